@@ -0,0 +1,659 @@
+// Micro-benchmarks for the kernels the emulator owns (Google Benchmark).
+//
+// Covers the refresh conversion (render_bw/gray_to_texture without SDL),
+// EInkDisplay::drawImage, status bar text through GlyphCache and through a
+// stand-in for GfxRenderer's pixel-by-pixel path, FsFile
+// read patterns, opening a library folder with and without LibraryIndex,
+// ZipEntryIndex builds and lookups, ImageToBmpConverter on generated PNGs,
+// the freertos_stub semaphore handoff and String building.
+// Baselines live in sim/bench/baseline/; compare a run against one with
+// Google Benchmark's tools/compare.py (see README "Benchmarks").
+//
+//   crosspoint_bench [--benchmark_filter=REGEX] [--benchmark_out=run.json --benchmark_out_format=json]
+
+#include <EInkDisplay.h>
+#include <FreeRTOSStub.h>
+#include <GlyphCache.h>
+#include <ImageToBmpConverter.h>
+#include <LibraryIndex.h>
+#include <SdFat.h>
+#include <WString.h>
+#include <ZipEntryIndex.h>
+#include <benchmark/benchmark.h>
+#include "sim_display.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// --- Refresh conversion -----------------------------------------------------
+
+// Text-like page: mostly white with dense short runs of black.
+std::vector<uint8_t> makePage(uint32_t seed) {
+  std::vector<uint8_t> buf(EInkDisplay::BUFFER_SIZE, 0xFF);
+  std::mt19937 rng(seed);
+  for (size_t i = 0; i < buf.size(); i++) {
+    if ((i / EInkDisplay::DISPLAY_WIDTH_BYTES) % 24 < 16 && rng() % 3 == 0) buf[i] = static_cast<uint8_t>(rng());
+  }
+  return buf;
+}
+
+constexpr int kWindowPitch = EInkDisplay::DISPLAY_HEIGHT * 3;
+
+void BM_ConvertBw(benchmark::State& state) {
+  const auto page = makePage(1);
+  std::vector<uint8_t> pixels(static_cast<size_t>(kWindowPitch) * EInkDisplay::DISPLAY_WIDTH);
+  for (auto _ : state) {
+    sim_display_convert_bw(page.data(), pixels.data(), kWindowPitch);
+    benchmark::DoNotOptimize(pixels.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(pixels.size()));
+}
+BENCHMARK(BM_ConvertBw);
+
+void BM_ConvertGray(benchmark::State& state) {
+  const auto bw = makePage(1);
+  const auto lsb = makePage(2);
+  const auto msb = makePage(3);
+  std::vector<uint8_t> pixels(static_cast<size_t>(kWindowPitch) * EInkDisplay::DISPLAY_WIDTH);
+  for (auto _ : state) {
+    sim_display_convert_gray(bw.data(), lsb.data(), msb.data(), pixels.data(), kWindowPitch);
+    benchmark::DoNotOptimize(pixels.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(pixels.size()));
+}
+BENCHMARK(BM_ConvertGray);
+
+// --- EInkDisplay::drawImage ---------------------------------------------------
+
+// Args: width, height, x. Odd x exercises the unaligned (bit-shifting) path.
+void BM_DrawImage(benchmark::State& state) {
+  const auto w = static_cast<uint16_t>(state.range(0));
+  const auto h = static_cast<uint16_t>(state.range(1));
+  const auto x = static_cast<uint16_t>(state.range(2));
+  static EInkDisplay display(0, 0, 0, 0, 0, 0);
+  display.clearScreen(0xFF);
+  std::vector<uint8_t> image(static_cast<size_t>((w + 7) / 8) * h);
+  std::mt19937 rng(7);
+  for (auto& b : image) b = static_cast<uint8_t>(rng());
+  for (auto _ : state) {
+    display.drawImage(image.data(), x, 16, w, h);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+BENCHMARK(BM_DrawImage)
+    ->ArgNames({"w", "h", "x"})
+    ->Args({32, 32, 0})
+    ->Args({32, 32, 3})
+    ->Args({240, 400, 0})
+    ->Args({240, 400, 5})
+    ->Args({800, 448, 0});
+
+// --- Glyph drawing ----------------------------------------------------------------
+
+// Stand-in for an EpdFont face: 95 ASCII glyphs of 12x17 pixels, 1 bit per
+// pixel packed row after row without padding, as in EpdFontData::bitmap.
+constexpr int kGlyphW = 12;
+constexpr int kGlyphH = 17;
+constexpr int kGlyphBytes = (kGlyphW * kGlyphH + 7) / 8;
+
+const std::vector<uint8_t>& glyphData() {
+  static const std::vector<uint8_t> data = [] {
+    std::vector<uint8_t> bits(95 * kGlyphBytes);
+    std::mt19937 rng(11);
+    for (auto& b : bits) b = static_cast<uint8_t>(rng() & rng());  // about a quarter ink
+    return bits;
+  }();
+  return data;
+}
+
+bool glyphInk(char c, int gx, int gy) {
+  const int i = gy * kGlyphW + gx;
+  return glyphData()[(c - ' ') * kGlyphBytes + (i >> 3)] & (0x80 >> (i & 7));
+}
+
+// A status bar's worth of text, drawn in portrait as the reader does:
+// logical (x, y) is framebuffer (y, DISPLAY_HEIGHT - 1 - x)
+const char kStatusText[] = "The Lantern Keeper   42%   118/412";
+constexpr int kTextX = 8;
+constexpr int kTextY = 771;
+
+void drawPixelPortrait(uint8_t* frame, int x, int y) {
+  const int px = y;
+  const int py = EInkDisplay::DISPLAY_HEIGHT - 1 - x;
+  frame[py * EInkDisplay::DISPLAY_WIDTH_BYTES + px / 8] &= static_cast<uint8_t>(~(0x80 >> (px & 7)));
+}
+
+// Stand-in for GfxRenderer::renderChar, which this tree does not build: every
+// pixel decoded from the font data and drawn through the rotation, as it does
+void drawTextDecoded(uint8_t* frame) {
+  int x = kTextX;
+  for (const char* c = kStatusText; *c; c++, x += kGlyphW) {
+    for (int gy = 0; gy < kGlyphH; gy++)
+      for (int gx = 0; gx < kGlyphW; gx++)
+        if (glyphInk(*c, gx, gy)) drawPixelPortrait(frame, x + gx, kTextY + gy);
+  }
+}
+
+// The same text through GlyphCache: bitmaps pre-rotated to the framebuffer
+void drawTextCached(GlyphCache& cache, uint8_t* frame) {
+  static const uint8_t font = 0;
+  int x = kTextX;
+  for (const char* c = kStatusText; *c; c++, x += kGlyphW) {
+    const int px = kTextY;
+    const int py = EInkDisplay::DISPLAY_HEIGHT - x - kGlyphW;
+    const char ch = *c;
+    const GlyphCache::Key key{&font, static_cast<uint32_t>(ch), 0, 1, static_cast<uint8_t>(px & 7)};
+    const auto* glyph =
+        cache.get(key, kGlyphH, kGlyphW, [ch](int u, int v) { return glyphInk(ch, kGlyphW - 1 - v, u); });
+    if (glyph) {
+      GlyphCache::blit(frame, EInkDisplay::DISPLAY_WIDTH_BYTES, EInkDisplay::DISPLAY_HEIGHT, px, py, *glyph, true);
+    } else {
+      for (int gy = 0; gy < kGlyphH; gy++)
+        for (int gx = 0; gx < kGlyphW; gx++)
+          if (glyphInk(ch, gx, gy)) drawPixelPortrait(frame, x + gx, kTextY + gy);
+    }
+  }
+}
+
+constexpr int64_t kStatusGlyphs = sizeof(kStatusText) - 1;
+
+// The baseline for BM_GlyphDrawCached: a stand-in for the firmware's text
+// path, not a measurement of it
+void BM_GlyphDrawStandInDecoded(benchmark::State& state) {
+  std::vector<uint8_t> frame(EInkDisplay::BUFFER_SIZE, 0xFF);
+  for (auto _ : state) {
+    drawTextDecoded(frame.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStatusGlyphs);
+}
+BENCHMARK(BM_GlyphDrawStandInDecoded);
+
+// Arg: budget in KB. 1 KB holds fewer glyphs than the line uses, so most
+// draws rebuild their entry: the cost of a cache that is too small.
+void BM_GlyphDrawCached(benchmark::State& state) {
+  GlyphCache cache(static_cast<size_t>(state.range(0)) * 1024);
+  std::vector<uint8_t> expected(EInkDisplay::BUFFER_SIZE, 0xFF);
+  std::vector<uint8_t> frame(EInkDisplay::BUFFER_SIZE, 0xFF);
+  drawTextDecoded(expected.data());
+  drawTextCached(cache, frame.data());
+  if (frame != expected) {
+    state.SkipWithError("cached glyphs differ from decoded ones");
+    return;
+  }
+  for (auto _ : state) {
+    drawTextCached(cache, frame.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStatusGlyphs);
+  state.counters["hit_rate"] = static_cast<double>(cache.hits()) / (cache.hits() + cache.misses());
+  state.counters["cache_kb"] = static_cast<double>(cache.used()) / 1024;
+}
+BENCHMARK(BM_GlyphDrawCached)->Arg(32)->Arg(1);
+
+// --- FsFile ---------------------------------------------------------------------
+
+// Scratch SD root under $TMPDIR holding the files the storage and image cases read.
+class Scratch {
+ public:
+  Scratch() {
+    const char* tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp && *tmp ? tmp : "/tmp") + "/crosspoint_bench.XXXXXX";
+    std::vector<char> path(templ.begin(), templ.end());
+    path.push_back('\0');
+    if (!mkdtemp(path.data())) {
+      perror("mkdtemp");
+      exit(1);
+    }
+    root_ = path.data();
+    FsFile::setRootPath(root_);
+  }
+  ~Scratch() {
+    for (const auto& name : files_) unlink((root_ + "/" + name).c_str());
+    rmdir(root_.c_str());
+  }
+
+  // Writes `data` as /name (once) and returns the SD path.
+  std::string put(const std::string& name, const std::vector<uint8_t>& data) {
+    for (const auto& f : files_)
+      if (f == name) return "/" + name;
+    FILE* f = fopen((root_ + "/" + name).c_str(), "wb");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+      perror(name.c_str());
+      exit(1);
+    }
+    fclose(f);
+    files_.push_back(name);
+    return "/" + name;
+  }
+
+  // Removes /name at exit too (files the code under test creates).
+  void adopt(const std::string& name) {
+    if (std::find(files_.begin(), files_.end(), name) == files_.end()) files_.push_back(name);
+  }
+
+ private:
+  std::string root_;
+  std::vector<std::string> files_;
+};
+
+Scratch& scratch() {
+  static Scratch s;
+  return s;
+}
+
+constexpr size_t kFileSize = 4 * 1024 * 1024;
+
+std::string dataFile() {
+  std::vector<uint8_t> data(kFileSize);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+  return scratch().put("data.bin", data);
+}
+
+// Arg: chunk size passed to read(buf, n)
+void BM_FsFileSequentialRead(benchmark::State& state) {
+  const std::string path = dataFile();
+  const auto chunk = static_cast<size_t>(state.range(0));
+  std::vector<uint8_t> buf(chunk);
+  for (auto _ : state) {
+    FsFile file;
+    file.open(path.c_str(), O_RDONLY);
+    size_t total = 0;
+    for (int n; (n = file.read(buf.data(), chunk)) > 0;) total += static_cast<size_t>(n);
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(kFileSize));
+}
+BENCHMARK(BM_FsFileSequentialRead)->RangeMultiplier(8)->Range(64, 32 << 10)->Unit(benchmark::kMillisecond);
+
+// read() one byte at a time, as the parsers' Stream paths do
+void BM_FsFileByteRead(benchmark::State& state) {
+  const std::string path = dataFile();
+  constexpr size_t kBytes = 256 * 1024;
+  FsFile file;
+  file.open(path.c_str(), O_RDONLY);
+  for (auto _ : state) {
+    file.seek(0);
+    unsigned sum = 0;
+    for (size_t i = 0; i < kBytes; i++) sum += static_cast<unsigned>(file.read());
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(kBytes));
+}
+BENCHMARK(BM_FsFileByteRead)->Unit(benchmark::kMillisecond);
+
+// seek + read(n) at random offsets, like ZIP central-directory lookups
+void BM_FsFileRandomRead(benchmark::State& state) {
+  const std::string path = dataFile();
+  const auto chunk = static_cast<size_t>(state.range(0));
+  std::vector<uint8_t> buf(chunk);
+  FsFile file;
+  file.open(path.c_str(), O_RDONLY);
+  std::mt19937 rng(11);
+  for (auto _ : state) {
+    file.seek(static_cast<uint32_t>(rng() % (kFileSize - chunk)));
+    benchmark::DoNotOptimize(file.read(buf.data(), chunk));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(chunk));
+}
+BENCHMARK(BM_FsFileRandomRead)->Arg(46)->Arg(512)->Arg(4096);
+
+// --- Library folder open ------------------------------------------------------------
+
+// Arg: books in the folder. Per book, a folder view without the index opens a
+// cached metadata file (title, author) and progress.bin.
+void BM_LibraryOpenPerBook(benchmark::State& state) {
+  const auto books = static_cast<int>(state.range(0));
+  for (int i = 0; i < books; i++) {
+    scratch().put("meta_" + std::to_string(i) + ".bin", std::vector<uint8_t>(256, 'a'));
+    scratch().put("progress_" + std::to_string(i) + ".bin", {1, 0, 2, 0, 40, 0, 17, 0});
+  }
+  uint8_t meta[256];
+  uint8_t progress[8];
+  for (auto _ : state) {
+    unsigned sum = 0;
+    for (int i = 0; i < books; i++) {
+      FsFile f;
+      f.open(("/meta_" + std::to_string(i) + ".bin").c_str(), O_RDONLY);
+      sum += static_cast<unsigned>(f.read(meta, sizeof(meta)));
+      f.open(("/progress_" + std::to_string(i) + ".bin").c_str(), O_RDONLY);
+      sum += static_cast<unsigned>(f.read(progress, sizeof(progress)));
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * books);
+}
+BENCHMARK(BM_LibraryOpenPerBook)->Arg(100)->Arg(500)->Unit(benchmark::kMillisecond);
+
+// The same folder from /library.idx: one file read, then a lookup per book.
+void BM_LibraryOpenIndex(benchmark::State& state) {
+  const auto books = static_cast<int>(state.range(0));
+  scratch().adopt("library.idx");
+  scratch().adopt("library.idx.tmp");
+  LibraryIndex index("/library.idx");
+  for (int i = 0; i < books; i++) {
+    const std::string book = scratch().put("book_" + std::to_string(i) + ".epub", std::vector<uint8_t>(64, 'b'));
+    index.recordBook(book, "The Lantern Keeper " + std::to_string(i), "Sample Author", true);
+    index.recordProgress(book, static_cast<uint8_t>(i % 101));
+  }
+  for (auto _ : state) {
+    index.reload();
+    unsigned sum = 0;
+    for (int i = 0; i < books; i++) {
+      LibraryIndex::Entry e;
+      if (index.find("/book_" + std::to_string(i) + ".epub", e)) sum += e.percent;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * books);
+}
+BENCHMARK(BM_LibraryOpenIndex)->Arg(100)->Arg(500)->Unit(benchmark::kMillisecond);
+
+// --- ZipEntryIndex ------------------------------------------------------------------
+
+void putLe(std::vector<uint8_t>& out, uint32_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+// Stored ZIP shaped like an image-heavy EPUB: OPF, NCX, then `entries` images.
+std::string zipFile(int entries) {
+  const std::string name = "book_" + std::to_string(entries) + ".epub";
+  std::vector<std::string> names = {"mimetype", "OEBPS/content.opf", "OEBPS/toc.ncx"};
+  for (int i = 0; i < entries; i++) names.push_back("OEBPS/images/img" + std::to_string(i) + ".png");
+  std::vector<uint8_t> zip, central;
+  for (size_t i = 0; i < names.size(); i++) {
+    const uint32_t offset = static_cast<uint32_t>(zip.size());
+    const uint32_t size = static_cast<uint32_t>(16 + i % 48);
+    putLe(zip, 0x04034b50, 4);
+    putLe(zip, 20, 2);
+    putLe(zip, 0, 8);  // flags, method, time, date
+    putLe(zip, 0, 4);  // crc
+    putLe(zip, size, 4);
+    putLe(zip, size, 4);
+    putLe(zip, static_cast<uint32_t>(names[i].size()), 2);
+    putLe(zip, 0, 2);
+    zip.insert(zip.end(), names[i].begin(), names[i].end());
+    zip.insert(zip.end(), size, 'z');
+
+    putLe(central, 0x02014b50, 4);
+    putLe(central, 20, 2);
+    putLe(central, 20, 2);
+    putLe(central, 0, 8);
+    putLe(central, 0, 4);
+    putLe(central, size, 4);
+    putLe(central, size, 4);
+    putLe(central, static_cast<uint32_t>(names[i].size()), 2);
+    putLe(central, 0, 4);  // extra, comment
+    putLe(central, 0, 8);  // disk, attributes
+    putLe(central, offset, 4);
+    central.insert(central.end(), names[i].begin(), names[i].end());
+  }
+  const uint32_t cdOffset = static_cast<uint32_t>(zip.size());
+  zip.insert(zip.end(), central.begin(), central.end());
+  putLe(zip, 0x06054b50, 4);
+  putLe(zip, 0, 4);
+  putLe(zip, static_cast<uint32_t>(names.size()), 2);
+  putLe(zip, static_cast<uint32_t>(names.size()), 2);
+  putLe(zip, static_cast<uint32_t>(central.size()), 4);
+  putLe(zip, cdOffset, 4);
+  putLe(zip, 0, 2);
+  return scratch().put(name, zip);
+}
+
+// Arg: image entries. Every open walks the central directory and writes the table.
+void BM_ZipIndexBuild(benchmark::State& state) {
+  const std::string zip = zipFile(static_cast<int>(state.range(0)));
+  scratch().adopt("zip_build.idx");
+  ZipEntryIndex index;
+  for (auto _ : state) {
+    state.PauseTiming();
+    remove((FsFile::rootPath() + "/zip_build.idx").c_str());
+    state.ResumeTiming();
+    index.open(zip, "/zip_build.idx");
+    benchmark::DoNotOptimize(index.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ZipIndexBuild)->Arg(100)->Arg(3000)->Unit(benchmark::kMicrosecond);
+
+// The same open from the cached table, then the lookups Epub::load makes.
+void BM_ZipIndexCached(benchmark::State& state) {
+  const std::string zip = zipFile(static_cast<int>(state.range(0)));
+  scratch().adopt("zip_cached.idx");
+  ZipEntryIndex index;
+  index.open(zip, "/zip_cached.idx");
+  ZipEntryIndex::Entry entry;
+  for (auto _ : state) {
+    index.open(zip, "/zip_cached.idx");
+    bool found = index.find("OEBPS/content.opf", entry);
+    found &= index.find("OEBPS/toc.ncx", entry);
+    found &= index.find("OEBPS/images/img42.png", entry);
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ZipIndexCached)->Arg(100)->Arg(3000)->Unit(benchmark::kMicrosecond);
+
+// --- ImageToBmpConverter ----------------------------------------------------------
+
+uint32_t pngCrc(const uint8_t* p, size_t n, uint32_t crc = 0) {
+  crc = ~crc;
+  while (n--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(v >> shift));
+}
+
+void chunk(std::vector<uint8_t>& out, const char* tag, const std::vector<uint8_t>& data) {
+  put32(out, static_cast<uint32_t>(data.size()));
+  const size_t start = out.size();
+  out.insert(out.end(), tag, tag + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put32(out, pngCrc(out.data() + start, out.size() - start));
+}
+
+// RGB PNG of a cover-like gradient with noise. The zlib stream uses stored
+// blocks, so the case measures decode filters, scaling and dithering rather
+// than inflate.
+std::vector<uint8_t> makePng(int width, int height) {
+  std::vector<uint8_t> raw;
+  raw.reserve(static_cast<size_t>(width * 3 + 1) * height);
+  std::mt19937 rng(static_cast<uint32_t>(width * 31 + height));
+  for (int y = 0; y < height; y++) {
+    raw.push_back(0);
+    for (int x = 0; x < width; x++) {
+      const int shade = x * 80 / width + y * 160 / height + static_cast<int>(rng() % 24);
+      raw.push_back(static_cast<uint8_t>(shade));
+      raw.push_back(static_cast<uint8_t>(shade / 2 + 40));
+      raw.push_back(static_cast<uint8_t>(255 - shade));
+    }
+  }
+
+  std::vector<uint8_t> z = {0x78, 0x01};
+  for (size_t pos = 0; pos < raw.size();) {
+    const size_t len = std::min<size_t>(65535, raw.size() - pos);
+    z.push_back(pos + len == raw.size() ? 1 : 0);
+    z.push_back(static_cast<uint8_t>(len));
+    z.push_back(static_cast<uint8_t>(len >> 8));
+    z.push_back(static_cast<uint8_t>(~len));
+    z.push_back(static_cast<uint8_t>(~len >> 8));
+    z.insert(z.end(), raw.begin() + static_cast<std::ptrdiff_t>(pos), raw.begin() + static_cast<std::ptrdiff_t>(pos + len));
+    pos += len;
+  }
+  uint32_t a = 1, b = 0;
+  for (const uint8_t c : raw) {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(z, (b << 16) | a);
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> header;
+  put32(header, static_cast<uint32_t>(width));
+  put32(header, static_cast<uint32_t>(height));
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  chunk(png, "IHDR", header);
+  chunk(png, "IDAT", z);
+  chunk(png, "IEND", {});
+  return png;
+}
+
+class NullPrint : public Print {
+ public:
+  size_t write(uint8_t) override {
+    bytes++;
+    return 1;
+  }
+  size_t write(const uint8_t*, size_t size) override {
+    bytes += size;
+    return size;
+  }
+  size_t bytes = 0;
+};
+
+std::string pngFile(int width, int height) {
+  return scratch().put("img_" + std::to_string(width) + "x" + std::to_string(height) + ".png",
+                       makePng(width, height));
+}
+
+// Args: source width, height. 2-bit cover conversion (fit to 480x800).
+void BM_ImageToBmpCover(benchmark::State& state) {
+  const std::string path = pngFile(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    FsFile file;
+    file.open(path.c_str(), O_RDONLY);
+    NullPrint out;
+    if (!ImageToBmpConverter::imageToBmpStream(file, out, false)) state.SkipWithError("conversion failed");
+    benchmark::DoNotOptimize(out.bytes);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_ImageToBmpCover)
+    ->ArgNames({"w", "h"})
+    ->Args({240, 400})
+    ->Args({480, 800})
+    ->Args({1200, 1600})
+    ->Unit(benchmark::kMillisecond);
+
+// Args: source width, height. 1-bit library thumbnail, 100 px high.
+void BM_ImageToBmpThumb(benchmark::State& state) {
+  const std::string path = pngFile(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    FsFile file;
+    file.open(path.c_str(), O_RDONLY);
+    NullPrint out;
+    if (!ImageToBmpConverter::imageTo1BitBmpStreamWithSize(file, out, 60, 100)) {
+      state.SkipWithError("conversion failed");
+    }
+    benchmark::DoNotOptimize(out.bytes);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_ImageToBmpThumb)->ArgNames({"w", "h"})->Args({480, 800})->Args({1200, 1600})->Unit(benchmark::kMillisecond);
+
+// --- freertos_stub ------------------------------------------------------------------
+
+// Uncontended take/give, the common case for the rendering mutex
+void BM_MutexTakeGive(benchmark::State& state) {
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  for (auto _ : state) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    xSemaphoreGive(mutex);
+  }
+  vSemaphoreDelete(mutex);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MutexTakeGive);
+
+struct PingPong {
+  SemaphoreHandle_t ping;
+  SemaphoreHandle_t pong;
+};
+
+void pongTask(void* param) {
+  auto* pp = static_cast<PingPong*>(param);
+  while (true) {
+    xSemaphoreTake(pp->ping, portMAX_DELAY);
+    xSemaphoreGive(pp->pong);
+  }
+}
+
+// Handoff to a task and back: two binary semaphores, two task switches per
+// iteration (fibers with SIM_CORES=1, host threads otherwise)
+void BM_TaskHandoff(benchmark::State& state) {
+  PingPong pp{xSemaphoreCreateBinary(), xSemaphoreCreateBinary()};
+  TaskHandle_t task = nullptr;
+  xTaskCreate(pongTask, "pong", 4096, &pp, 1, &task);
+  for (auto _ : state) {
+    xSemaphoreGive(pp.ping);
+    xSemaphoreTake(pp.pong, portMAX_DELAY);
+  }
+  vTaskDelete(task);
+  vSemaphoreDelete(pp.ping);
+  vSemaphoreDelete(pp.pong);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TaskHandoff);
+
+// --- String -----------------------------------------------------------------------------
+
+// += of short pieces, as in path and label building
+void BM_StringAppend(benchmark::State& state) {
+  const auto pieces = state.range(0);
+  for (auto _ : state) {
+    String s;
+    for (int64_t i = 0; i < pieces; i++) {
+      s += "/chapter";
+      s += static_cast<char>('0' + i % 10);
+    }
+    benchmark::DoNotOptimize(s.c_str());
+  }
+  state.SetItemsProcessed(state.iterations() * pieces);
+}
+BENCHMARK(BM_StringAppend)->Arg(8)->Arg(64)->Arg(512);
+
+// a + b + c temporaries, as in "[" + tag + "] " + message
+void BM_StringConcat(benchmark::State& state) {
+  const String tag("EPB");
+  const String message("Section cache hit for chapter 12 of The Lantern Keeper");
+  for (auto _ : state) {
+    String line = "[" + tag + "] " + message + '\n';
+    benchmark::DoNotOptimize(line.c_str());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StringConcat);
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // The converter logs every image; keep the tables readable
+  setenv("SIM_LOG", "*=warn", 0);
+  sim_rtos_begin();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::AddCustomContext("sim_cores", getenv("SIM_CORES") ? getenv("SIM_CORES") : "1");
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,134 @@
+// MD5Builder throughput benchmark (emulator only).
+//
+// Checks the RFC 1321 test vectors, then measures add() over buffers of
+// several sizes and addStream() over a stream with a bulk readBytes() path
+// versus one that only reads byte by byte.
+//
+//   crosspoint_md5_bench [--mb 256]
+
+#include <MD5Builder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// In-memory stream; `bulk` selects whether readBytes() is overridden.
+class MemoryStream : public Stream {
+ public:
+  MemoryStream(const std::vector<uint8_t>& data, size_t total, bool bulk) : data_(data), left_(total), bulk_(bulk) {}
+
+  int available() override { return static_cast<int>(std::min<size_t>(left_, 0x7fffffff)); }
+  int read() override {
+    if (left_ == 0) return -1;
+    left_--;
+    const uint8_t c = data_[pos_];
+    pos_ = (pos_ + 1) % data_.size();
+    return c;
+  }
+  size_t readBytes(uint8_t* buf, size_t len) override {
+    if (!bulk_) return Stream::readBytes(buf, len);
+    size_t n = 0;
+    while (n < len && left_ > 0) {
+      const size_t take = std::min({len - n, left_, data_.size() - pos_});
+      memcpy(buf + n, data_.data() + pos_, take);
+      n += take;
+      left_ -= take;
+      pos_ = (pos_ + take) % data_.size();
+    }
+    return n;
+  }
+
+ private:
+  const std::vector<uint8_t>& data_;
+  size_t pos_ = 0;
+  size_t left_;
+  bool bulk_;
+};
+
+std::string md5Hex(const char* text) {
+  MD5Builder md5;
+  md5.begin();
+  md5.add(text);
+  md5.calculate();
+  return md5.toString().c_str();
+}
+
+bool checkVectors() {
+  static const char* const kVectors[][2] = {
+      {"", "d41d8cd98f00b204e9800998ecf8427e"},
+      {"a", "0cc175b9c0f1b6a831c399e269772661"},
+      {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+      {"message digest", "f96b697d7cb7938d525a2f31aaf161d0"},
+      {"abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b"},
+      {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f"},
+      {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+       "57edf4a22be3c955ac49da2e2107b67a"},
+  };
+  bool ok = true;
+  for (const auto& v : kVectors) {
+    const std::string got = md5Hex(v[0]);
+    if (got != v[1]) {
+      fprintf(stderr, "MD5(\"%s\") = %s, expected %s\n", v[0], got.c_str(), v[1]);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+double mbPerSec(size_t bytes, Clock::duration d) {
+  const double s = std::chrono::duration<double>(d).count();
+  return s > 0 ? bytes / (1024.0 * 1024.0) / s : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t totalMb = 256;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--mb")) {
+      totalMb = static_cast<size_t>(std::max(1, atoi(argv[i + 1])));
+    } else {
+      fprintf(stderr, "usage: %s [--mb MEGABYTES]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!checkVectors()) return 1;
+  printf("MD5 test vectors OK\n");
+
+  const size_t total = totalMb * 1024 * 1024;
+  std::vector<uint8_t> data(1024 * 1024);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+
+  printf("%-28s %10s %10s\n", "case", "MB", "MB/s");
+  for (const size_t chunk : {size_t{64}, size_t{1024}, size_t{16 * 1024}, size_t{1024 * 1024}}) {
+    MD5Builder md5;
+    md5.begin();
+    const auto t0 = Clock::now();
+    for (size_t done = 0; done < total; done += chunk) md5.add(data.data(), std::min(chunk, total - done));
+    md5.calculate();
+    char label[64];
+    snprintf(label, sizeof(label), "add() %zu-byte buffers", chunk);
+    printf("%-28s %10zu %10.1f\n", label, totalMb, mbPerSec(total, Clock::now() - t0));
+  }
+
+  for (const bool bulk : {true, false}) {
+    // The byte-by-byte path is far slower; keep its run short.
+    const size_t bytes = bulk ? total : std::min(total, size_t{32} * 1024 * 1024);
+    MemoryStream stream(data, bytes, bulk);
+    MD5Builder md5;
+    md5.begin();
+    const auto t0 = Clock::now();
+    const bool complete = md5.addStream(stream, bytes);
+    md5.calculate();
+    printf("%-28s %10zu %10.1f%s\n", bulk ? "addStream() bulk readBytes" : "addStream() read() per byte",
+           bytes / (1024 * 1024), mbPerSec(bytes, Clock::now() - t0), complete ? "" : "  (short read)");
+  }
+  return 0;
+}
@@ -0,0 +1,250 @@
+// OPDS feed parser benchmark (emulator only).
+//
+// Generates synthetic OPDS Atom catalogs on the fly and pushes them through
+// OpdsParser's streaming Print interface in fixed-size chunks, the way
+// HttpDownloader::fetchUrl() feeds it from the network. Reports parse
+// throughput, peak heap and heap allocations per entry.
+//
+//   crosspoint_opds_bench [--entries 1000,10000,100000] [--chunk 1024]
+//                         [--summary 2000] [--depth 8]
+
+#include <OpdsParser.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Heap accounting. On glibc every malloc is counted (expat allocates with
+// malloc); elsewhere only C++ allocations are.
+// ---------------------------------------------------------------------------
+
+namespace {
+
+std::atomic<uint64_t> g_allocs{0};
+std::atomic<int64_t> g_liveBytes{0};
+std::atomic<int64_t> g_peakBytes{0};
+
+void noteAlloc(size_t bytes) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  const int64_t live = g_liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) +
+                       static_cast<int64_t>(bytes);
+  int64_t peak = g_peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void noteFree(size_t bytes) { g_liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed); }
+
+}  // namespace
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t n) {
+  void* p = __libc_malloc(n);
+  if (p) noteAlloc(malloc_usable_size(p));
+  return p;
+}
+void* calloc(size_t n, size_t size) {
+  void* p = __libc_calloc(n, size);
+  if (p) noteAlloc(malloc_usable_size(p));
+  return p;
+}
+void* realloc(void* old, size_t n) {
+  const size_t oldBytes = old ? malloc_usable_size(old) : 0;
+  void* p = __libc_realloc(old, n);
+  if (p) {
+    noteFree(oldBytes);
+    noteAlloc(malloc_usable_size(p));
+  }
+  return p;
+}
+void free(void* p) {
+  if (p) noteFree(malloc_usable_size(p));
+  __libc_free(p);
+}
+}
+#else
+void* operator new(size_t n) {
+  void* p = std::malloc(n + sizeof(std::max_align_t));
+  if (!p) throw std::bad_alloc();
+  *static_cast<size_t*>(p) = n;
+  noteAlloc(n);
+  return static_cast<char*>(p) + sizeof(std::max_align_t);
+}
+void operator delete(void* p) noexcept {
+  if (!p) return;
+  void* base = static_cast<char*>(p) - sizeof(std::max_align_t);
+  noteFree(*static_cast<size_t*>(base));
+  std::free(base);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::vector<int> entries{1000, 10000, 100000};
+  size_t chunk = 1024;
+  size_t summary = 2000;
+  int depth = 8;
+};
+
+// Writes one catalog entry. Every third entry is a navigation link, the rest
+// are books with acquisition links, categories and a deeply nested summary.
+void appendEntry(std::string& out, int i, const Options& opt) {
+  char buf[512];
+  const bool navigation = i % 3 == 0;
+  snprintf(buf, sizeof(buf),
+           "<entry>\n"
+           "  <title>%s %d: The Long and Winding Title of a Synthetic Book</title>\n"
+           "  <id>urn:uuid:5f2c%08x-0000-4000-8000-%012d</id>\n"
+           "  <updated>2026-01-%02dT12:00:00Z</updated>\n",
+           navigation ? "Series" : "Book", i, i, i, 1 + i % 28);
+  out += buf;
+  if (navigation) {
+    snprintf(buf, sizeof(buf),
+             "  <link rel=\"subsection\" href=\"/opds/series/%d?page=1&amp;sort=title\" "
+             "type=\"application/atom+xml;profile=opds-catalog;kind=navigation\"/>\n"
+             "  <content type=\"text\">Books in series %d</content>\n</entry>\n",
+             i, i);
+    out += buf;
+    return;
+  }
+  snprintf(buf, sizeof(buf),
+           "  <author><name>Author %d</name><uri>/opds/author/%d</uri></author>\n"
+           "  <category term=\"Fiction\" label=\"Fiction\"/><category term=\"Fantasy\" label=\"Fantasy\"/>\n"
+           "  <link rel=\"http://opds-spec.org/image/thumbnail\" href=\"/get/thumb/%d\" type=\"image/jpeg\"/>\n"
+           "  <link rel=\"http://opds-spec.org/acquisition\" href=\"/get/epub/%d/book_%d.epub\" "
+           "type=\"application/epub+zip\" length=\"%d\"/>\n",
+           i % 997, i % 997, i, i, i, 250000 + i);
+  out += buf;
+  out += "  <summary type=\"xhtml\"><div xmlns=\"http://www.w3.org/1999/xhtml\">";
+  for (int d = 0; d < opt.depth; d++) out += d % 2 ? "<span class=\"x\">" : "<div>";
+  static const char kLorem[] =
+      "Lorem ipsum dolor sit amet, consectetur adipiscing elit &amp; sed do eiusmod tempor "
+      "incididunt ut labore et dolore magna aliqua. &#8220;Ut enim&#8221; ad minim veniam. ";
+  for (size_t n = 0; n < opt.summary; n += sizeof(kLorem) - 1) out += kLorem;
+  for (int d = opt.depth - 1; d >= 0; d--) out += d % 2 ? "</span>" : "</div>";
+  out += "</div></summary>\n</entry>\n";
+}
+
+struct Result {
+  double parseMs = 0;
+  size_t bytes = 0;
+  size_t parsedEntries = 0;
+  uint64_t allocs = 0;
+  int64_t peakBytes = 0;
+  bool ok = false;
+};
+
+Result run(int entryCount, const Options& opt) {
+  std::string pending;
+  pending.reserve(opt.chunk + 64 * 1024);
+  Result r;
+  Clock::duration parseTime{};
+
+  const int64_t baseline = g_liveBytes.load();
+  g_peakBytes.store(baseline);
+  const uint64_t allocsBefore = g_allocs.load();
+  {
+    OpdsParser parser;
+    // Feeds whole chunks to the parser, keeping the remainder for later.
+    auto feed = [&](bool final) {
+      size_t off = 0;
+      while (pending.size() - off >= opt.chunk || (final && off < pending.size())) {
+        const size_t n = std::min(opt.chunk, pending.size() - off);
+        const auto t0 = Clock::now();
+        parser.write(reinterpret_cast<const uint8_t*>(pending.data() + off), n);
+        parseTime += Clock::now() - t0;
+        r.bytes += n;
+        off += n;
+      }
+      pending.erase(0, off);
+    };
+
+    pending +=
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<feed xmlns=\"http://www.w3.org/2005/Atom\" xmlns:opds=\"http://opds-spec.org/2010/catalog\" "
+        "xmlns:dc=\"http://purl.org/dc/terms/\">\n"
+        "  <id>urn:uuid:synthetic-catalog</id>\n  <title>Synthetic Catalog</title>\n"
+        "  <updated>2026-01-01T00:00:00Z</updated>\n"
+        "  <link rel=\"self\" href=\"/opds\" type=\"application/atom+xml;profile=opds-catalog\"/>\n";
+    for (int i = 0; i < entryCount; i++) {
+      appendEntry(pending, i, opt);
+      feed(false);
+    }
+    pending += "</feed>\n";
+    feed(true);
+    const auto t0 = Clock::now();
+    parser.flush();
+    parseTime += Clock::now() - t0;
+
+    r.ok = !parser.error();
+    r.parsedEntries = parser.getEntries().size();
+    r.allocs = g_allocs.load() - allocsBefore;
+    r.peakBytes = g_peakBytes.load() - baseline;
+  }
+  r.parseMs = std::chrono::duration<double, std::milli>(parseTime).count();
+  return r;
+}
+
+std::vector<int> parseList(const char* s) {
+  std::vector<int> out;
+  for (const char* p = s; *p;) {
+    out.push_back(atoi(p));
+    p = strchr(p, ',');
+    if (!p) break;
+    p++;
+  }
+  return out;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  setenv("SIM_LOG", "*=warn", 0);  // the parser's per-entry logging is not what we measure
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--entries")) opt.entries = parseList(argv[i + 1]);
+    else if (!strcmp(argv[i], "--chunk")) opt.chunk = std::max(1, atoi(argv[i + 1]));
+    else if (!strcmp(argv[i], "--summary")) opt.summary = static_cast<size_t>(std::max(0, atoi(argv[i + 1])));
+    else if (!strcmp(argv[i], "--depth")) opt.depth = std::max(0, atoi(argv[i + 1]));
+    else {
+      fprintf(stderr, "usage: %s [--entries N,N,...] [--chunk BYTES] [--summary CHARS] [--depth N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("OpdsParser: %zu-byte chunks, %zu-char summaries, nesting depth %d\n", opt.chunk, opt.summary,
+         opt.depth);
+  printf("%9s %9s %10s %10s %11s %12s %11s\n", "entries", "parsed", "feed MB", "parse ms", "entries/s",
+         "peak heap KB", "allocs/entry");
+  bool allOk = true;
+  for (int n : opt.entries) {
+    const Result r = run(n, opt);
+    allOk = allOk && r.ok;
+    printf("%9d %9zu %10.1f %10.1f %11.0f %12.1f %11.2f%s\n", n, r.parsedEntries,
+           static_cast<double>(r.bytes) / (1024.0 * 1024.0), r.parseMs,
+           r.parseMs > 0 ? n / (r.parseMs / 1000.0) : 0.0, static_cast<double>(r.peakBytes) / 1024.0,
+           n ? static_cast<double>(r.allocs) / n : 0.0, r.ok ? "" : "  (parser error)");
+  }
+  return allOk ? 0 : 1;
+}
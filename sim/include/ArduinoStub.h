@@ -4,6 +4,7 @@
 #define PROGMEM
 #endif
 
+#include <atomic>
 #include <cstdarg>
 #include <cstddef>
 #include <cstdint>
@@ -13,25 +14,39 @@
 #include <chrono>
 #include <thread>
 
+#include "sim_log.h"
+
 // Minimal Arduino-like API for host build
 
+// Device time the CPU-cost model (sim_profile.h) adds on top of host time.
+extern std::atomic<long long> g_simClockSkewUs;
+
 inline unsigned long millis() {
   static const auto start = std::chrono::steady_clock::now();
   auto now = std::chrono::steady_clock::now();
+  const long long skewMs = g_simClockSkewUs.load(std::memory_order_relaxed) / 1000;
   return static_cast<unsigned long>(
-      std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count());
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() + skewMs);
 }
 
+// Scheduling points of the sim FreeRTOS scheduler (freertos_stub.cpp): block the
+// calling task for ms, or let other ready tasks of the same or higher priority run.
+void sim_task_delay(unsigned long ms);
+void sim_task_yield();
+
+// Blocks the calling task until `fd` has any of `events` (poll(2) flags) or
+// timeoutMs passes; returns the revents, 0 on timeout. Other tasks keep
+// running, in fiber mode too: the scheduler polls the fd.
+short sim_task_wait_fd(int fd, short events, int timeoutMs);
+
 // Cap delay to 1ms in the emulator to keep the UI responsive.
 // On the real device delay(10) saves power; in the sim it just adds latency.
 inline void delay(unsigned long ms) {
   unsigned long capped = ms > 1 ? 1 : ms;
-  if (capped > 0) std::this_thread::sleep_for(std::chrono::milliseconds(capped));
+  sim_task_delay(capped);
 }
 
-inline void yield() {
-  std::this_thread::sleep_for(std::chrono::microseconds(100));
-}
+inline void yield() { sim_task_yield(); }
 
 // Arduino random(): random(max) returns 0..max-1; random(min,max) returns min..max-1
 inline long random(long max) {
@@ -67,6 +82,13 @@ class Stream : public Print {
   virtual int available() { return 0; }
   virtual int read() { return -1; }
   virtual int peek() { return -1; }
+  // Bulk read; streams with a faster path than read() per byte override it.
+  virtual size_t readBytes(uint8_t* buf, size_t len) {
+    size_t n = 0;
+    for (int c; n < len && (c = read()) >= 0;) buf[n++] = static_cast<uint8_t>(c);
+    return n;
+  }
+  size_t readBytes(char* buf, size_t len) { return readBytes(reinterpret_cast<uint8_t*>(buf), len); }
   size_t write(uint8_t c) override { return 0; }
 };
 
@@ -76,22 +98,24 @@ class SerialStub : public Print {
   operator bool() const { return true; }
   int available() const { return 0; }
   int read() { return -1; }
+  // Output goes through the async log sink (sim_log.h); nothing here blocks on
+  // the terminal.
+  void flush() override { sim_log_flush(); }
   size_t write(uint8_t c) override {
-    putchar(static_cast<char>(c));
+    const char ch = static_cast<char>(c);
+    sim_log_write(&ch, 1);
     return 1;
   }
   size_t write(const uint8_t* buf, size_t size) override {
-    for (size_t i = 0; i < size; i++) putchar(static_cast<char>(buf[i]));
+    sim_log_write(reinterpret_cast<const char*>(buf), size);
     return size;
   }
   size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
     va_list args;
     va_start(args, fmt);
-    char buf[512];
-    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    const size_t n = sim_log_vprintf(fmt, args);
     va_end(args);
-    if (n > 0) fwrite(buf, 1, static_cast<size_t>(n), stdout);
-    return static_cast<size_t>(n);
+    return n;
   }
 };
 
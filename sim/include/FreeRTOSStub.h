@@ -1,19 +1,67 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+using BaseType_t = int;
+using UBaseType_t = unsigned;
+using TickType_t = uint32_t;
 using TaskHandle_t = void*;
 using SemaphoreHandle_t = void*;
+using QueueHandle_t = void*;
 
-constexpr int pdPASS = 1;
-constexpr unsigned portMAX_DELAY = 0xFFFFFFFF;
+constexpr BaseType_t pdFALSE = 0;
+constexpr BaseType_t pdTRUE = 1;
+constexpr BaseType_t pdFAIL = pdFALSE;
+constexpr BaseType_t pdPASS = pdTRUE;
+constexpr BaseType_t errQUEUE_EMPTY = pdFALSE;
+constexpr BaseType_t errQUEUE_FULL = pdFALSE;
+constexpr TickType_t portMAX_DELAY = 0xFFFFFFFF;
 constexpr int portTICK_PERIOD_MS = 1;
+constexpr int tskIDLE_PRIORITY = 0;
+constexpr int configMAX_PRIORITIES = 25;
+
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms) / portTICK_PERIOD_MS)
 
 int xTaskCreate(void (*fn)(void*), const char* name, unsigned stack, void* param, int prio,
                 TaskHandle_t* handle);
 void vTaskDelete(TaskHandle_t h);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void taskYIELD();
+void vTaskDelay(TickType_t ticks);
+// Device stack bytes the task (NULL: the caller) has never touched, estimated
+// from its host stack (see sim_task_stack.h). 0 for loopTask, which is not measured.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t h);
+
+// Semaphores. Takes block for up to `timeout` ticks and return pdFALSE on
+// timeout; a task deleted while blocked unwinds from inside the call.
 SemaphoreHandle_t xSemaphoreCreateMutex();
-void xSemaphoreTake(SemaphoreHandle_t m, unsigned timeout);
-void xSemaphoreGive(SemaphoreHandle_t m);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t m);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t m, TickType_t timeout);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t m);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t m);
 void vSemaphoreDelete(SemaphoreHandle_t m);
-void vTaskDelay(unsigned ms);
+
+// Queues of fixed-size items, copied in and out by value.
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t timeout);
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void* item, TickType_t timeout);
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void* item, TickType_t timeout);
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void* item);
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t timeout);
+BaseType_t xQueuePeek(QueueHandle_t q, void* item, TickType_t timeout);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q);
+BaseType_t xQueueReset(QueueHandle_t q);
+void vQueueDelete(QueueHandle_t q);
+
+// Emulator only: adopt the calling thread as Arduino's loopTask (priority 1).
+// Call once before setup(). SIM_CORES selects the scheduling model:
+//   1 (default) - cooperative fibers on this thread, single-core like the device
+//   N > 1       - one host thread per task, at most N running at once
+//   0           - one host thread per task, unrestricted
+void sim_rtos_begin();
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * LRU cache of glyph bitmaps laid out for the framebuffer, so text drawn on
+ * every frame (status bar, button hints, library titles) is blitted a byte at
+ * a time instead of decoded from EpdFont data pixel by pixel.
+ *
+ * A cached glyph is in framebuffer orientation, one byte-aligned row per
+ * framebuffer row, already shifted to its sub-byte x offset (x & 7). One
+ * glyph drawn at several offsets is one entry per offset. Entries are evicted
+ * least recently used first once their bytes pass the budget; a budget of 0
+ * turns the cache off, and get() then returns nullptr like for a glyph larger
+ * than the whole budget. Not locked: use it from the task that renders.
+ *
+ *   GlyphCache::Key key{&font, cp, style, orientation, uint8_t(x & 7)};
+ *   if (auto* g = GlyphBitmaps.get(key, w, h, [&](int gx, int gy) { return inkAt(gx, gy); }))
+ *     GlyphCache::blit(frame, HalDisplay::DISPLAY_WIDTH_BYTES, HalDisplay::DISPLAY_HEIGHT, x, y, *g, true);
+ */
+class GlyphCache {
+ public:
+  struct Key {
+    const void* font;  // EpdFontData of the face
+    uint32_t codepoint;
+    uint8_t style;        // EpdFontFamily style, or any other variant of the same glyph
+    uint8_t orientation;  // renderer orientation: the bitmap is pre-rotated
+    uint8_t shift;        // framebuffer x & 7
+
+    bool operator==(const Key& o) const {
+      return font == o.font && codepoint == o.codepoint && style == o.style && orientation == o.orientation &&
+             shift == o.shift;
+    }
+  };
+
+  struct Bitmap {
+    uint16_t rowBytes = 0;  // (shift + width + 7) / 8
+    uint16_t height = 0;
+    std::vector<uint8_t> rows;  // ink bits, MSB first; glyph column 0 is bit (7 - shift) of byte 0
+  };
+
+  /// Framebuffer-oriented ink of a glyph, (0, 0) its top-left pixel.
+  using InkFn = std::function<bool(int x, int y)>;
+
+  explicit GlyphCache(size_t budgetBytes) : budget_(budgetBytes) {}
+
+  /// The glyph's bitmap, built from ink on a miss. Valid until the next get()
+  /// or clear(). nullptr when it does not fit the budget: draw it directly.
+  const Bitmap* get(const Key& key, int width, int height, const InkFn& ink);
+
+  /// Draws glyph into a 1-bit framebuffer (1 = white) with its top-left at
+  /// (x, y), clipped to the frame: black clears the ink bits, white sets them.
+  static void blit(uint8_t* frame, int frameWidthBytes, int frameHeight, int x, int y, const Bitmap& glyph,
+                   bool black);
+
+  /// Drops entries until the cache fits budgetBytes; 0 turns it off.
+  void setBudget(size_t budgetBytes);
+  size_t budget() const { return budget_; }
+  size_t used() const { return used_; }
+  size_t size() const { return entries_.size(); }
+  uint32_t hits() const { return hits_; }
+  uint32_t misses() const { return misses_; }
+  /// On font changes (e.g. the reader's font size setting) and low memory.
+  void clear();
+
+  static GlyphCache& getInstance() { return instance; }
+
+ private:
+  struct KeyHash {
+    size_t operator()(const Key& k) const;
+  };
+  struct Entry {
+    Bitmap bitmap;
+    std::list<Key>::iterator lru;
+  };
+
+  static size_t costOf(const Bitmap& bitmap);  // bytes plus bookkeeping
+  void evictTo(size_t budgetBytes);
+
+  static GlyphCache instance;
+
+  size_t budget_;
+  size_t used_ = 0;
+  uint32_t hits_ = 0;
+  uint32_t misses_ = 0;
+  std::list<Key> lru_;  // most recently used first
+  std::unordered_map<Key, Entry, KeyHash> entries_;
+};
+
+#define GlyphBitmaps GlyphCache::getInstance()
@@ -3,18 +3,68 @@
 #include "WString.h"
 #include "WiFiClient.h"
 #include "WiFiClientSecure.h"
+#include "sim_http.h"
 #include <string>
 
+// Arduino HTTPClient on top of the host HTTP client (sim_http.h). Plain http
+// URLs go to real sockets; in-process handlers such as the local kosync
+// server (sim_kosync.h) answer their own URL prefix.
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+enum followRedirects_t {
+  HTTPC_DISABLE_FOLLOW_REDIRECTS,
+  HTTPC_STRICT_FOLLOW_REDIRECTS,
+  HTTPC_FORCE_FOLLOW_REDIRECTS
+};
+
 class HTTPClient {
  public:
-  bool begin(const char* url) { (void)url; return false; }
-  bool begin(WiFiClient& client, const char* url) { (void)client; (void)url; return false; }
-  bool begin(WiFiClientSecure& client, const char* url) { (void)client; (void)url; return false; }
-  void addHeader(const char* name, const char* value) { (void)name; (void)value; }
-  void setAuthorization(const char* user, const char* pass) { (void)user; (void)pass; }
-  int GET() { return -1; }
-  int PUT(const char* body) { (void)body; return -1; }
-  int getSize() { return -1; }
-  String getString() { return String(""); }
-  void end() {}
+  bool begin(const char* url);
+  bool begin(const String& url) { return begin(url.c_str()); }
+  bool begin(WiFiClient& client, const char* url) {
+    (void)client;
+    return begin(url);
+  }
+  bool begin(WiFiClient& client, const String& url) { return begin(client, url.c_str()); }
+  void end();
+
+  void addHeader(const char* name, const char* value);
+  void addHeader(const String& name, const String& value) { addHeader(name.c_str(), value.c_str()); }
+  void setAuthorization(const char* user, const char* pass);
+  void setTimeout(uint16_t ms) { timeoutMs_ = ms; }
+  void setConnectTimeout(int32_t ms) { (void)ms; }
+  void setFollowRedirects(followRedirects_t follow) { (void)follow; }  // always followed
+  void setUserAgent(const char* agent) { addHeader("User-Agent", agent); }
+
+  int GET() { return sendRequest("GET", nullptr, 0); }
+  int PUT(const char* body) { return sendRequest("PUT", body, body ? strlen(body) : 0); }
+  int PUT(const String& body) { return PUT(body.c_str()); }
+  int POST(const char* body) { return sendRequest("POST", body, body ? strlen(body) : 0); }
+  int POST(const String& body) { return POST(body.c_str()); }
+  int sendRequest(const char* method, const char* body, size_t len);
+
+  int getSize() const { return size_; }
+  String getString() const { return String(body_); }
+  String header(const char* name) const;
+  bool hasHeader(const char* name) const { return sim_http_header(responseHeaders_, name) != nullptr; }
+  static String errorToString(int error);
+
+ private:
+  std::string url_;
+  SimHttpHeaders headers_;
+  SimHttpHeaders responseHeaders_;
+  std::string body_;
+  int size_ = -1;
+  int timeoutMs_ = 5000;  // HTTPCLIENT_DEFAULT_TCP_TIMEOUT
 };
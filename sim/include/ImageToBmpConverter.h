@@ -2,6 +2,7 @@
 
 class FsFile;
 class Print;
+class ZipInflater;
 
 /**
  * Generic image-to-BMP converter using stb_image (emulator only).
@@ -24,9 +25,23 @@ class ImageToBmpConverter {
   static bool imageTo1BitBmpStreamWithSize(FsFile& imageFile, Print& bmpOut,
                                            int targetMaxWidth, int targetMaxHeight);
 
+  /// Same conversions straight from an EPUB entry, without extracting it to
+  /// a file first. @param imageEntry  Started on the image (ZipInflater::begin).
+  static bool imageToBmpStream(ZipInflater& imageEntry, Print& bmpOut, bool crop = true);
+  static bool imageTo1BitBmpStreamWithSize(ZipInflater& imageEntry, Print& bmpOut,
+                                           int targetMaxWidth, int targetMaxHeight);
+
  private:
+  /// Where stb_image reads the encoded image from (its I/O callbacks).
+  struct Source {
+    int (*read)(void* user, char* data, int size);
+    void (*skip)(void* user, int n);
+    int (*eof)(void* user);
+    void* user;
+  };
+
   /// Shared internal implementation.
-  static bool imageToBmpStreamInternal(FsFile& imageFile, Print& bmpOut,
+  static bool imageToBmpStreamInternal(const Source& source, Print& bmpOut,
                                        int targetWidth, int targetHeight,
                                        bool oneBit, bool crop);
 };
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Library metadata index kept on the SD card (/.crosspoint/library.idx), so a
+ * folder view reads one file instead of opening every book and its
+ * progress.bin.
+ *
+ * Entries are keyed by the hash that also names a book's cache directory
+ * (/.crosspoint/epub_<hash>). The file is append-only: every change appends
+ * the book's whole entry, a later record replaces an earlier one, and the file
+ * is rewritten once superseded records outnumber live ones. A record torn by
+ * power loss ends the read; the next write rewrites the file. Safe to call
+ * from any task: the prewarm records books while the reader saves progress.
+ *
+ * File: "CPLI", u8 version, then records (little-endian):
+ *   u16 length of the rest | u64 hash | u32 book size | u32 FAT modify
+ *   date << 16 | time | u8 flags | u8 percent | u8 n | title[n] | u8 n | author[n]
+ */
+class LibraryIndex {
+ public:
+  static constexpr uint8_t kHasThumb = 1;
+  static constexpr uint8_t kNoProgress = 0xFF;
+
+  struct Entry {
+    uint32_t size = 0;      // book file size when recorded (0: unknown)
+    uint32_t modified = 0;  // FAT date << 16 | time when recorded
+    uint8_t flags = 0;
+    uint8_t percent = kNoProgress;
+    std::string title;
+    std::string author;
+  };
+
+  explicit LibraryIndex(std::string indexPath) : indexPath_(std::move(indexPath)) {}
+
+  /// Key of a book: std::hash of its SD path, as in its cache directory name.
+  static uint64_t keyFor(const std::string& bookPath);
+
+  /// Copies a book's entry into out; false when it has none. Compare
+  /// size/modified with the directory entry to tell whether the book changed
+  /// since it was recorded.
+  bool find(const std::string& bookPath, Entry& out);
+  bool find(uint64_t key, Entry& out);
+  size_t size();
+
+  /// After loading a book (thumbnail prewarm, opening it). Appends only when
+  /// something changed, so calling it on every boot is cheap.
+  bool recordBook(const std::string& bookPath, const std::string& title, const std::string& author, bool hasThumb);
+  /// When the reader saves progress (0-100).
+  bool recordProgress(const std::string& bookPath, uint8_t percent);
+  bool recordProgress(uint64_t key, uint8_t percent);
+
+  /// Drops the in-memory copy; the next call reads the file again.
+  void reload();
+
+  /// Emulator: main_sim's FsFile write observer reports every written file
+  /// (host path), standing in for the reader's recordProgress(). Only
+  /// .../epub_<key>/progress.bin is read; any other path is ignored.
+  void noteProgressFile(const std::string& hostPath);
+
+  static LibraryIndex& getInstance() { return instance; }
+
+ private:
+  void ensureLoaded();
+  bool setProgress(uint64_t key, uint8_t percent);
+  bool append(uint64_t key, const Entry& entry);
+  bool rewrite();
+
+  static LibraryIndex instance;
+
+  std::mutex mutex_;  // guards everything below and the file
+  std::string indexPath_;
+  std::unordered_map<uint64_t, Entry> entries_;
+  size_t records_ = 0;        // records in the file, live or superseded
+  bool loaded_ = false;
+  bool needsRewrite_ = false;  // torn tail or unknown version
+};
+
+#define LibIndex LibraryIndex::getInstance()
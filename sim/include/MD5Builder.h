@@ -3,29 +3,30 @@
 #include "ArduinoStub.h"
 #include "WString.h"
 #include <cstdint>
-#include <cstdio>
 #include <cstring>
 
-// Stub MD5Builder for emulator: provides API, hash is not implemented (returns zeros).
+// MD5Builder for the emulator: real RFC 1321 MD5, so cache keys and content
+// checks derived from it match the device.
 class MD5Builder {
  public:
-  void begin() { memset(hash_, 0, sizeof(hash_)); }
-  void add(const uint8_t* data, size_t len) { (void)data; (void)len; }
-  void add(const char* data) { (void)data; }
-  void add(const String& s) { (void)s; }
-  void add(const uint8_t* data) { (void)data; }
-  bool addStream(Stream& stream, const size_t maxLen = 0) {
-    (void)stream;
-    (void)maxLen;
-    return true;
-  }
-  void calculate() {}
-  void getBytes(uint8_t* output) const { memset(output, 0, 16); }
-  void getChars(char* output) const {
-    for (int i = 0; i < 16; i++) snprintf(output + i * 2, 3, "%02x", hash_[i]);
-  }
-  String toString() const { return String(""); }
+  void begin();
+  void add(const uint8_t* data, size_t len);
+  void add(const char* data) { add(reinterpret_cast<const uint8_t*>(data), data ? strlen(data) : 0); }
+  void add(const uint8_t* data) { add(reinterpret_cast<const char*>(data)); }
+  void add(const String& s) { add(reinterpret_cast<const uint8_t*>(s.c_str()), s.length()); }
+  void addHexString(const char* data);
+  void addHexString(const String& data) { addHexString(data.c_str()); }
+  // Hashes up to maxLen bytes from the stream (0: until it runs dry), read in
+  // large chunks. False if the stream ended before maxLen.
+  bool addStream(Stream& stream, const size_t maxLen = 0);
+  void calculate();
+  void getBytes(uint8_t* output) const { memcpy(output, hash_, sizeof(hash_)); }
+  void getChars(char* output) const;
+  String toString() const;
 
  private:
-  uint8_t hash_[16] = {0};
+  uint32_t state_[4] = {};
+  uint64_t bytes_ = 0;
+  uint8_t pending_[64] = {};
+  uint8_t hash_[16] = {};
 };
@@ -13,11 +13,14 @@
 #define O_CREAT   0x04
 #define O_TRUNC   0x08
 #endif
+#ifndef O_APPEND
+#define O_APPEND  0x10
+#endif
 typedef int oflag_t;
 
 class FsFile : public Stream {
  public:
-  FsFile() : fp_(nullptr), dir_(nullptr), isDir_(false), dirPath_(), currentName_() {}
+  FsFile() : fp_(nullptr), dir_(nullptr), lowerDir_(nullptr), isDir_(false), written_(false), dirPath_(), currentName_() {}
   ~FsFile() { close(); }
 
   FsFile(FsFile&& other) noexcept;
@@ -30,6 +33,11 @@ class FsFile : public Stream {
   int read(uint8_t* buf, size_t size);
   int read(void* buf, size_t size) { return read(static_cast<uint8_t*>(buf), size); }
   int read(char* buf, size_t size) { return read(reinterpret_cast<uint8_t*>(buf), size); }
+  size_t readBytes(uint8_t* buf, size_t len) override {
+    const int n = read(buf, len);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  using Stream::readBytes;
   int peek() override;
   size_t write(uint8_t c) override;
   size_t write(const uint8_t* buf, size_t size) override;
@@ -47,21 +55,42 @@ class FsFile : public Stream {
   void setCurrentName(const std::string& name) { currentName_ = name; }
   FsFile openNextFile();
   bool rename(const char* newPath);
+  // FAT-packed modify date/time, as SdFat: date = (year-1980)<<9 | month<<5 | day,
+  // time = hour<<11 | minute<<5 | second/2
+  bool getModifyDateTime(uint16_t* pdate, uint16_t* ptime) const;
 
   operator bool() const { return fp_ != nullptr || dir_ != nullptr; }
 
   static void setRootPath(const std::string& root) { s_rootPath = root; }
+  static const std::string& rootPath() { return s_rootPath; }
+  // Copy-on-write layer over the root (SIM_OVERLAY); empty turns it off
+  static void setOverlayPath(const std::string& overlay) { s_overlayPath = overlay; }
+  static const std::string& overlayPath() { return s_overlayPath; }
   static std::string resolvePath(const char* path);
+  // Emulator hook: called with the host path after a file that was written
+  // to is closed (by close(), a reopen or the destructor)
+  using WriteCloseObserver = void (*)(const std::string& hostPath);
+  static void setWriteCloseObserver(WriteCloseObserver observer) { s_writeCloseObserver = observer; }
 
  private:
+  bool openMerged(const char* path, oflag_t oflag);
+  void closeLocked();
+  const char* nextEntryName();
+
   FILE* fp_;
-  void* dir_;  // DIR* from dirent.h when isDir_
+  void* dir_;       // DIR* from dirent.h when isDir_
+  void* lowerDir_;  // DIR* of the root-layer half of a merged overlay directory
   bool isDir_;
+  bool written_;
   std::string dirPath_;
+  std::string lowerDirPath_;
+  std::string logicalPath_;  // card path of a directory opened through the overlay
   std::string currentName_;
   std::string filePath_;  // full path when open as file (for rename)
 
   static std::string s_rootPath;
+  static std::string s_overlayPath;
+  static WriteCloseObserver s_writeCloseObserver;
 };
 
 class SdFat {
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * Builds the next chapter's section cache in the background while the current
+ * one is read, so the page turn across a chapter boundary loads a finished
+ * section file instead of parsing and laying out the XHTML first.
+ *
+ * Jobs run one at a time on a FreeRTOS task at loopTask's priority. On the
+ * device and in fiber mode (SIM_CORES=1) it takes turns with the reader: it
+ * hands the CPU back at every checkpoint(), and gets it again when loop()
+ * blocks or yields. At idle priority it would never run while loop() keeps
+ * the CPU. In thread mode (SIM_CORES=0 or N>1) it is a worker thread next to
+ * the reader.
+ *
+ * A job is the reader's own section build (Section::createSectionFile with
+ * the current layout settings), so the cache file format is unchanged. It
+ * must use its own Epub and Section objects, call checkpoint() from the
+ * build's progress callback and, when checkpoint() returns false, stop and
+ * remove the partial file.
+ *
+ * Nothing in the emulator schedules jobs: the reader (firmware) wires it in.
+ *   after a section is shown:      SectionPrefetch.schedule(bookKey, spine + 1, job)
+ *   before opening a section file: SectionPrefetch.waitFor(bookKey, spine)
+ *   when the book closes:          SectionPrefetch.cancel()
+ */
+class SectionPrefetcher {
+ public:
+  /// Builds one section file; returns whether it was completed.
+  using Job = std::function<bool()>;
+
+  /// Queues job for (bookKey, spineIndex), replacing a job queued and not yet
+  /// started. A running job for another section is cancelled.
+  void schedule(uint64_t bookKey, int spineIndex, Job job);
+
+  /// Call before opening a section file. Waits for a running job on that
+  /// section and returns true if a job completed the file, even when later
+  /// jobs ran since. A queued job for it is dropped; the caller builds the
+  /// section as before.
+  bool waitFor(uint64_t bookKey, int spineIndex);
+
+  /// Drops the queued job and stops the running one, waiting until it has.
+  /// Forgets the results of finished jobs.
+  void cancel();
+
+  /// True while a job is queued or running.
+  bool busy();
+
+  /// From inside a job: lets the reader run (the device is single core) and
+  /// returns false once the job has been cancelled.
+  static bool checkpoint();
+
+  static SectionPrefetcher& getInstance() { return instance; }
+
+ private:
+  struct Slot {
+    uint64_t bookKey = 0;
+    int spineIndex = -1;
+    Job job;
+  };
+  struct Result {
+    uint64_t bookKey = 0;
+    int spineIndex = -1;
+    bool ok = false;
+  };
+
+  static void taskEntry(void* self);
+  void run();
+  void start();
+  bool isRunning(uint64_t bookKey, int spineIndex) const;
+  void waitForJob();  // caller holds lock_; released until the running job returns
+
+  static SectionPrefetcher instance;
+
+  TaskHandle_t task_ = nullptr;
+  SemaphoreHandle_t lock_ = nullptr;
+  SemaphoreHandle_t wake_ = nullptr;  // a job was queued
+  SemaphoreHandle_t done_ = nullptr;  // the running job returned
+  Slot queued_;
+  Slot running_;
+  std::vector<Result> results_;  // of finished jobs not yet waited for, oldest first
+  bool busy_ = false;
+  std::atomic<bool> cancelled_{false};
+};
+
+#define SectionPrefetch SectionPrefetcher::getInstance()
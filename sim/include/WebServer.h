@@ -4,9 +4,25 @@
 #include "WiFiClient.h"
 
 #include <functional>
+#include <memory>
 
-enum { HTTP_GET, HTTP_POST };
+// Arduino WebServer on a localhost socket (see sim_net.h for the address and
+// port mapping). Like the ESP32 server, handleClient() takes one request at a
+// time and runs it to completion, streaming multipart uploads to the upload
+// handler in HTTP_UPLOAD_BUFLEN pieces; a long upload holds the caller's loop
+// for its whole duration, which is logged.
+//
+// Environment:
+//   SIM_WEB_KBPS=1500   cap request body intake at this many kilobytes/s
+//                       (device WiFi speed); unlimited by default
+
+enum HTTPMethod { HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE, HTTP_ANY };
 constexpr int CONTENT_LENGTH_UNKNOWN = -1;
+constexpr int CONTENT_LENGTH_NOT_SET = -2;
+
+#ifndef HTTP_UPLOAD_BUFLEN
+#define HTTP_UPLOAD_BUFLEN 1436
+#endif
 
 enum { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
 
@@ -15,45 +31,52 @@ struct HTTPUpload {
   String filename;
   String name;
   String type;
-  size_t size = 0;
+  size_t size = 0;  // file bytes received so far, the current piece included
   size_t totalSize = 0;
   size_t currentSize = 0;
-  const uint8_t* buf = nullptr;
+  const uint8_t* buf = nullptr;  // currentSize bytes, valid during the handler call
 };
 
 class WebServer {
  public:
-  explicit WebServer(uint16_t port) : port_(port) {}
-  void on(const char* path, int method, std::function<void()> fn) { (void)path; (void)method; (void)fn; }
-  void on(const char* path, int method, std::function<void()> uploadFn, std::function<void()> bodyFn) {
-    (void)path; (void)method; (void)uploadFn; (void)bodyFn;
-  }
-  void onNotFound(std::function<void()> fn) { (void)fn; }
-  void begin() {}
-  void stop() {}
-  void handleClient() {}
-  void send(int code, const char* type, const char* content) { (void)code; (void)type; (void)content; }
-  void send(int code, const char* type, const String& content) { (void)code; (void)type; (void)content; }
-  void sendContent(const char* content) { (void)content; }
-  void sendContent(const String& content) { (void)content; }
-  void sendHeader(const char* name, const char* value, bool first = false) {
-    (void)name;
-    (void)value;
-    (void)first;
-  }
+  using THandlerFunction = std::function<void()>;
+
+  explicit WebServer(uint16_t port);
+  ~WebServer();
+
+  void on(const char* path, int method, THandlerFunction fn);
+  // `fn` answers the request once `uploadFn` has seen every upload chunk.
+  void on(const char* path, int method, THandlerFunction fn, THandlerFunction uploadFn);
+  void onNotFound(THandlerFunction fn);
+  void begin();
+  void stop();
+  void handleClient();
+
+  void send(int code, const char* type = nullptr, const char* content = nullptr);
+  void send(int code, const char* type, const String& content) { send(code, type, content.c_str()); }
+  void sendContent(const char* content) { sendContent(content, content ? strlen(content) : 0); }
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char* content, size_t len);
+  void sendHeader(const char* name, const char* value, bool first = false);
   void sendHeader(const String& name, const String& value, bool first = false) {
-    (void)name;
-    (void)value;
-    (void)first;
+    sendHeader(name.c_str(), value.c_str(), first);
   }
-  void setContentLength(size_t len) { (void)len; }
-  WiFiClient client() { return WiFiClient(); }
-  bool hasArg(const char* name) const { (void)name; return false; }
-  String arg(const char* name) const { (void)name; return String(""); }
-  String uri() const { return String(""); }
-  const HTTPUpload& upload() const { return upload_; }
+  void setContentLength(size_t len);
+  WiFiClient client();
+
+  bool hasArg(const char* name) const;
+  String arg(const char* name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const;
+  bool hasHeader(const char* name) const;
+  String header(const char* name) const;
+  String uri() const;
+  HTTPMethod method() const;
+  HTTPUpload& upload();
+
+  struct Impl;
 
  private:
-  uint16_t port_;
-  HTTPUpload upload_;
+  std::unique_ptr<Impl> impl_;
 };
@@ -3,20 +3,46 @@
 #include "WString.h"
 #include <cstdint>
 #include <functional>
+#include <memory>
 
-enum WStype_t { WStype_TEXT, WStype_BIN, WStype_CONNECTED, WStype_DISCONNECTED };
+// arduinoWebSockets server on a localhost socket (see sim_net.h for the
+// address and port mapping). loop() never blocks: it accepts, handshakes and
+// dispatches whatever frames have fully arrived, then returns.
+
+enum WStype_t {
+  WStype_TEXT,
+  WStype_BIN,
+  WStype_CONNECTED,
+  WStype_DISCONNECTED,
+  WStype_ERROR,
+  WStype_PING,
+  WStype_PONG
+};
+
+#ifndef WEBSOCKETS_SERVER_CLIENT_MAX
+#define WEBSOCKETS_SERVER_CLIENT_MAX 5
+#endif
 
 class WebSocketsServer {
  public:
-  explicit WebSocketsServer(uint16_t port) : port_(port) {}
-  void begin() {}
-  void close() {}
-  void onEvent(void (*callback)(uint8_t, WStype_t, uint8_t*, size_t)) { (void)callback; }
-  void loop() {}
-  void sendTXT(uint8_t num, const char* payload) { (void)num; (void)payload; }
-  void sendTXT(uint8_t num, const String& payload) { (void)num; (void)payload; }
-  void sendTXT(uint8_t num, const uint8_t* payload, size_t len) { (void)num; (void)payload; (void)len; }
+  using WebSocketServerEvent = std::function<void(uint8_t num, WStype_t type, uint8_t* payload, size_t length)>;
+
+  explicit WebSocketsServer(uint16_t port);
+  ~WebSocketsServer();
+  void begin();
+  void close();
+  void onEvent(WebSocketServerEvent callback);
+  void loop();
+  bool sendTXT(uint8_t num, const char* payload);
+  bool sendTXT(uint8_t num, const String& payload) { return sendTXT(num, payload.c_str()); }
+  bool sendTXT(uint8_t num, const uint8_t* payload, size_t len);
+  bool sendBIN(uint8_t num, const uint8_t* payload, size_t len);
+  bool broadcastTXT(const char* payload);
+  void disconnect(uint8_t num);
+  int connectedClients();
+
+  struct Impl;
 
  private:
-  uint16_t port_;
+  std::unique_ptr<Impl> impl_;
 };
@@ -42,10 +42,12 @@ enum wifi_mode_t { WIFI_MODE_NULL = 0, WIFI_MODE_STA = 1, WIFI_MODE_AP = 2, WIFI
 enum { WIFI_SCAN_RUNNING = -1, WIFI_SCAN_FAILED = -2 };
 enum { WIFI_AUTH_OPEN = 0 };
 
+// Offline unless SIM_WIFI=1, which reports a connected station so network
+// features (e.g. KOReader sync against the local kosync server) run.
 class WiFiClass {
  public:
   void mode(int) {}
-  wl_status_t status() const { return WL_DISCONNECTED; }
+  wl_status_t status() const;
   void disconnect(bool = true) {}
   void softAPdisconnect(bool = true) {}
   bool softAP(const char* ssid, const char* pass = nullptr, int = 1, bool = false, int = 4) {
@@ -54,8 +56,8 @@ class WiFiClass {
     return false;  // no-op in sim
   }
   IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
-  IPAddress localIP() const { return IPAddress(0, 0, 0, 0); }
-  String SSID() const { return String(""); }
+  IPAddress localIP() const;
+  String SSID() const;
   String SSID(int i) const {
     (void)i;
     return String("");
@@ -79,11 +81,7 @@ class WiFiClass {
     (void)i;
     return WIFI_AUTH_OPEN;
   }
-  bool begin(const char* ssid, const char* pass = nullptr) {
-    (void)ssid;
-    (void)pass;
-    return false;
-  }
+  bool begin(const char* ssid, const char* pass = nullptr);
 };
 
 extern WiFiClass WiFi;
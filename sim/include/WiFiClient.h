@@ -2,13 +2,19 @@
 
 #include "ArduinoStub.h"
 
+// Outgoing connections are not supported (connect() fails). A client handed
+// out by WebServer::client() writes to that request's socket, which the
+// server keeps ownership of.
 class WiFiClient : public Stream {
  public:
+  WiFiClient() = default;
+  explicit WiFiClient(int fd) : fd_(fd) {}
+
   int connect(const char* host, uint16_t port) { (void)host; (void)port; return 0; }
-  void stop() {}
-  bool connected() { return false; }
-  size_t write(uint8_t c) override { (void)c; return 0; }
-  size_t write(const uint8_t* buf, size_t size) override { (void)buf; (void)size; return 0; }
+  void stop() { fd_ = -1; }
+  bool connected() { return fd_ >= 0; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
   size_t write(Stream& stream) {
     size_t n = 0;
     while (stream.available()) {
@@ -18,4 +24,8 @@ class WiFiClient : public Stream {
     }
     return n;
   }
+  operator bool() { return connected(); }
+
+ private:
+  int fd_ = -1;
 };
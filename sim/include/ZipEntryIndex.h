@@ -0,0 +1,70 @@
+#pragma once
+
+#include <SdFat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Entry table of a ZIP (EPUB) kept in the book's cache directory, so opening
+ * the book and finding a chapter or image does not walk the central directory.
+ *
+ * The first open scans the central directory and writes the table; later opens
+ * read it back if the ZIP's size and FAT modify time still match. Records are
+ * sorted by FNV-1a hash of the entry name and bucketed by the hash's top byte,
+ * so a lookup checks one or two records. Names are not stored: find() confirms
+ * the name against the entry's local header, which it reads anyway to locate
+ * the data.
+ *
+ * File: "CPZI", u8 version, u32 ZIP size, u32 FAT modify date << 16 | time,
+ * u32 count, then count records (little-endian):
+ *   u32 name hash | u32 local header offset | u32 compressed size |
+ *   u32 uncompressed size | u16 method
+ *
+ * ZIP64 archives are not indexed (open() returns false); use the central
+ * directory as before.
+ */
+class ZipEntryIndex {
+ public:
+  struct Entry {
+    uint32_t localHeaderOffset = 0;
+    uint32_t dataOffset = 0;  // first byte of the (compressed) data
+    uint32_t compressedSize = 0;
+    uint32_t uncompressedSize = 0;
+    uint16_t method = 0;  // 0 stored, 8 deflate
+  };
+
+  /// Opens zipPath and its table at indexPath (e.g. <cache dir>/zip.idx),
+  /// building the table when it is missing or stale.
+  bool open(const std::string& zipPath, const std::string& indexPath);
+  void close();
+
+  /// Looks up an entry by its full name in the archive.
+  bool find(const char* name, Entry& out);
+  size_t size() const { return records_.size(); }
+  /// Whether open() had to scan the central directory.
+  bool rebuilt() const { return rebuilt_; }
+
+  static uint32_t hashName(const char* name, size_t len);
+
+ private:
+  struct Record {
+    uint32_t hash;
+    uint32_t localHeaderOffset;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint16_t method;
+  };
+
+  bool load(const std::string& indexPath, uint32_t zipSize, uint32_t modified);
+  bool scan();
+  void save(const std::string& indexPath, uint32_t zipSize, uint32_t modified) const;
+  void buildBuckets();
+
+  FsFile zip_;
+  std::vector<Record> records_;
+  uint32_t buckets_[257] = {};  // records_ index of the first hash with each top byte
+  bool rebuilt_ = false;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <SdFat.h>
+#include <ZipEntryIndex.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Streams one ZIP entry (stored or deflated) straight to its consumer, e.g.
+ * expat for a chapter or stb_image for a cover, without extracting the entry
+ * to a buffer or a temporary file first.
+ *
+ * Deflate runs on a tinfl decompressor whose 32 KB dictionary doubles as the
+ * output window. Decompressors come from a small pool and are reused, so an
+ * extraction does not allocate: at most kPoolSize entries inflate at once,
+ * and begin() fails past that.
+ *
+ *   ZipInflater in;
+ *   if (in.begin(zip, entry))
+ *     in.inflateTo([&](const uint8_t* p, size_t n) { return XML_Parse(parser, (const char*)p, n, 0); });
+ */
+class ZipInflater {
+ public:
+  static constexpr int kPoolSize = 2;
+
+  ZipInflater() = default;
+  ~ZipInflater() { end(); }
+  ZipInflater(const ZipInflater&) = delete;
+  ZipInflater& operator=(const ZipInflater&) = delete;
+
+  /// Starts reading entry from zip (an open archive, see ZipEntryIndex::find).
+  /// Every refill seeks first, so zip may be read elsewhere in between.
+  bool begin(FsFile& zip, const ZipEntryIndex::Entry& entry);
+  /// Returns the decompressor to the pool. Called by the destructor.
+  void end();
+
+  /// Pull: up to size bytes of the entry; 0 at the end, -1 on a corrupt entry.
+  int read(uint8_t* buf, size_t size);
+  /// Push: hands every decompressed span to sink (which returns false to
+  /// stop) straight from the output window. True when the whole entry went out.
+  bool inflateTo(const std::function<bool(const uint8_t*, size_t)>& sink);
+
+  bool atEnd() const { return done_ && pendingLen_ == 0; }
+  uint32_t produced() const { return produced_; }
+
+  /// Frees pooled decompressors not in use (e.g. when the reader closes).
+  static void trimPool();
+
+ private:
+  struct Context;
+
+  bool step();  // next span into pending_/pendingLen_; false at the end or on error
+
+  static Context* pool[kPoolSize];  // allocated on first use, kept until trimPool()
+
+  FsFile* zip_ = nullptr;
+  Context* ctx_ = nullptr;
+  uint16_t method_ = 0;
+  uint32_t readPos_ = 0;         // next compressed byte in the archive
+  uint32_t compressedLeft_ = 0;  // not yet read from the archive
+  uint32_t expected_ = 0;        // uncompressed size
+  uint32_t produced_ = 0;
+  size_t inPos_ = 0;
+  size_t inLen_ = 0;
+  size_t windowPos_ = 0;
+  const uint8_t* pending_ = nullptr;
+  size_t pendingLen_ = 0;
+  bool done_ = true;
+  bool failed_ = false;
+};
@@ -2,17 +2,45 @@
 
 #include <cstdint>
 
-enum { ECC_LOW };
+// QR code encoder with the API of the ricmoo QRCode library the firmware
+// uses (versions 1-10, all four ECC levels). The module matrix is bit-packed
+// in the caller's buffer, row-major, MSB first.
+
+#define ECC_LOW 0
+#define ECC_MEDIUM 1
+#define ECC_QUARTILE 2
+#define ECC_HIGH 3
+
+#define MODE_NUMERIC 0
+#define MODE_ALPHANUMERIC 1
+#define MODE_BYTE 2
 
 struct QRCode {
+  uint8_t version;
   uint8_t size;
+  uint8_t ecc;
+  uint8_t mode;
+  uint8_t mask;
+  uint8_t* modules;
 };
 
-int qrcode_getBufferSize(int version) { (void)version; return 200; }
-void qrcode_initText(struct QRCode* qrcode, uint8_t* buffers, int version, int ecc, const char* text) {
-  (void)qrcode; (void)buffers; (void)version; (void)ecc; (void)text;
-  qrcode->size = 0;
-}
-bool qrcode_getModule(const struct QRCode* qrcode, int x, int y) {
-  (void)qrcode; (void)x; (void)y; return false;
-}
+uint16_t qrcode_getBufferSize(uint8_t version);
+
+// Encode `data` (numeric, alphanumeric or byte mode, whichever is densest).
+// Return 0 on success, -1 if the version is unsupported or the data does not fit.
+int8_t qrcode_initText(QRCode* qrcode, uint8_t* modules, uint8_t version, uint8_t ecc, const char* data);
+int8_t qrcode_initBytes(QRCode* qrcode, uint8_t* modules, uint8_t version, uint8_t ecc, const uint8_t* data,
+                        uint16_t length);
+
+bool qrcode_getModule(const QRCode* qrcode, uint8_t x, uint8_t y);
+
+// Row-span fast path (emulator extension). Writes the dark runs of row `y` as
+// [starts[i], ends[i]) module ranges and returns how many there are, so a
+// renderer can fill one rectangle per run instead of one per module.
+uint8_t qrcode_getRowSpans(const QRCode* qrcode, uint8_t y, uint8_t* starts, uint8_t* ends, uint8_t maxSpans);
+
+// Draws the code, light modules included, into a 1-bit MSB-first buffer
+// (0 = black, as in EInkDisplay's framebuffer) at pixel (x, y) with `scale`
+// pixels per module. Each pixel row is filled span by span, a byte at a time.
+void qrcode_drawToBuffer(const QRCode* qrcode, uint8_t* buffer, uint16_t widthBytes, uint16_t height, int x, int y,
+                         uint8_t scale);
@@ -0,0 +1,9 @@
+#pragma once
+
+// Emulator runtime settings, read from SIM_* environment variables.
+// Unset or unparsable values fall back to the given default.
+
+int sim_config_int(const char* name, int defaultValue);
+double sim_config_double(const char* name, double defaultValue);
+const char* sim_config_str(const char* name, const char* defaultValue);
+bool sim_config_flag(const char* name, bool defaultValue = false);
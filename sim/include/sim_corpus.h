@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+
+// Corpus run: `crosspoint_emulator --corpus <dir>` loads and paginates every
+// EPUB under <dir> and writes one CSV row per book to stdout:
+//   book,status,sections,pages,load_ms,total_ms,pages_per_s,book_peak_kb,peak_rss_kb,failure
+// then a summary with the aggregate pages/s to stderr. status is ok, failed,
+// or load-only when the firmware does not define sim_corpus_paginate(); a
+// load-only row leaves pages and pages_per_s empty, and the summary warns.
+//
+// Every book runs in its own headless emulator process, forked before SDL
+// starts, so a crash or hang only fails that book. Each process runs setup(),
+// then sim_corpus_paginate() on the firmware thread. <dir> is the card and
+// stays untouched: every book gets a fresh SIM_OVERLAY for its caches.
+// book_peak_kb is the book's peak heap: the most the live malloc'd bytes grew
+// above where they stood after setup() (sim_heap.h). It is empty where the
+// heap cannot be tracked (not glibc).
+//
+// Environment:
+//   SIM_CORPUS_JOBS=<cpus>       books at once
+//   SIM_CORPUS_DIR=corpus        per-job overlays and logs; the serial log
+//                                of a failed book is kept as <dir>/<book>.log
+//                                (with '/' in its path as '_')
+//   SIM_CORPUS_TIMEOUT=600       seconds per book before it counts as hung
+
+struct SimCorpusBook {
+  int sections = 0;
+  int pages = 0;
+  double loadMs = 0;       // part of the book's time spent in Epub::load
+  bool paginated = true;   // false when the book was only loaded: pages unknown
+  std::string failure;     // empty when the whole book paginated
+};
+
+// Loads the book at `path` (SD path) and lays out every spine item into the
+// section cache, filling `book`. Returns false on failure, with the reason in
+// book.failure. The firmware defines this under CROSSPOINT_EMULATED, with the
+// reader's renderer and layout settings; the emulator's weak default only
+// loads the book and clears book.paginated.
+bool sim_corpus_paginate(const std::string& path, SimCorpusBook& book);
+
+// `--corpus <dir>`: called by main before SDL. Returns only in a book's
+// process, set up as that book; the parent exits when every book is done.
+void sim_corpus_run(const char* dir);
+
+// On the firmware thread after setup(): in a book's process, paginates the
+// book, reports it and exits. Returns at once otherwise.
+void sim_corpus_book();
@@ -1,7 +1,28 @@
 #pragma once
 
+#include <cstdint>
+
 // Call before setup() so HalDisplay::begin() can use the window.
 bool sim_display_init(void);
 void sim_display_shutdown(void);
-// Process SDL events (keyboard, etc.). Returns false if user requested quit.
-bool sim_display_pump_events(void);
+// Main thread loop body: waits up to timeoutMs (0: no wait) for an SDL event
+// or a published frame, feeds key events to sim_gpio, then presents the newest
+// frame. Returns false if the user requested quit. All SDL calls stay on the
+// thread that called sim_display_init(); the firmware only publishes frames.
+bool sim_display_pump_events(int timeoutMs = 0);
+// Snapshots (sim_snapshot.h): park() returns once the main thread is waiting
+// at the end of sim_display_pump_events(), holding no SDL or frame lock, so
+// the firmware thread can fork. In the forked copy, after_fork() resets the
+// park state before a new thread takes over sim_display_pump_events().
+// headless() is true for the dummy and offscreen video drivers, whose SDL
+// state survives fork().
+void sim_display_park();
+void sim_display_after_fork();
+bool sim_display_headless();
+
+// Framebuffer -> window conversion used by every refresh: 1-bit 800x480 panel
+// buffers in, RGB24 480x800 (rotated 90° clockwise) out, `pitch` bytes per row.
+// No SDL state is touched, so benchmarks can call these directly.
+void sim_display_convert_bw(const uint8_t* bw, uint8_t* pixels, int pitch);
+void sim_display_convert_gray(const uint8_t* bw, const uint8_t* lsb, const uint8_t* msb, uint8_t* pixels,
+                              int pitch);
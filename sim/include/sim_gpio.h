@@ -1,3 +1,10 @@
 #pragma once
 
-void sim_gpio_pump_events();
+// Key press/release from the main thread's SDL event loop (SDL_Keycode).
+// HalGPIO::update() on the firmware thread sees a key held between two
+// updates, and a press that was released again before the next update.
+void sim_gpio_key_event(int keycode, bool down);
+
+// Replaces the SIM_INPUT_SCRIPT replay with the script at `path`, from its
+// first step (a resumed snapshot). False if it cannot be read or parsed.
+bool sim_gpio_replace_script(const char* path);
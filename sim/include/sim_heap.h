@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// Heap accounting for corpus runs. On glibc the emulator wraps malloc, calloc,
+// realloc, the aligned allocators and free; while tracking is on each call
+// adds or subtracts the block's usable size, so the peak is exact rather than
+// sampled. Off (the default) a call costs one relaxed load.
+//
+// Counting starts at zero when tracking starts: memory allocated before and
+// freed during the book counts against it, so the peak is the most the heap
+// grew above where it stood.
+
+// Starts tracking in this process. False where the heap cannot be tracked
+// (not glibc).
+bool sim_heap_track_begin();
+
+// Highest growth of the live heap since sim_heap_track_begin(), in bytes.
+size_t sim_heap_peak_bytes();
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Host-side HTTP for the emulator: a small HTTP/1.1 client over POSIX sockets
+// (plain http only, e.g. a local fixture server), plus a file-backed URL map
+// and a bandwidth/latency shaper so downloads take device-like time.
+//
+// Environment:
+//   SIM_HTTP_MAP=urls.txt     lines of "<url prefix> <host path>"; matching
+//                             URLs are served from files (file:// always is)
+//   SIM_HTTP_LATENCY_MS=120   delay before the first byte of every response
+//   SIM_HTTP_KBPS=250         cap body delivery at this many kilobytes/s
+//   SIM_HTTP_TIMEOUT_MS=15000 give up on a silent connection
+//
+// Waiting (connect, reads, shaping) blocks only the calling task: sockets are
+// waited on through the sim scheduler (sim_task_wait_fd), so other tasks and
+// the UI keep running while a request is in flight, with SIM_CORES=1 too.
+//
+// In-process handlers (sim_http_register_handler) answer URLs under a prefix
+// without any socket, ahead of SIM_HTTP_MAP and the network.
+
+using SimHttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+struct SimHttpRequest {
+  std::string method = "GET";
+  std::string url;
+  SimHttpHeaders headers;
+  std::string body;
+  int timeoutMs = 0;  // 0: SIM_HTTP_TIMEOUT_MS
+};
+
+struct SimHttpResponse {
+  int status = -1;             // HTTP status, or -1 if no response arrived
+  int64_t contentLength = -1;  // -1 when the server did not say
+  SimHttpHeaders headers;
+  std::string error;           // set when status is -1 or the body was cut short
+};
+
+// Receives the body in chunks; return false to abort the transfer.
+using SimHttpBodySink = std::function<bool(const uint8_t* data, size_t len)>;
+// Called once the status line and headers are known, before any body.
+using SimHttpHeadersSink = std::function<void(const SimHttpResponse& response)>;
+
+// Performs the request, following up to 5 redirects.
+SimHttpResponse sim_http_request(const SimHttpRequest& request, const SimHttpBodySink& onBody,
+                                 const SimHttpHeadersSink& onHeaders = nullptr);
+
+// Answers a request routed to it: fills in status and headers and returns the
+// body. Leave status at -1 and set `error` to simulate a network failure.
+using SimHttpHandler = std::function<std::string(const SimHttpRequest& request, SimHttpResponse& response)>;
+
+// Routes URLs starting with `prefix` to `handler` (longest prefix wins).
+void sim_http_register_handler(const std::string& prefix, SimHttpHandler handler);
+
+// Case-insensitive header lookup; nullptr if absent.
+const std::string* sim_http_header(const SimHttpHeaders& headers, const char* name);
@@ -0,0 +1,22 @@
+#pragma once
+
+// In-process stand-in for a KOReader sync (kosync) server, reached through
+// HTTPClient / sim_http like a real one. It implements the progress API
+// KOReaderSync uses: POST /users/create, GET /users/auth,
+// PUT /syncs/progress and GET /syncs/progress/<document>.
+//
+// Environment:
+//   SIM_KOSYNC=1                 serve at http://kosync.sim (or give a base URL
+//                                instead of 1); enter it as the sync server
+//   SIM_KOSYNC_LATENCY_MS=150    delay before every response
+//   SIM_KOSYNC_JITTER_MS=0       plus up to this much random extra delay
+//   SIM_KOSYNC_FAIL_RATE=0.0     fraction of requests that fail (0..1)
+//   SIM_KOSYNC_FAIL=refused      how they fail: refused, timeout (waits out the
+//                                client timeout) or an HTTP status like 500
+//   SIM_KOSYNC_DB=path           keep users and progress in this file
+//   SIM_KOSYNC_REGISTER=0        reject unknown users (default: auto-register)
+//
+// Every request is logged with its latency; per-endpoint totals print at exit.
+
+// Registers the server with sim_http when SIM_KOSYNC is set. Call once at startup.
+void sim_kosync_begin();
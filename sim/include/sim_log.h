@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+
+// Asynchronous log sink behind Serial.
+//
+// Callers never touch stdout. Serial.printf() copies the format pointer and its
+// arguments into a slot of a lock-free multi-producer ring; a background writer
+// thread does the formatting and the fwrite. When the ring is full the line is
+// dropped rather than stalling the caller; the next line written is preceded
+// by a "[LOG] N lines dropped" note.
+//
+// Environment:
+//   SIM_LOG=*=warn,EPB=info   per-tag levels (off, error, warn, info). The tag
+//                             is the second bracket of "[%lu] [TAG] ..."; the
+//                             level is guessed from the text ("fail"/"error"
+//                             is error, "warn" is warn, anything else info).
+//   SIM_LOG_BINARY=path       write raw records to path instead of text on
+//                             stdout; decode with --decode-log path.
+//   SIM_LOG_SYNC=1            format and write on the calling thread.
+
+// Formats later on the writer thread, so nothing is formatted here. Returns
+// the formatted length (as vsnprintf) only when the line was formatted on the
+// caller: SIM_LOG_SYNC, or arguments that cannot be deferred. A deferred line
+// returns the length of fmt. 0 when SIM_LOG filters the line out or the full
+// ring drops it.
+size_t sim_log_vprintf(const char* fmt, va_list args);
+
+// Raw bytes (Serial.write/print). Buffered per thread up to the newline.
+void sim_log_write(const char* data, size_t len);
+
+// Blocks until everything queued so far has been written. Call before abort().
+void sim_log_flush();
+
+// Decodes a SIM_LOG_BINARY file to stdout. Returns false if it is unreadable.
+bool sim_log_decode(const char* path);
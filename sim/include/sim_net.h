@@ -0,0 +1,36 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// POSIX socket helpers shared by the emulator's network stubs (WebServer,
+// WebSocketsServer, WiFiClient). Sockets are non-blocking; waits block only
+// the calling task (sim_task_wait_fd), so other tasks keep running.
+//
+// Environment:
+//   SIM_WEB_BIND=127.0.0.1     address the servers listen on (0.0.0.0 to
+//                              reach them from a phone on the LAN)
+//   SIM_WEB_PORT_OFFSET=8000   added to ports the host refuses (< 1024)
+
+// Listens on `port`, or on port + SIM_WEB_PORT_OFFSET if the host refuses it.
+// Returns the socket (-1 on failure) and the port actually bound.
+int sim_net_listen(uint16_t port, uint16_t& boundPort);
+
+// Accepts a pending connection as a non-blocking socket; -1 if none.
+int sim_net_accept(int listenFd, std::string* peer = nullptr);
+
+// Blocks the calling task until `fd` is readable (POLLIN) or writable
+// (POLLOUT); false after timeoutMs.
+bool sim_net_wait(int fd, short events, int timeoutMs);
+
+// Reads what is available: > 0 bytes, 0 on EOF, -1 on error, -2 if nothing yet.
+ssize_t sim_net_recv(int fd, void* buf, size_t cap);
+
+bool sim_net_send_all(int fd, const void* data, size_t len, int timeoutMs = 15000);
+
+void sim_net_close(int& fd);
+
+std::string sim_net_base64(const uint8_t* data, size_t len);
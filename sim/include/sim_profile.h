@@ -0,0 +1,45 @@
+#pragma once
+
+// CPU-cost model: measures host CPU time per named region and scales it to an
+// estimate of ESP32-C3 time.
+//
+// Enabled by SIM_PROFILE=1 or by setting SIM_CPU_SCALE (device time per unit of
+// host CPU time, e.g. 200). With a scale above 1, every measured CPU
+// millisecond also pushes millis() forward by (scale - 1) ms, so code that
+// times itself or polls the clock sees device-like durations. A per-region
+// report (p50/p95/max in estimated device ms) and input-to-refresh latencies
+// are printed at exit.
+//
+// Regions may nest; each reports its inclusive time. CPU time is per task: in
+// fiber mode (SIM_CORES=1) time a task spends switched out is not counted.
+
+// Call once before setup(). No-op unless enabled.
+void sim_profile_begin();
+bool sim_profile_enabled();
+
+class SimProfileScope {
+ public:
+  explicit SimProfileScope(const char* region);
+  ~SimProfileScope();
+  SimProfileScope(const SimProfileScope&) = delete;
+  SimProfileScope& operator=(const SimProfileScope&) = delete;
+
+ private:
+  const char* region_;
+  double startCpuMs_ = 0;
+};
+
+#define SIM_PROFILE_CONCAT_(a, b) a##b
+#define SIM_PROFILE_CONCAT(a, b) SIM_PROFILE_CONCAT_(a, b)
+// Profiles the rest of the enclosing block as `region` (a string literal).
+#define SIM_PROFILE_SCOPE(region) SimProfileScope SIM_PROFILE_CONCAT(simProfileScope_, __LINE__)(region)
+
+// Hooks for the sim HAL and scheduler.
+void sim_profile_task_switch(const void* from, const char* fromName, const void* to);
+void sim_profile_task_end(const void* task);
+void sim_profile_input();    // a button went down
+void sim_profile_refresh();  // a display refresh completed
+
+// Labels the latencies that follow (e.g. with the current activity's name).
+// Firmware can call this from code built with CROSSPOINT_EMULATED.
+void sim_profile_set_activity(const char* name);
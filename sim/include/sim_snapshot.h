@@ -0,0 +1,32 @@
+#pragma once
+
+// Warm-start snapshots through a fork server. The input script's `snapshot`
+// command freezes the emulated device at that point (a script that starts
+// with it freezes it right after setup()). The process then forks one copy
+// per resume script and each copy runs on from the frozen state: framebuffers,
+// settings, the open activity and every task fiber are process memory, so
+// fork() keeps them; the virtual clock is rebased to continue from the
+// snapshot and the SD overlay is copied per run.
+//
+// Environment:
+//   SIM_SNAPSHOT_RESUME=a.txt,b.txt   input scripts to resume with, one run
+//                                     each (end them with `quit`); unset, the
+//                                     `snapshot` command does nothing
+//   SIM_SNAPSHOT_DIR=snapshot         run <i> logs to <dir>/<i>/serial.log and
+//                                     writes to the overlay <dir>/<i>/overlay
+//   SIM_SNAPSHOT_JOBS=<cpus>          runs at once
+//
+// Needs fiber mode (SIM_CORES=1) and a headless video driver
+// (SDL_VIDEODRIVER=dummy). Take the snapshot where no file is open: forked
+// runs would share the open file offsets. The process that took the snapshot
+// waits for every run and exits non-zero if one failed.
+
+// Called once by main before the firmware starts. `startPresenter` runs in a
+// resumed copy, where only the firmware thread survived fork(); it must take
+// over the main thread's SDL loop.
+void sim_snapshot_begin(void (*startPresenter)());
+
+// The `snapshot` command, on the firmware thread. Returns at once when
+// snapshots are off; otherwise returns only in resumed copies, with the
+// copy's resume script already loaded.
+void sim_snapshot_take();
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Explicitly allocated stacks for emulated FreeRTOS tasks.
+//
+// Each stack is an mmap'd region with a PROT_NONE guard page below it (stacks
+// grow down). It is not painted, which would commit every page: usage is every
+// page from the lowest one ever touched (mincore) up, so it reads up to a page
+// high, never low. The host stack is the requested size times SIM_STACK_SCALE
+// (default 16), headroom only. Device usage is estimated as host usage over
+// SIM_STACK_FRAME_RATIO (default 2, about x86-64 frames against RV32 ones).
+// Running into the guard page prints the task name and aborts.
+
+struct SimTaskStack {
+  void* map = nullptr;      // whole mapping, guard page included
+  size_t mapBytes = 0;
+  uint8_t* base = nullptr;  // lowest usable byte, just above the guard page
+  size_t bytes = 0;         // usable host bytes
+  unsigned deviceBytes = 0; // size the firmware asked for
+  int guardSlot = -1;
+};
+
+// Allocates a stack for a task that asked for deviceBytes.
+bool sim_stack_alloc(SimTaskStack& stack, unsigned deviceBytes, const char* taskName);
+void sim_stack_free(SimTaskStack& stack);
+
+// Deepest host usage so far, in bytes.
+size_t sim_stack_peak_bytes(const SimTaskStack& stack);
+
+// Estimated device bytes never used, the value uxTaskGetStackHighWaterMark()
+// returns on ESP-IDF.
+unsigned sim_stack_high_water_mark(const SimTaskStack& stack);
+
+// Logs the task's peak usage and warns when it would not fit on the device.
+void sim_stack_report(const SimTaskStack& stack, const char* taskName);
+
+// Installs the guard-page SIGSEGV handler (once per process) and an alternate
+// signal stack for the calling thread (once per thread). Call on every host
+// thread that runs task code.
+void sim_stack_install_guard_handler();
+
+// Removes and frees the calling thread's alternate signal stack. Call last
+// thing before a thread that installed the handler exits.
+void sim_stack_release_guard_handler();
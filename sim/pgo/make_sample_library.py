@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Generate the sample SD card used for PGO training and headless runs.
+
+Writes deterministic EPUBs (chapters of generated prose, a PNG cover and an
+inline figure each), one folder of books and a plain-text book, so a
+scripted session exercises expat, miniz, layout, glyph rendering and cover
+dithering without shipping copyrighted books or binary blobs.
+
+Usage: python3 sim/pgo/make_sample_library.py <output-dir> [--books N] [--chapters N]
+"""
+
+import argparse
+import os
+import random
+import struct
+import zipfile
+import zlib
+
+WORDS = (
+    "the a of and to in was he she it that his her with for as had on at by "
+    "river morning lantern harbour letter garden window silence evening road "
+    "quietly suddenly perhaps against beneath between towards without always "
+    "remembered whispered wandered carried promised answered followed noticed "
+    "old small bright cold distant familiar narrow heavy gentle strange "
+    "ship house city mountain forest bridge station village market tower "
+    "captain doctor stranger sister brother teacher traveller keeper"
+).split()
+
+TITLES = [
+    "The Lantern Keeper", "Harbour Lights", "A Narrow Road North", "The Glass Orchard",
+    "Letters from the Tower", "Winter Station", "The Cartographer's Daughter", "Salt and Iron",
+    "Beneath the Bridge", "The Quiet Market", "Distant Bells", "The Last Ferry",
+]
+
+
+def sentence(rng):
+    words = [rng.choice(WORDS) for _ in range(rng.randint(6, 22))]
+    text = " ".join(words)
+    if rng.random() < 0.15:
+        text = "“" + text.capitalize() + ",” she said"
+    return text[0].upper() + text[1:] + rng.choice(".....?!")
+
+
+def paragraph(rng):
+    return " ".join(sentence(rng) for _ in range(rng.randint(3, 9)))
+
+
+def png(width, height, row):
+    """Encode an RGB PNG; row(y) returns the width * 3 bytes of one scanline."""
+    raw = b"".join(b"\x00" + row(y) for y in range(height))
+
+    def chunk(tag, data):
+        return struct.pack(">I", len(data)) + tag + data + struct.pack(">I", zlib.crc32(tag + data) & 0xFFFFFFFF)
+
+    header = struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)
+    return b"\x89PNG\r\n\x1a\n" + chunk(b"IHDR", header) + chunk(b"IDAT", zlib.compress(raw, 6)) + chunk(b"IEND", b"")
+
+
+def cover(rng, width=480, height=800):
+    # Gradients, a few discs and noise: plenty of mid-greys for the dithering path
+    base = [rng.randint(40, 200) for _ in range(3)]
+    discs = [(rng.randint(0, width), rng.randint(0, height), rng.randint(40, 180)) for _ in range(5)]
+    noise = random.Random(rng.random())
+    table = [noise.randint(-12, 12) for _ in range(width + 64)]
+    clamp = bytes(max(0, min(255, v - 64)) for v in range(64 + 256 + 64))
+
+    def row(y):
+        inside = bytearray(width)
+        for cx, cy, r in discs:
+            dy = y - cy
+            if dy * dy < r * r:
+                half = int((r * r - dy * dy) ** 0.5)
+                for x in range(max(0, cx - half), min(width, cx + half)):
+                    inside[x] = 1
+        out = bytearray(width * 3)
+        offset = y % 64
+        for x in range(width):
+            shade = (x * 80 // width) + (y * 120 // height)
+            if inside[x]:
+                shade = 255 - shade
+            n = table[x + offset] + 64
+            out[3 * x] = clamp[(base[0] + shade) // 2 + n]
+            out[3 * x + 1] = clamp[(base[1] + shade) // 2 + n]
+            out[3 * x + 2] = clamp[(base[2] + shade) // 2 + n]
+        return bytes(out)
+
+    return png(width, height, row)
+
+
+def figure(rng, width=320, height=200):
+    period = rng.randint(12, 40)
+    dark, light = b"\x1e\x1e\x1e", b"\xff\xff\xff"
+    return png(width, height, lambda y: b"".join(light if (x + y // 2) % period < period // 2 else dark for x in range(width)))
+
+
+def xhtml(title, body):
+    return (
+        '<?xml version="1.0" encoding="utf-8"?>\n'
+        '<!DOCTYPE html>\n'
+        '<html xmlns="http://www.w3.org/1999/xhtml" xmlns:epub="http://www.idpf.org/2007/ops">\n'
+        f"<head><title>{title}</title><link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\"/></head>\n"
+        f"<body>\n{body}\n</body>\n</html>\n"
+    )
+
+
+def write_epub(path, title, author, chapters, rng):
+    book_id = "urn:uuid:crosspoint-sample-%08x" % rng.getrandbits(32)
+    manifest, spine, nav = [], [], []
+    files = {}
+    for i in range(1, chapters + 1):
+        paras = []
+        for p in range(rng.randint(25, 45)):
+            text = paragraph(rng)
+            if p % 11 == 5:
+                text = f"<em>{text}</em>"
+            paras.append(f"<p>{text}</p>")
+        if i == 2:
+            paras.insert(3, '<div class="figure"><img src="figure.png" alt="figure"/></div>')
+        name = f"chapter{i:02d}.xhtml"
+        files["OEBPS/" + name] = xhtml(f"Chapter {i}", f"<h2>Chapter {i}</h2>\n" + "\n".join(paras))
+        manifest.append(f'<item id="c{i}" href="{name}" media-type="application/xhtml+xml"/>')
+        spine.append(f'<itemref idref="c{i}"/>')
+        nav.append(f'<li><a href="{name}">Chapter {i}</a></li>')
+
+    files["OEBPS/nav.xhtml"] = xhtml("Contents", '<nav epub:type="toc"><ol>' + "".join(nav) + "</ol></nav>")
+    files["OEBPS/style.css"] = "body { margin: 0 5%; } p { text-indent: 1.2em; margin: 0; } h2 { text-align: center; }\n"
+    files["OEBPS/toc.ncx"] = (
+        '<?xml version="1.0" encoding="UTF-8"?>\n'
+        '<ncx xmlns="http://www.daisy.org/z3986/2005/ncx/" version="2005-1">'
+        f'<head><meta name="dtb:uid" content="{book_id}"/></head><docTitle><text>{title}</text></docTitle><navMap>'
+        + "".join(
+            f'<navPoint id="n{i}" playOrder="{i}"><navLabel><text>Chapter {i}</text></navLabel>'
+            f'<content src="chapter{i:02d}.xhtml"/></navPoint>'
+            for i in range(1, chapters + 1)
+        )
+        + "</navMap></ncx>\n"
+    )
+    files["OEBPS/content.opf"] = (
+        '<?xml version="1.0" encoding="UTF-8"?>\n'
+        '<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="bookid">\n'
+        '<metadata xmlns:dc="http://purl.org/dc/elements/1.1/">'
+        f'<dc:identifier id="bookid">{book_id}</dc:identifier><dc:title>{title}</dc:title>'
+        f'<dc:creator>{author}</dc:creator><dc:language>en</dc:language><meta name="cover" content="cover"/>'
+        "</metadata>\n<manifest>"
+        '<item id="nav" href="nav.xhtml" media-type="application/xhtml+xml" properties="nav"/>'
+        '<item id="ncx" href="toc.ncx" media-type="application/x-dtbncx+xml"/>'
+        '<item id="css" href="style.css" media-type="text/css"/>'
+        '<item id="cover" href="cover.png" media-type="image/png" properties="cover-image"/>'
+        '<item id="figure" href="figure.png" media-type="image/png"/>'
+        + "".join(manifest)
+        + '</manifest>\n<spine toc="ncx">'
+        + "".join(spine)
+        + "</spine>\n</package>\n"
+    )
+    container = (
+        '<?xml version="1.0"?>\n<container version="1.0" xmlns="urn:oasis:names:tc:opendocument:xmlns:container">'
+        '<rootfiles><rootfile full-path="OEBPS/content.opf" media-type="application/oebps-package+xml"/>'
+        "</rootfiles></container>\n"
+    )
+
+    with zipfile.ZipFile(path, "w") as z:
+        z.writestr("mimetype", "application/epub+zip", compress_type=zipfile.ZIP_STORED)
+        z.writestr("META-INF/container.xml", container, compress_type=zipfile.ZIP_DEFLATED)
+        for name, text in files.items():
+            z.writestr(name, text, compress_type=zipfile.ZIP_DEFLATED)
+        z.writestr("OEBPS/cover.png", cover(rng), compress_type=zipfile.ZIP_STORED)
+        z.writestr("OEBPS/figure.png", figure(rng), compress_type=zipfile.ZIP_STORED)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output")
+    parser.add_argument("--books", type=int, default=8)
+    parser.add_argument("--chapters", type=int, default=12)
+    args = parser.parse_args()
+
+    rng = random.Random(2026)
+    os.makedirs(os.path.join(args.output, "Series"), exist_ok=True)
+    for i in range(args.books):
+        title = TITLES[i % len(TITLES)] + (f" {i // len(TITLES) + 1}" if i >= len(TITLES) else "")
+        folder = "Series" if i >= args.books - 2 else ""
+        name = "".join(c for c in title if c.isalnum() or c == " ").replace(" ", "_") + ".epub"
+        write_epub(os.path.join(args.output, folder, name), title, "Sample Author", args.chapters, rng)
+
+    with open(os.path.join(args.output, "Field_Notes.txt"), "w", encoding="utf-8") as f:
+        for _ in range(400):
+            f.write(paragraph(rng) + "\n\n")
+    print(f"Sample library written to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
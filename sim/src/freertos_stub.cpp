@@ -1,42 +1,426 @@
 #include "FreeRTOSStub.h"
 
-#include <thread>
-#include <unordered_map>
-#include <mutex>
+#include "ArduinoStub.h"
+#include "sim_config.h"
+#include "sim_profile.h"
+#include "sim_task_stack.h"
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 // ---------------------------------------------------------------------------
 // Sim FreeRTOS stub
 //
-// Key challenge: on real FreeRTOS, vTaskDelete() kills a task immediately,
-// even if it is blocked on a semaphore. std::thread has no such mechanism,
-// so we must make every blocking point *cooperative* — the task periodically
-// checks whether it has been cancelled and throws TaskExit to unwind.
+// Two scheduling models, picked once per process by SIM_CORES:
 //
-// Deadlock scenario this solves:
+// Fiber mode (SIM_CORES=1, default): every task is a ucontext fiber on the
+// thread that called sim_rtos_begin(), the main context being loopTask. Only
+// one task runs at a time, as on the single-core ESP32-C3. Context switches
+// happen at blocking points (vTaskDelay, a semaphore or queue wait, delay(),
+// yield()); the scheduler then resumes the highest-priority ready task,
+// round-robin within a priority. When nothing is ready the host thread sleeps
+// until the next timed wake-up, so idle tasks cost no host CPU. Tasks waiting
+// on a socket (sim_task_wait_fd) are blocked fibers too: the scheduler polls
+// their fds, and sleeps in poll(2) on them when nothing else is ready.
+//
+// Thread mode (SIM_CORES=0 or N>1): one host thread per task, blocking on
+// condition variables. With N>1 a task must hold one of N core tokens to run;
+// tokens are handed out by priority and returned at every blocking point.
+//
+// In both modes vTaskDelete() must be able to kill a task that is blocked,
+// e.g. on the rendering mutex held by the deleting thread:
 //   1. Main thread: xSemaphoreTake(renderingMutex)     — holds the mutex
-//   2. Main thread: vTaskDelete(displayTaskHandle)      — sets cancelled, join()s
+//   2. Main thread: vTaskDelete(displayTaskHandle)      — cancels the task
 //   3. Display task: xSemaphoreTake(renderingMutex)     — would block forever
 //
-// Fix: xSemaphoreTake uses try_lock() in a loop, checking cancelled between
-// attempts. When cancelled, it throws TaskExit so the thread exits and
-// join() returns.
+// The victim's blocking call throws TaskExit, which unwinds the task's stack up
+// to its entry point. Fiber mode resumes the victim directly to do this; thread
+// mode notifies the condition variable the victim is waiting on.
+//
+// Semaphores and queues share one wait path (blockingOp): try the operation,
+// and if it cannot complete, wait on the object's wait list until another task
+// changes the object, the timeout passes or the waiter is deleted. As in
+// FreeRTOS, a woken waiter retries rather than being handed the resource.
 // ---------------------------------------------------------------------------
 
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
 struct TaskExit : std::exception {};
 
+enum class TaskState { Ready, Running, Blocked, Finished };
+
+struct TaskInfo;
+
+// Tasks blocked on one condition of a semaphore or queue.
+struct WaitList {
+  std::vector<TaskInfo*> fibers;  // fiber mode, in arrival order
+  std::condition_variable cv;     // thread mode
+};
+
+// Base of everything a task can block on. The mutex is only used in thread
+// mode; fibers never run concurrently.
+struct SyncObject {
+  std::mutex m;
+};
+
 struct TaskInfo {
-  std::thread thread;
+  std::string name;
+  int prio = 1;
+  void (*fn)(void*) = nullptr;
+  void* param = nullptr;
   std::atomic<bool> cancelled{false};
+  bool selfDelete = false;
+
+  // Fiber mode
+  TaskState state = TaskState::Ready;
+  uint64_t readySeq = 0;
+  Clock::time_point wakeAt = Clock::time_point::max();
+  WaitList* waitingOn = nullptr;
+  int waitFd = -1;  // sim_task_wait_fd: the fd and events it waits for
+  short waitEvents = 0;
+  short readyEvents = 0;
+  TaskInfo* joiner = nullptr;
+  ucontext_t ctx{};
+
+  SimTaskStack stack;  // tasks only; loopTask runs on the thread that adopted it (main_sim's firmware thread)
+
+  // Thread mode
+  pthread_t thread{};
+  bool threadStarted = false;
+  std::mutex waitLock;  // guards waitObject/waitList against vTaskDelete
+  SyncObject* waitObject = nullptr;
+  WaitList* waitList = nullptr;
+  SyncObject sleepObject;  // vTaskDelay waits here
+  WaitList sleepList;
+};
+
+struct Semaphore : SyncObject {
+  enum class Kind { Mutex, RecursiveMutex, Binary, Counting };
+  Kind kind = Kind::Mutex;
+  UBaseType_t count = 0;
+  UBaseType_t maxCount = 1;
+  const void* owner = nullptr;  // mutexes only
+  UBaseType_t recursion = 0;
+  WaitList takers;
+};
+
+struct Queue : SyncObject {
+  size_t length = 0;
+  size_t itemSize = 0;
+  std::vector<uint8_t> storage;
+  size_t head = 0;
+  size_t count = 0;
+  WaitList senders;
+  WaitList receivers;
 };
+
+int coreCount() {
+  static const int cores = std::max(0, sim_config_int("SIM_CORES", 1));
+  return cores;
+}
+
+bool fiberMode() { return coreCount() == 1; }
+
+// ---------------------------------------------------------------------------
+// Fiber mode. All state is owned by the firmware thread.
+// ---------------------------------------------------------------------------
+
+TaskInfo s_loopTask;
+TaskInfo* s_current = nullptr;
+std::vector<TaskInfo*> s_fibers;
+uint64_t s_readySeq = 0;
+std::thread::id s_fiberThread;
+bool s_preemptPending = false;
+std::vector<pollfd> s_pollFds;  // reschedule() scratch, parallel to s_pollWaiters
+std::vector<TaskInfo*> s_pollWaiters;
+
+void fiberInit() {
+  if (s_current) {
+    if (std::this_thread::get_id() != s_fiberThread) {
+      fprintf(stderr, "[RTOS] FreeRTOS call from a foreign host thread in fiber mode\n");
+      std::abort();
+    }
+    return;
+  }
+  s_loopTask.name = "loopTask";
+  s_loopTask.prio = 1;
+  s_loopTask.state = TaskState::Running;
+  s_current = &s_loopTask;
+  s_fibers.push_back(&s_loopTask);
+  s_fiberThread = std::this_thread::get_id();
+}
+
+void makeReady(TaskInfo* t) {
+  t->state = TaskState::Ready;
+  t->wakeAt = Clock::time_point::max();
+  t->readySeq = ++s_readySeq;
+}
+
+TaskInfo* pickReady() {
+  TaskInfo* best = nullptr;
+  for (TaskInfo* t : s_fibers) {
+    if (t->state != TaskState::Ready) continue;
+    if (!best || t->prio > best->prio || (t->prio == best->prio && t->readySeq < best->readySeq))
+      best = t;
+  }
+  return best;
+}
+
+void removeWaiter(TaskInfo* t) {
+  if (!t->waitingOn) return;
+  auto& w = t->waitingOn->fibers;
+  w.erase(std::remove(w.begin(), w.end(), t), w.end());
+  t->waitingOn = nullptr;
+}
+
+// Free what finished fibers left behind. Never touches the running fiber.
+void reapFinished() {
+  for (auto it = s_fibers.begin(); it != s_fibers.end();) {
+    TaskInfo* t = *it;
+    if (t->state != TaskState::Finished || t == s_current || t->joiner) {
+      ++it;
+      continue;
+    }
+    sim_stack_free(t->stack);
+    if (t->selfDelete) {
+      sim_profile_task_end(t);
+      it = s_fibers.erase(it);
+      delete t;
+    } else {
+      ++it;  // returned from its entry point; freed by a later vTaskDelete()
+    }
+  }
+}
+
+void switchTo(TaskInfo* next) {
+  TaskInfo* prev = s_current;
+  next->state = TaskState::Running;
+  if (next == prev) return;
+  sim_profile_task_switch(prev, prev->name.c_str(), next);
+  s_current = next;
+  swapcontext(&prev->ctx, &next->ctx);
+  reapFinished();
+}
+
+// Polls the fds of fibers in sim_task_wait_fd and readies those with events.
+void pollWaiters(int timeoutMs) {
+  const int n = poll(s_pollFds.data(), s_pollFds.size(), timeoutMs);
+  if (n <= 0) return;
+  for (size_t i = 0; i < s_pollFds.size(); i++) {
+    if (!s_pollFds[i].revents) continue;
+    s_pollWaiters[i]->readyEvents = s_pollFds[i].revents;
+    makeReady(s_pollWaiters[i]);
+  }
+}
+
+// Run the highest-priority ready fiber. The caller has already moved itself out
+// of Running (Ready to yield, Blocked to wait, Finished to exit).
+void reschedule() {
+  s_preemptPending = false;
+  for (;;) {
+    const auto now = Clock::now();
+    auto earliest = Clock::time_point::max();
+    s_pollFds.clear();
+    s_pollWaiters.clear();
+    for (TaskInfo* t : s_fibers) {
+      if (t->state != TaskState::Blocked) continue;
+      if (t->wakeAt <= now) {
+        removeWaiter(t);
+        makeReady(t);
+        continue;
+      }
+      earliest = std::min(earliest, t->wakeAt);
+      if (t->waitFd >= 0) {
+        s_pollFds.push_back(pollfd{t->waitFd, t->waitEvents, 0});
+        s_pollWaiters.push_back(t);
+      }
+    }
+    if (!s_pollFds.empty()) pollWaiters(0);
+    if (TaskInfo* next = pickReady()) {
+      switchTo(next);
+      return;
+    }
+    if (earliest == Clock::time_point::max() && s_pollFds.empty()) {
+      Serial.printf("[%lu] [RTOS] Deadlock: every task is blocked without a timeout\n", millis());
+      sim_log_flush();
+      std::abort();
+    }
+    if (s_pollFds.empty()) {
+      std::this_thread::sleep_until(earliest);
+    } else if (earliest == Clock::time_point::max()) {
+      pollWaiters(-1);
+    } else {
+      const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - Clock::now()).count() + 1;
+      pollWaiters(static_cast<int>(std::min<long long>(std::max<long long>(ms, 0), INT_MAX)));
+    }
+  }
+}
+
+void fiberCheckCancelled() {
+  if (s_current->cancelled.load()) throw TaskExit();
+}
+
+void fiberBlock(WaitList* waitingOn, Clock::time_point deadline) {
+  TaskInfo* self = s_current;
+  self->state = TaskState::Blocked;
+  self->waitingOn = waitingOn;
+  if (waitingOn) waitingOn->fibers.push_back(self);
+  self->wakeAt = deadline;
+  reschedule();
+  fiberCheckCancelled();
+}
+
+void fiberYield() {
+  fiberInit();
+  fiberCheckCancelled();
+  makeReady(s_current);
+  reschedule();
+  fiberCheckCancelled();
+}
+
+// Wake the highest-priority fiber waiting on list (first come first served
+// within a priority). It preempts the caller at the end of the current call
+// if its priority is higher.
+void fiberWakeOne(WaitList& list) {
+  if (list.fibers.empty()) return;
+  auto best = list.fibers.begin();
+  for (auto it = list.fibers.begin(); it != list.fibers.end(); ++it)
+    if ((*it)->prio > (*best)->prio) best = it;
+  TaskInfo* t = *best;
+  list.fibers.erase(best);
+  t->waitingOn = nullptr;
+  makeReady(t);
+  if (t->prio > s_current->prio) s_preemptPending = true;
+}
+
+void fiberPreemptIfPending() {
+  if (!s_preemptPending) return;
+  makeReady(s_current);
+  reschedule();
+  fiberCheckCancelled();
+}
+
+void fiberEntry() {
+  TaskInfo* self = s_current;
+  try {
+    if (!self->cancelled.load()) self->fn(self->param);
+  } catch (const TaskExit&) {
+  }
+  sim_stack_report(self->stack, self->name.c_str());
+  self->state = TaskState::Finished;
+  if (self->joiner) makeReady(self->joiner);
+  reschedule();  // never returns: nothing resumes a finished fiber
+}
+
+TaskInfo* fiberCreate(void (*fn)(void*), unsigned stack, TaskInfo* info) {
+  if (!sim_stack_alloc(info->stack, stack, info->name.c_str())) return nullptr;
+  info->fn = fn;
+  getcontext(&info->ctx);
+  info->ctx.uc_stack.ss_sp = info->stack.base;
+  info->ctx.uc_stack.ss_size = info->stack.bytes;
+  info->ctx.uc_link = nullptr;
+  makecontext(&info->ctx, fiberEntry, 0);
+  s_fibers.push_back(info);
+  makeReady(info);
+  return info;
+}
+
+void fiberDelete(TaskInfo* t) {
+  if (std::find(s_fibers.begin(), s_fibers.end(), t) == s_fibers.end()) return;
+  if (t->state != TaskState::Finished) {
+    // Resume the victim right away so its blocking call throws TaskExit; we
+    // wait as its joiner until fiberEntry() hands control back.
+    t->cancelled.store(true);
+    removeWaiter(t);
+    t->joiner = s_current;
+    s_current->state = TaskState::Blocked;
+    s_current->wakeAt = Clock::time_point::max();
+    switchTo(t);
+  }
+  s_fibers.erase(std::remove(s_fibers.begin(), s_fibers.end(), t), s_fibers.end());
+  sim_profile_task_end(t);
+  sim_stack_free(t->stack);
+  delete t;
+}
+
+// ---------------------------------------------------------------------------
+// Thread mode.
+// ---------------------------------------------------------------------------
+
 std::unordered_map<TaskHandle_t, TaskInfo*> s_tasks;
+std::vector<TaskInfo*> s_zombies;  // self-deleted threads, joined and freed later
 std::mutex s_mutex;
 
 thread_local TaskHandle_t t_currentHandle = nullptr;
 thread_local TaskInfo* t_currentInfo = nullptr;
+thread_local char t_threadToken;  // mutex owner id for threads that are not tasks
+
+// N core tokens, granted to the highest-priority waiter first (SIM_CORES=N>1).
+class CoreGate {
+ public:
+  void acquire(int prio) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto self = waiting_.insert(prio);
+    cv_.wait(lock, [&] { return free_ > 0 && *waiting_.rbegin() <= prio; });
+    waiting_.erase(self);
+    free_--;
+    cv_.notify_all();
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_++;
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multiset<int> waiting_;
+  int free_ = coreCount();
+};
+
+CoreGate s_cores;
+
+bool coresLimited() { return coreCount() > 1; }
+
+void acquireCore() {
+  if (coresLimited() && t_currentInfo) s_cores.acquire(t_currentInfo->prio);
+}
+
+void releaseCore() {
+  if (coresLimited() && t_currentInfo) s_cores.release();
+}
+
+// Gives up the calling task's core for the duration of a blocking wait.
+// Never construct or destroy one while holding a SyncObject mutex.
+struct OffCore {
+  OffCore() { releaseCore(); }
+  ~OffCore() { acquireCore(); }
+  OffCore(const OffCore&) = delete;
+  OffCore& operator=(const OffCore&) = delete;
+};
 
 // Check if the current task has been cancelled and throw if so.
 inline void checkCancelled() {
@@ -44,44 +428,408 @@ inline void checkCancelled() {
     throw TaskExit();
 }
 
+// Publishes what the current task is blocked on so vTaskDelete() can wake it.
+// Lock order: TaskInfo::waitLock, then SyncObject::m. A waiter never takes
+// waitLock while holding the object mutex.
+struct WaitRegistration {
+  WaitRegistration(SyncObject* obj, WaitList* list) {
+    if (!t_currentInfo) return;
+    std::lock_guard<std::mutex> lock(t_currentInfo->waitLock);
+    t_currentInfo->waitObject = obj;
+    t_currentInfo->waitList = list;
+  }
+  ~WaitRegistration() {
+    if (!t_currentInfo) return;
+    std::lock_guard<std::mutex> lock(t_currentInfo->waitLock);
+    t_currentInfo->waitObject = nullptr;
+    t_currentInfo->waitList = nullptr;
+  }
+  WaitRegistration(const WaitRegistration&) = delete;
+  WaitRegistration& operator=(const WaitRegistration&) = delete;
+};
+
+void* threadEntry(void* arg) {
+  auto* info = static_cast<TaskInfo*>(arg);
+  t_currentHandle = info;
+  t_currentInfo = info;
+  sim_stack_install_guard_handler();
+  acquireCore();
+  try {
+    if (!info->cancelled.load()) info->fn(info->param);
+  } catch (const TaskExit&) {}
+  sim_stack_report(info->stack, info->name.c_str());
+  releaseCore();
+  t_currentHandle = nullptr;
+  t_currentInfo = nullptr;
+  sim_stack_release_guard_handler();
+  if (info->selfDelete) {
+    // The thread is still running on info->stack; whoever reaps it joins first.
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_zombies.push_back(info);
+  }
+  return nullptr;
+}
+
+void joinAndFree(TaskInfo* info) {
+  if (info->threadStarted) pthread_join(info->thread, nullptr);
+  sim_stack_free(info->stack);
+  delete info;
+}
+
+void reapZombies() {
+  std::vector<TaskInfo*> zombies;
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    zombies.swap(s_zombies);
+  }
+  for (TaskInfo* info : zombies) joinAndFree(info);
+}
+
+void wakeBlockedThread(TaskInfo* info) {
+  std::lock_guard<std::mutex> lock(info->waitLock);
+  if (!info->waitObject) return;
+  std::lock_guard<std::mutex> objLock(info->waitObject->m);
+  info->waitList->cv.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Shared blocking path for semaphores and queues.
+// ---------------------------------------------------------------------------
+
+Clock::time_point deadlineFor(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) return Clock::time_point::max();
+  return Clock::now() + std::chrono::milliseconds(static_cast<uint64_t>(ticks) * portTICK_PERIOD_MS);
+}
+
+void wakeOne(WaitList& list) {
+  if (fiberMode())
+    fiberWakeOne(list);
+  else
+    list.cv.notify_all();  // waiters re-check; the OS picks who wins
+}
+
+// Run tryOp (which must not block) until it succeeds or the timeout passes.
+// While it fails the caller waits on `list`, which whoever changes the object
+// must wake. Thread mode runs tryOp under obj->m.
+template <typename TryOp>
+BaseType_t blockingOp(SyncObject* obj, WaitList& list, TickType_t ticks, TryOp tryOp) {
+  if (fiberMode()) {
+    fiberInit();
+    fiberCheckCancelled();
+    const auto deadline = deadlineFor(ticks);
+    while (!tryOp()) {
+      if (ticks == 0 || Clock::now() >= deadline) return pdFALSE;
+      fiberBlock(&list, deadline);
+    }
+    fiberPreemptIfPending();
+    return pdTRUE;
+  }
+
+  checkCancelled();
+  {
+    std::lock_guard<std::mutex> lock(obj->m);
+    if (tryOp()) return pdTRUE;
+  }
+  if (ticks == 0) return pdFALSE;
+
+  const auto deadline = deadlineFor(ticks);
+  OffCore off;
+  WaitRegistration reg(obj, &list);
+  std::unique_lock<std::mutex> lock(obj->m);
+  for (;;) {
+    if (t_currentInfo && t_currentInfo->cancelled.load()) {
+      lock.unlock();
+      throw TaskExit();
+    }
+    if (tryOp()) return pdTRUE;
+    if (deadline == Clock::time_point::max()) {
+      list.cv.wait(lock);
+    } else if (list.cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      return tryOp() ? pdTRUE : pdFALSE;
+    }
+  }
+}
+
+// Runs a non-blocking operation on obj (under obj->m in thread mode).
+template <typename Op>
+auto withLock(SyncObject* obj, Op op) -> decltype(op()) {
+  if (fiberMode()) {
+    fiberInit();
+    return op();
+  }
+  std::lock_guard<std::mutex> lock(obj->m);
+  return op();
+}
+
+const void* currentOwnerId() {
+  if (fiberMode()) return s_current;
+  if (t_currentInfo) return t_currentInfo;
+  return &t_threadToken;
+}
+
+Semaphore* newSemaphore(Semaphore::Kind kind, UBaseType_t maxCount, UBaseType_t initialCount) {
+  auto* s = new Semaphore();
+  s->kind = kind;
+  s->maxCount = maxCount;
+  s->count = std::min(initialCount, maxCount);
+  return s;
+}
+
+bool isMutex(const Semaphore* s) {
+  return s->kind == Semaphore::Kind::Mutex || s->kind == Semaphore::Kind::RecursiveMutex;
+}
+
+BaseType_t semaphoreTake(Semaphore* s, TickType_t ticks, bool recursive) {
+  const void* me = currentOwnerId();
+  return blockingOp(s, s->takers, ticks, [s, me, recursive] {
+    if (recursive && s->owner == me) {
+      s->recursion++;
+      return true;
+    }
+    if (s->count == 0) return false;
+    s->count--;
+    if (isMutex(s)) {
+      s->owner = me;
+      s->recursion = 1;
+    }
+    return true;
+  });
+}
+
+BaseType_t semaphoreGive(Semaphore* s, bool recursive) {
+  const void* me = currentOwnerId();
+  const BaseType_t ok = withLock(s, [s, me, recursive] {
+    if (isMutex(s)) {
+      if (s->owner != me) return pdFALSE;
+      if (recursive && --s->recursion > 0) return pdTRUE;
+      s->owner = nullptr;
+      s->recursion = 0;
+    } else if (s->count >= s->maxCount) {
+      return pdFALSE;
+    }
+    s->count++;
+    wakeOne(s->takers);
+    return pdTRUE;
+  });
+  if (fiberMode()) fiberPreemptIfPending();
+  return ok;
+}
+
+BaseType_t queueSend(Queue* q, const void* item, TickType_t ticks, bool toFront) {
+  return blockingOp(q, q->senders, ticks, [q, item, toFront] {
+    if (q->count == q->length) return false;
+    size_t slot;
+    if (toFront) {
+      q->head = (q->head + q->length - 1) % q->length;
+      slot = q->head;
+    } else {
+      slot = (q->head + q->count) % q->length;
+    }
+    memcpy(q->storage.data() + slot * q->itemSize, item, q->itemSize);
+    q->count++;
+    wakeOne(q->receivers);
+    return true;
+  });
+}
+
+BaseType_t queueReceive(Queue* q, void* item, TickType_t ticks, bool peek) {
+  return blockingOp(q, q->receivers, ticks, [q, item, peek] {
+    if (q->count == 0) return false;
+    memcpy(item, q->storage.data() + q->head * q->itemSize, q->itemSize);
+    if (peek) {
+      wakeOne(q->receivers);  // a peek leaves the item for the next receiver
+      return true;
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    wakeOne(q->senders);
+    return true;
+  });
+}
+
+// Peak usage of tasks still alive at exit; finished tasks report as they end.
+void reportLiveStacks() {
+  if (fiberMode()) {
+    for (TaskInfo* t : s_fibers)
+      if (t->state != TaskState::Finished) sim_stack_report(t->stack, t->name.c_str());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (const auto& entry : s_tasks) sim_stack_report(entry.second->stack, entry.second->name.c_str());
+}
+
 }  // namespace
 
-void vTaskDelay(unsigned ms) {
+void sim_rtos_begin() {
+  static bool begun = false;
+  if (!begun) {
+    begun = true;
+    sim_stack_install_guard_handler();
+    std::atexit(reportLiveStacks);
+  }
+  if (fiberMode()) {
+    fiberInit();
+    return;
+  }
+  if (t_currentInfo || !coresLimited()) return;
+  s_loopTask.name = "loopTask";
+  s_loopTask.prio = 1;
+  t_currentInfo = &s_loopTask;
+  t_currentHandle = &s_loopTask;
+  acquireCore();
+}
+
+void sim_task_delay(unsigned long ms) {
+  if (ms == 0) {
+    sim_task_yield();
+    return;
+  }
+  vTaskDelay(static_cast<TickType_t>(ms));
+}
+
+void sim_task_yield() {
+  if (fiberMode()) {
+    fiberYield();
+    return;
+  }
+  checkCancelled();
+  OffCore off;
+  std::this_thread::yield();
+}
+
+void taskYIELD() { sim_task_yield(); }
+
+short sim_task_wait_fd(int fd, short events, int timeoutMs) {
+  const auto deadline = Clock::now() + std::chrono::milliseconds(std::max(0, timeoutMs));
+  // In fiber mode only the firmware thread is scheduled; other host threads
+  // take the thread-mode path and just poll
+  if (fiberMode() && (!s_current || std::this_thread::get_id() == s_fiberThread)) {
+    fiberInit();
+    fiberCheckCancelled();
+    pollfd ready{fd, events, 0};
+    if (poll(&ready, 1, 0) > 0) return ready.revents;
+    if (timeoutMs <= 0) return 0;
+    TaskInfo* self = s_current;
+    self->waitFd = fd;
+    self->waitEvents = events;
+    self->readyEvents = 0;
+    try {
+      fiberBlock(nullptr, deadline);
+    } catch (...) {
+      self->waitFd = -1;
+      throw;
+    }
+    self->waitFd = -1;
+    return self->readyEvents;
+  }
+
+  // Thread mode: off the core, in slices so vTaskDelete() is noticed
   checkCancelled();
-  // Sleep in small increments so cancellation is noticed quickly.
-  constexpr unsigned SLICE_MS = 5;
-  unsigned remaining = ms;
-  while (remaining > 0) {
-    unsigned sleepMs = remaining < SLICE_MS ? remaining : SLICE_MS;
-    std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
-    remaining -= sleepMs;
+  OffCore off;
+  for (;;) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (left <= 0) return 0;
+    pollfd p{fd, events, 0};
+    const int n = poll(&p, 1, static_cast<int>(std::min<long long>(left, 100)));
+    if (n > 0) return p.revents;
+    if (n < 0 && errno != EINTR) return POLLERR;
     checkCancelled();
   }
 }
 
-int xTaskCreate(void (*fn)(void*), const char*, unsigned, void* param, int,
+void vTaskDelay(TickType_t ticks) {
+  if (fiberMode()) {
+    fiberInit();
+    fiberCheckCancelled();
+    if (ticks == 0) {
+      fiberYield();
+      return;
+    }
+    fiberBlock(nullptr, deadlineFor(ticks));
+    return;
+  }
+
+  checkCancelled();
+  const auto deadline = deadlineFor(ticks);
+  OffCore off;
+  if (!t_currentInfo) {
+    std::this_thread::sleep_until(deadline);
+    return;
+  }
+  // Sleep on the task's own condition variable so vTaskDelete() can wake it.
+  TaskInfo* self = t_currentInfo;
+  WaitRegistration reg(&self->sleepObject, &self->sleepList);
+  std::unique_lock<std::mutex> lock(self->sleepObject.m);
+  self->sleepList.cv.wait_until(lock, deadline, [self] { return self->cancelled.load(); });
+  lock.unlock();
+  checkCancelled();
+}
+
+int xTaskCreate(void (*fn)(void*), const char* name, unsigned stack, void* param, int prio,
                 TaskHandle_t* handle) {
-  auto h = reinterpret_cast<TaskHandle_t>(new uintptr_t(0));
   auto* info = new TaskInfo();
-  {
+  info->name = name ? name : "";
+  info->prio = std::max(tskIDLE_PRIORITY, std::min(prio, configMAX_PRIORITIES - 1));
+  info->param = param;
+
+  if (fiberMode()) {
+    fiberInit();
+    if (!fiberCreate(fn, stack, info)) {
+      delete info;
+      if (handle) *handle = nullptr;
+      return pdFAIL;
+    }
+    if (handle) *handle = info;
+    // A new task with higher priority than its creator runs immediately.
+    if (info->prio > s_current->prio) fiberYield();
+    return pdPASS;
+  }
+
+  reapZombies();
+  info->fn = fn;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  const bool ok = sim_stack_alloc(info->stack, stack, info->name.c_str()) &&
+                  pthread_attr_setstack(&attr, info->stack.base, info->stack.bytes) == 0;
+  TaskHandle_t h = info;
+  if (ok) {
     std::lock_guard<std::mutex> lock(s_mutex);
     s_tasks[h] = info;
+    info->threadStarted = pthread_create(&info->thread, &attr, threadEntry, info) == 0;
+    if (!info->threadStarted) s_tasks.erase(h);
+  }
+  pthread_attr_destroy(&attr);
+  if (!info->threadStarted) {
+    sim_stack_free(info->stack);
+    delete info;
+    if (handle) *handle = nullptr;
+    return pdFAIL;
   }
-  info->thread = std::thread([fn, param, h, info]() {
-    t_currentHandle = h;
-    t_currentInfo = info;
-    try {
-      fn(param);
-    } catch (const TaskExit&) {}
-    t_currentHandle = nullptr;
-    t_currentInfo = nullptr;
-  });
   if (handle) *handle = h;
   return pdPASS;
 }
 
 void vTaskDelete(TaskHandle_t h) {
-  if (!h) return;
+  if (fiberMode()) {
+    fiberInit();
+    if (!h || h == s_current) {
+      if (s_current == &s_loopTask) return;
+      s_current->selfDelete = true;
+      throw TaskExit();
+    }
+    fiberDelete(static_cast<TaskInfo*>(h));
+    return;
+  }
+
+  if (!h || h == t_currentHandle) {
+    if (!t_currentInfo || t_currentInfo == &s_loopTask) return;
+    {
+      std::lock_guard<std::mutex> lock(s_mutex);
+      s_tasks.erase(t_currentHandle);
+    }
+    t_currentInfo->selfDelete = true;
+    throw TaskExit();
+  }
   TaskInfo* info = nullptr;
   {
     std::lock_guard<std::mutex> lock(s_mutex);
@@ -92,41 +840,153 @@ void vTaskDelete(TaskHandle_t h) {
     }
   }
   if (info) {
-    // Signal cancellation — the task will see this in vTaskDelay or xSemaphoreTake.
+    // Cancel, then wake whatever the task is blocked on so it unwinds now.
     info->cancelled.store(true);
-    if (info->thread.joinable())
-      info->thread.join();
-    delete info;
+    wakeBlockedThread(info);
+    OffCore off;
+    joinAndFree(info);
+  }
+  reapZombies();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t h) {
+  if (!h) h = xTaskGetCurrentTaskHandle();
+  if (!h) return 0;
+  return sim_stack_high_water_mark(static_cast<TaskInfo*>(h)->stack);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (fiberMode()) {
+    fiberInit();
+    return s_current;
   }
-  delete reinterpret_cast<uintptr_t*>(h);
+  return t_currentHandle;
 }
 
 SemaphoreHandle_t xSemaphoreCreateMutex() {
-  return reinterpret_cast<SemaphoreHandle_t>(new std::mutex);
+  return newSemaphore(Semaphore::Kind::Mutex, 1, 1);
 }
 
-void xSemaphoreTake(SemaphoreHandle_t m, unsigned) {
-  auto* mtx = m ? static_cast<std::mutex*>(m) : nullptr;
-  if (!mtx) return;
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return newSemaphore(Semaphore::Kind::RecursiveMutex, 1, 1);
+}
 
-  // Main thread (no task context) — just lock normally.
-  if (!t_currentInfo) {
-    mtx->lock();
-    return;
-  }
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return newSemaphore(Semaphore::Kind::Binary, 1, 0);
+}
 
-  // Task thread — spin on try_lock with cancellation checks so we never
-  // block permanently on a mutex held by the thread that is join()ing us.
-  while (!mtx->try_lock()) {
-    checkCancelled();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-  }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  if (maxCount == 0) return nullptr;
+  return newSemaphore(Semaphore::Kind::Counting, maxCount, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t timeout) {
+  if (!m) return pdFALSE;
+  return semaphoreTake(static_cast<Semaphore*>(m), timeout, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+  if (!m) return pdFALSE;
+  return semaphoreGive(static_cast<Semaphore*>(m), false);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t m, TickType_t timeout) {
+  if (!m) return pdFALSE;
+  return semaphoreTake(static_cast<Semaphore*>(m), timeout, true);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t m) {
+  if (!m) return pdFALSE;
+  return semaphoreGive(static_cast<Semaphore*>(m), true);
 }
 
-void xSemaphoreGive(SemaphoreHandle_t m) {
-  if (m) static_cast<std::mutex*>(m)->unlock();
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t m) {
+  if (!m) return 0;
+  auto* s = static_cast<Semaphore*>(m);
+  return withLock(s, [s] { return s->count; });
 }
 
 void vSemaphoreDelete(SemaphoreHandle_t m) {
-  delete static_cast<std::mutex*>(m);
+  delete static_cast<Semaphore*>(m);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  if (length == 0) return nullptr;
+  auto* q = new Queue();
+  q->length = length;
+  q->itemSize = itemSize;
+  q->storage.resize(static_cast<size_t>(length) * itemSize);
+  return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t timeout) {
+  return xQueueSendToBack(q, item, timeout);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void* item, TickType_t timeout) {
+  if (!q) return errQUEUE_FULL;
+  return queueSend(static_cast<Queue*>(q), item, timeout, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void* item, TickType_t timeout) {
+  if (!q) return errQUEUE_FULL;
+  return queueSend(static_cast<Queue*>(q), item, timeout, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void* item) {
+  if (!q) return pdFALSE;
+  auto* queue = static_cast<Queue*>(q);
+  withLock(queue, [queue, item] {
+    if (queue->count == queue->length) {  // intended for length-1 queues
+      queue->head = (queue->head + 1) % queue->length;
+      queue->count--;
+    }
+    const size_t slot = (queue->head + queue->count) % queue->length;
+    memcpy(queue->storage.data() + slot * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    wakeOne(queue->receivers);
+    return 0;
+  });
+  if (fiberMode()) fiberPreemptIfPending();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t timeout) {
+  if (!q) return errQUEUE_EMPTY;
+  return queueReceive(static_cast<Queue*>(q), item, timeout, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void* item, TickType_t timeout) {
+  if (!q) return errQUEUE_EMPTY;
+  return queueReceive(static_cast<Queue*>(q), item, timeout, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  if (!q) return 0;
+  auto* queue = static_cast<Queue*>(q);
+  return withLock(queue, [queue] { return static_cast<UBaseType_t>(queue->count); });
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  if (!q) return 0;
+  auto* queue = static_cast<Queue*>(q);
+  return withLock(queue,
+                  [queue] { return static_cast<UBaseType_t>(queue->length - queue->count); });
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+  if (!q) return pdFALSE;
+  auto* queue = static_cast<Queue*>(q);
+  withLock(queue, [queue] {
+    queue->head = 0;
+    queue->count = 0;
+    wakeOne(queue->senders);
+    return 0;
+  });
+  if (fiberMode()) fiberPreemptIfPending();
+  return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+  delete static_cast<Queue*>(q);
 }
@@ -0,0 +1,96 @@
+/**
+ * GlyphCache — framebuffer-ready glyph bitmaps (see GlyphCache.h).
+ */
+
+#include "GlyphCache.h"
+
+#include "sim_config.h"
+
+#include <algorithm>
+
+namespace {
+constexpr size_t kEntryOverhead = 64;  // map node, LRU node and vector header, roughly
+}  // namespace
+
+// SIM_GLYPH_CACHE_KB: budget, e.g. 8 to try what a device build can spare
+GlyphCache GlyphCache::instance(static_cast<size_t>(std::max(0, sim_config_int("SIM_GLYPH_CACHE_KB", 32))) * 1024);
+
+size_t GlyphCache::KeyHash::operator()(const Key& k) const {
+  size_t h = reinterpret_cast<uintptr_t>(k.font);
+  h = h * 31 + k.codepoint;
+  h = h * 31 + (static_cast<size_t>(k.style) << 16 | static_cast<size_t>(k.orientation) << 8 | k.shift);
+  return h ^ (h >> 17);
+}
+
+size_t GlyphCache::costOf(const Bitmap& bitmap) { return bitmap.rows.size() + kEntryOverhead; }
+
+const GlyphCache::Bitmap* GlyphCache::get(const Key& key, int width, int height, const InkFn& ink) {
+  const auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return &it->second.bitmap;
+  }
+  misses_++;
+  if (width <= 0 || height <= 0 || key.shift > 7) return nullptr;
+
+  const size_t rowBytes = (key.shift + static_cast<size_t>(width) + 7) / 8;
+  if (rowBytes * height + kEntryOverhead > budget_) return nullptr;
+
+  Bitmap bitmap;
+  bitmap.rowBytes = static_cast<uint16_t>(rowBytes);
+  bitmap.height = static_cast<uint16_t>(height);
+  bitmap.rows.assign(rowBytes * height, 0);
+  for (int y = 0; y < height; y++) {
+    uint8_t* row = &bitmap.rows[rowBytes * y];
+    for (int x = 0; x < width; x++) {
+      const int bit = key.shift + x;
+      if (ink(x, y)) row[bit >> 3] |= static_cast<uint8_t>(0x80 >> (bit & 7));
+    }
+  }
+
+  evictTo(budget_ - costOf(bitmap));
+  used_ += costOf(bitmap);
+  lru_.push_front(key);
+  Entry& entry = entries_[key];
+  entry.bitmap = std::move(bitmap);
+  entry.lru = lru_.begin();
+  return &entry.bitmap;
+}
+
+void GlyphCache::blit(uint8_t* frame, int frameWidthBytes, int frameHeight, int x, int y, const Bitmap& glyph,
+                      bool black) {
+  const int col = x >> 3;  // floor, also left of the frame
+  const int first = std::max(0, -col);
+  const int last = std::min<int>(glyph.rowBytes, frameWidthBytes - col);
+  if (first >= last) return;
+  for (int gy = std::max(0, -y); gy < glyph.height && y + gy < frameHeight; gy++) {
+    const uint8_t* src = &glyph.rows[static_cast<size_t>(glyph.rowBytes) * gy];
+    uint8_t* dst = frame + static_cast<size_t>(y + gy) * frameWidthBytes + col;
+    if (black) {
+      for (int i = first; i < last; i++) dst[i] &= static_cast<uint8_t>(~src[i]);
+    } else {
+      for (int i = first; i < last; i++) dst[i] |= src[i];
+    }
+  }
+}
+
+void GlyphCache::setBudget(size_t budgetBytes) {
+  budget_ = budgetBytes;
+  evictTo(budget_);
+}
+
+void GlyphCache::clear() {
+  entries_.clear();
+  lru_.clear();
+  used_ = 0;
+}
+
+void GlyphCache::evictTo(size_t budgetBytes) {
+  while (used_ > budgetBytes && !lru_.empty()) {
+    const auto it = entries_.find(lru_.back());
+    used_ -= costOf(it->second.bitmap);
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+}
@@ -0,0 +1,116 @@
+// HTTPClient for the emulator, on top of the host HTTP client (sim_http.h).
+#include "HTTPClient.h"
+
+#include <HardwareSerial.h>
+
+#include "sim_net.h"
+
+#include <chrono>
+
+namespace {
+
+// sim_http reports failures as text; map them onto HTTPClient's codes.
+int errorCode(const std::string& error) {
+  if (error.compare(0, 14, "cannot resolve") == 0 || error.compare(0, 14, "cannot connect") == 0 ||
+      error.find("not supported") != std::string::npos)
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  if (error == "send failed") return HTTPC_ERROR_SEND_HEADER_FAILED;
+  if (error == "no HTTP response") return HTTPC_ERROR_READ_TIMEOUT;
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+}  // namespace
+
+bool HTTPClient::begin(const char* url) {
+  end();
+  url_ = url ? url : "";
+  return !url_.empty();
+}
+
+void HTTPClient::end() {
+  url_.clear();
+  headers_.clear();
+  responseHeaders_.clear();
+  body_.clear();
+  size_ = -1;
+}
+
+void HTTPClient::addHeader(const char* name, const char* value) {
+  if (!name || !value) return;
+  for (auto& h : headers_) {
+    if (h.first == name) {
+      h.second = value;
+      return;
+    }
+  }
+  headers_.emplace_back(name, value);
+}
+
+void HTTPClient::setAuthorization(const char* user, const char* pass) {
+  const std::string credentials = std::string(user ? user : "") + ":" + (pass ? pass : "");
+  addHeader("Authorization",
+            ("Basic " + sim_net_base64(reinterpret_cast<const uint8_t*>(credentials.data()), credentials.size())).c_str());
+}
+
+int HTTPClient::sendRequest(const char* method, const char* body, size_t len) {
+  if (url_.empty()) return HTTPC_ERROR_NOT_CONNECTED;
+  SimHttpRequest request;
+  request.method = method;
+  request.url = url_;
+  request.headers = headers_;
+  if (body) request.body.assign(body, len);
+  request.timeoutMs = timeoutMs_;
+
+  body_.clear();
+  const auto start = std::chrono::steady_clock::now();
+  const SimHttpResponse response = sim_http_request(request, [this](const uint8_t* data, size_t n) {
+    body_.append(reinterpret_cast<const char*>(data), n);
+    return true;
+  });
+  const long elapsedMs = static_cast<long>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+  responseHeaders_ = response.headers;
+  size_ = response.contentLength >= 0 ? static_cast<int>(response.contentLength) : -1;
+  const int code = response.status >= 0 ? response.status : errorCode(response.error);
+  if (code < 0)
+    Serial.printf("[%lu] [HTTP] %s %s failed after %ld ms: %s\n", millis(), method, url_.c_str(), elapsedMs,
+                  response.error.c_str());
+  else
+    Serial.printf("[%lu] [HTTP] %s %s -> %d in %ld ms\n", millis(), method, url_.c_str(), code, elapsedMs);
+  return code;
+}
+
+String HTTPClient::header(const char* name) const {
+  const std::string* value = sim_http_header(responseHeaders_, name);
+  return String(value ? *value : std::string());
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+      return String("connection refused");
+    case HTTPC_ERROR_SEND_HEADER_FAILED:
+      return String("send header failed");
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+      return String("send payload failed");
+    case HTTPC_ERROR_NOT_CONNECTED:
+      return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST:
+      return String("connection lost");
+    case HTTPC_ERROR_NO_STREAM:
+      return String("no stream");
+    case HTTPC_ERROR_NO_HTTP_SERVER:
+      return String("no HTTP server");
+    case HTTPC_ERROR_TOO_LESS_RAM:
+      return String("too less ram");
+    case HTTPC_ERROR_ENCODING:
+      return String("Transfer-Encoding not supported");
+    case HTTPC_ERROR_STREAM_WRITE:
+      return String("Stream write error");
+    case HTTPC_ERROR_READ_TIMEOUT:
+      return String("read Timeout");
+    default:
+      return String();
+  }
+}
@@ -1,21 +1,97 @@
-// Stub implementation of HttpDownloader for emulator (no HTTP in sim).
+// HttpDownloader for the emulator, on top of the host HTTP client (sim_http.h):
+// real sockets to a local server, or files through SIM_HTTP_MAP.
 #include "network/HttpDownloader.h"
 
-bool HttpDownloader::fetchUrl(const std::string& url, std::string& outContent) {
-  (void)url;
-  (void)outContent;
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+
+#include "sim_http.h"
+
+namespace {
+
+SimHttpRequest getRequest(const std::string& url) {
+  SimHttpRequest request;
+  request.url = url;
+  return request;
+}
+
+bool succeeded(const SimHttpResponse& response, const std::string& url) {
+  if (response.status == 200 && response.error.empty()) return true;
+  if (response.status < 0 || !response.error.empty())
+    Serial.printf("[%lu] [HTTP] %s failed: %s\n", millis(), url.c_str(), response.error.c_str());
+  else
+    Serial.printf("[%lu] [HTTP] %s failed: HTTP %d\n", millis(), url.c_str(), response.status);
   return false;
 }
+
+}  // namespace
+
+bool HttpDownloader::fetchUrl(const std::string& url, std::string& outContent) {
+  outContent.clear();
+  const SimHttpResponse response = sim_http_request(
+      getRequest(url),
+      [&outContent](const uint8_t* data, size_t len) {
+        outContent.append(reinterpret_cast<const char*>(data), len);
+        return true;
+      },
+      [&outContent](const SimHttpResponse& r) {
+        if (r.status == 200 && r.contentLength > 0) outContent.reserve(static_cast<size_t>(r.contentLength));
+      });
+  return succeeded(response, url);
+}
+
 bool HttpDownloader::fetchUrl(const std::string& url, Stream& stream) {
-  (void)url;
-  (void)stream;
-  return false;
+  bool started = false;
+  const SimHttpResponse response = sim_http_request(
+      getRequest(url),
+      [&stream, &started](const uint8_t* data, size_t len) {
+        if (!started) return false;  // error page; don't feed it to the parser
+        return static_cast<Print&>(stream).write(data, len) == len;
+      },
+      [&started](const SimHttpResponse& r) { started = r.status == 200; });
+  return succeeded(response, url);
 }
+
 HttpDownloader::DownloadError HttpDownloader::downloadToFile(const std::string& url,
                                                              const std::string& destPath,
                                                              ProgressCallback progress) {
-  (void)url;
-  (void)destPath;
-  (void)progress;
-  return HttpDownloader::HTTP_ERROR;
+  FsFile file;
+  bool fileOk = true;
+  bool started = false;
+  size_t downloaded = 0;
+  size_t total = 0;
+  const unsigned long startMs = millis();
+
+  const SimHttpResponse response = sim_http_request(
+      getRequest(url),
+      [&](const uint8_t* data, size_t len) {
+        if (!started) return false;
+        if (file.write(data, len) != len) {
+          fileOk = false;
+          return false;
+        }
+        downloaded += len;
+        if (progress) progress(downloaded, total);
+        return true;
+      },
+      [&](const SimHttpResponse& r) {
+        if (r.status != 200) return;
+        total = r.contentLength > 0 ? static_cast<size_t>(r.contentLength) : 0;
+        started = fileOk = SdMan.openFileForWrite("HTTP", destPath, file);
+      });
+
+  if (file) file.close();
+  // Only remove destPath once this call opened it: a failed open leaves
+  // whatever was there before
+  if (!fileOk) {
+    if (started) SdMan.remove(destPath.c_str());
+    return FILE_ERROR;
+  }
+  if (!succeeded(response, url)) {
+    if (started) SdMan.remove(destPath.c_str());
+    return HTTP_ERROR;
+  }
+  Serial.printf("[%lu] [HTTP] Downloaded %zu bytes to %s in %lu ms\n", millis(), downloaded,
+                destPath.c_str(), millis() - startMs);
+  return OK;
 }
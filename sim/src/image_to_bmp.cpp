@@ -20,6 +20,7 @@
 #include "Arduino.h"
 #include <HardwareSerial.h>
 #include <SdFat.h>
+#include <ZipInflater.h>
 
 #include <algorithm>
 #include <cstdint>
@@ -27,6 +28,7 @@
 #include <vector>
 
 #include "BitmapHelpers.h"
+#include "sim_profile.h"
 
 // ============================================================================
 // Target dimensions — must match JpegToBmpConverter for consistent covers
@@ -136,26 +138,47 @@ static int stbi_fsfile_eof(void* user) {
   return file->position() >= file->size() ? 1 : 0;
 }
 
+// ============================================================================
+// stb_image callback for reading from a ZIP entry as it inflates
+// ============================================================================
+static int stbi_zip_read(void* user, char* data, int size) {
+  const int got = static_cast<ZipInflater*>(user)->read(reinterpret_cast<uint8_t*>(data), size);
+  return got < 0 ? 0 : got;
+}
+
+static void stbi_zip_skip(void* user, int n) {
+  auto* entry = static_cast<ZipInflater*>(user);
+  uint8_t discard[256];
+  while (n > 0) {
+    const int got = entry->read(discard, std::min(n, static_cast<int>(sizeof(discard))));
+    if (got <= 0) return;
+    n -= got;
+  }
+}
+
+static int stbi_zip_eof(void* user) { return static_cast<ZipInflater*>(user)->atEnd() ? 1 : 0; }
+
 // ============================================================================
 // Core implementation
 // ============================================================================
 bool ImageToBmpConverter::imageToBmpStreamInternal(
-    FsFile& imageFile, Print& bmpOut,
+    const Source& source, Print& bmpOut,
     int targetWidth, int targetHeight,
     bool oneBit, bool crop) {
+  SIM_PROFILE_SCOPE("image conversion");
 
   Serial.printf("[IMG] Decoding image via stb_image (target %dx%d, %s)\n",
                 targetWidth, targetHeight, oneBit ? "1-bit" : "2-bit");
 
-  // Set up stb_image I/O callbacks to read from FsFile
+  // Set up stb_image I/O callbacks to read from the source
   stbi_io_callbacks callbacks;
-  callbacks.read = stbi_fsfile_read;
-  callbacks.skip = stbi_fsfile_skip;
-  callbacks.eof  = stbi_fsfile_eof;
+  callbacks.read = source.read;
+  callbacks.skip = source.skip;
+  callbacks.eof  = source.eof;
 
   int srcW = 0, srcH = 0, channels = 0;
   // Request 1 channel (grayscale) — stb_image will convert for us
-  unsigned char* pixels = stbi_load_from_callbacks(&callbacks, &imageFile,
+  unsigned char* pixels = stbi_load_from_callbacks(&callbacks, source.user,
                                                    &srcW, &srcH, &channels, 1);
   if (!pixels) {
     Serial.printf("[IMG] stb_image failed: %s\n", stbi_failure_reason());
@@ -263,7 +286,7 @@ bool ImageToBmpConverter::imageToBmpStreamInternal(
 
 // Public API — cover image (2-bit, display-size)
 bool ImageToBmpConverter::imageToBmpStream(FsFile& imageFile, Print& bmpOut, bool crop) {
-  return imageToBmpStreamInternal(imageFile, bmpOut,
+  return imageToBmpStreamInternal({stbi_fsfile_read, stbi_fsfile_skip, stbi_fsfile_eof, &imageFile}, bmpOut,
                                   TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT,
                                   false, crop);
 }
@@ -272,7 +295,23 @@ bool ImageToBmpConverter::imageToBmpStream(FsFile& imageFile, Print& bmpOut, boo
 bool ImageToBmpConverter::imageTo1BitBmpStreamWithSize(
     FsFile& imageFile, Print& bmpOut,
     int targetMaxWidth, int targetMaxHeight) {
-  return imageToBmpStreamInternal(imageFile, bmpOut,
+  return imageToBmpStreamInternal({stbi_fsfile_read, stbi_fsfile_skip, stbi_fsfile_eof, &imageFile}, bmpOut,
+                                  targetMaxWidth, targetMaxHeight,
+                                  true, true);
+}
+
+// Public API — cover straight from an EPUB entry
+bool ImageToBmpConverter::imageToBmpStream(ZipInflater& imageEntry, Print& bmpOut, bool crop) {
+  return imageToBmpStreamInternal({stbi_zip_read, stbi_zip_skip, stbi_zip_eof, &imageEntry}, bmpOut,
+                                  TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT,
+                                  false, crop);
+}
+
+// Public API — thumbnail straight from an EPUB entry
+bool ImageToBmpConverter::imageTo1BitBmpStreamWithSize(
+    ZipInflater& imageEntry, Print& bmpOut,
+    int targetMaxWidth, int targetMaxHeight) {
+  return imageToBmpStreamInternal({stbi_zip_read, stbi_zip_skip, stbi_zip_eof, &imageEntry}, bmpOut,
                                   targetMaxWidth, targetMaxHeight,
                                   true, true);
 }
@@ -0,0 +1,244 @@
+/**
+ * LibraryIndex — append-only library metadata file (see LibraryIndex.h).
+ */
+
+#include "LibraryIndex.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+LibraryIndex LibraryIndex::instance("/.crosspoint/library.idx");
+
+namespace {
+constexpr char kMagic[4] = {'C', 'P', 'L', 'I'};
+constexpr uint8_t kVersion = 1;
+constexpr size_t kHeaderBytes = sizeof(kMagic) + 1;
+constexpr size_t kFixedBytes = 8 + 4 + 4 + 1 + 1;  // key, size, modified, flags, percent
+constexpr size_t kMinSlack = 16;                   // superseded records tolerated before a rewrite
+
+void putLe(std::string& out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+uint64_t getLe(const uint8_t* p, int bytes) {
+  uint64_t v = 0;
+  for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+// At most 255 bytes, not splitting a UTF-8 sequence.
+std::string clip(const std::string& s) {
+  if (s.size() <= 255) return s;
+  size_t n = 255;
+  while (n > 0 && (static_cast<uint8_t>(s[n]) & 0xC0) == 0x80) n--;
+  return s.substr(0, n);
+}
+
+std::string encode(uint64_t key, const LibraryIndex::Entry& e) {
+  const std::string title = clip(e.title);
+  const std::string author = clip(e.author);
+  std::string rec;
+  putLe(rec, kFixedBytes + 2 + title.size() + author.size(), 2);
+  putLe(rec, key, 8);
+  putLe(rec, e.size, 4);
+  putLe(rec, e.modified, 4);
+  putLe(rec, e.flags, 1);
+  putLe(rec, e.percent, 1);
+  putLe(rec, title.size(), 1);
+  rec += title;
+  putLe(rec, author.size(), 1);
+  rec += author;
+  return rec;
+}
+
+// Size and FAT modify time of a book, for telling later whether it changed.
+bool statBook(const std::string& bookPath, LibraryIndex::Entry& e) {
+  FsFile book = SdMan.open(bookPath.c_str(), O_RDONLY);
+  if (!book || book.isDirectory()) return false;
+  e.size = static_cast<uint32_t>(book.size());
+  uint16_t date = 0, time = 0;
+  e.modified = book.getModifyDateTime(&date, &time) ? (static_cast<uint32_t>(date) << 16) | time : 0;
+  return true;
+}
+}  // namespace
+
+uint64_t LibraryIndex::keyFor(const std::string& bookPath) {
+  return static_cast<uint64_t>(std::hash<std::string>{}(bookPath));
+}
+
+void LibraryIndex::ensureLoaded() {
+  if (loaded_) return;
+  loaded_ = true;
+  entries_.clear();
+  records_ = 0;
+  needsRewrite_ = false;
+  if (!SdMan.exists(indexPath_.c_str())) return;
+  FsFile f = SdMan.open(indexPath_.c_str(), O_RDONLY);
+  if (!f) return;
+  uint8_t header[kHeaderBytes];
+  if (f.read(header, sizeof(header)) != static_cast<int>(sizeof(header)) || memcmp(header, kMagic, 4) != 0 ||
+      header[4] != kVersion) {
+    Serial.printf("[%lu] [LIBIDX] %s is not a version %u index, starting over\n", millis(), indexPath_.c_str(),
+                  kVersion);
+    needsRewrite_ = true;
+    return;
+  }
+  uint8_t buf[2 + kFixedBytes + 2 + 255 + 255];
+  for (;;) {
+    const int got = f.read(buf, 2);
+    if (got == 0) break;
+    const size_t len = got == 2 ? getLe(buf, 2) : 0;
+    if (len < kFixedBytes + 2 || len > sizeof(buf) - 2 || f.read(buf + 2, len) != static_cast<int>(len)) {
+      needsRewrite_ = true;  // torn last record
+      break;
+    }
+    const uint8_t* p = buf + 2;
+    const size_t titleLen = p[kFixedBytes];
+    if (kFixedBytes + 2 + titleLen > len || kFixedBytes + 2 + titleLen + p[kFixedBytes + 1 + titleLen] != len) {
+      needsRewrite_ = true;
+      break;
+    }
+    Entry e;
+    e.size = static_cast<uint32_t>(getLe(p + 8, 4));
+    e.modified = static_cast<uint32_t>(getLe(p + 12, 4));
+    e.flags = p[16];
+    e.percent = p[17];
+    e.title.assign(reinterpret_cast<const char*>(p + kFixedBytes + 1), titleLen);
+    e.author.assign(reinterpret_cast<const char*>(p + kFixedBytes + 2 + titleLen), len - kFixedBytes - 2 - titleLen);
+    entries_[getLe(p, 8)] = std::move(e);
+    records_++;
+  }
+}
+
+bool LibraryIndex::append(uint64_t key, const Entry& entry) {
+  if (needsRewrite_ || records_ >= 2 * entries_.size() + kMinSlack) return rewrite();
+  const std::string rec = encode(key, entry);
+  const size_t slash = indexPath_.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) SdMan.ensureDirectoryExists(indexPath_.substr(0, slash).c_str());
+  FsFile f = SdMan.open(indexPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND);
+  if (!f) return false;
+  if (f.size() == 0) {
+    f.write(reinterpret_cast<const uint8_t*>(kMagic), sizeof(kMagic));
+    f.write(kVersion);
+  }
+  const bool ok = f.write(reinterpret_cast<const uint8_t*>(rec.data()), rec.size()) == rec.size();
+  f.close();
+  records_++;
+  return ok;
+}
+
+bool LibraryIndex::rewrite() {
+  const std::string tmpPath = indexPath_ + ".tmp";
+  FsFile f;
+  if (!SdMan.openFileForWrite("LIBIDX", tmpPath, f)) return false;
+  bool ok = f.write(reinterpret_cast<const uint8_t*>(kMagic), sizeof(kMagic)) == sizeof(kMagic) &&
+            f.write(kVersion) == 1;
+  for (const auto& kv : entries_) {
+    const std::string rec = encode(kv.first, kv.second);
+    ok = ok && f.write(reinterpret_cast<const uint8_t*>(rec.data()), rec.size()) == rec.size();
+  }
+  if (ok) {
+    SdMan.remove(indexPath_.c_str());
+    ok = f.rename(indexPath_.c_str());
+  }
+  f.close();
+  if (!ok) {
+    SdMan.remove(tmpPath.c_str());
+    Serial.printf("[%lu] [LIBIDX] Could not rewrite %s\n", millis(), indexPath_.c_str());
+    return false;
+  }
+  records_ = entries_.size();
+  needsRewrite_ = false;
+  return true;
+}
+
+bool LibraryIndex::find(uint64_t key, Entry& out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ensureLoaded();
+  const auto it = entries_.find(key);
+  if (it == entries_.end()) return false;
+  out = it->second;
+  return true;
+}
+
+bool LibraryIndex::find(const std::string& bookPath, Entry& out) { return find(keyFor(bookPath), out); }
+
+size_t LibraryIndex::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ensureLoaded();
+  return entries_.size();
+}
+
+bool LibraryIndex::recordBook(const std::string& bookPath, const std::string& title, const std::string& author,
+                              bool hasThumb) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ensureLoaded();
+  Entry next;
+  if (!statBook(bookPath, next)) return false;
+  const uint64_t key = keyFor(bookPath);
+  Entry& e = entries_[key];
+  next.flags = static_cast<uint8_t>((e.flags & ~kHasThumb) | (hasThumb ? kHasThumb : 0));
+  next.percent = e.percent;
+  next.title = clip(title);
+  next.author = clip(author);
+  if (next.size == e.size && next.modified == e.modified && next.flags == e.flags && next.title == e.title &&
+      next.author == e.author)
+    return true;
+  e = std::move(next);
+  return append(key, e);
+}
+
+bool LibraryIndex::recordProgress(uint64_t key, uint8_t percent) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return setProgress(key, percent);
+}
+
+bool LibraryIndex::setProgress(uint64_t key, uint8_t percent) {
+  ensureLoaded();
+  Entry& e = entries_[key];
+  if (e.percent == percent) return true;
+  e.percent = percent;
+  return append(key, e);
+}
+
+bool LibraryIndex::recordProgress(const std::string& bookPath, uint8_t percent) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ensureLoaded();
+  const uint64_t key = keyFor(bookPath);
+  if (entries_.find(key) == entries_.end()) statBook(bookPath, entries_[key]);
+  return setProgress(key, percent);
+}
+
+void LibraryIndex::reload() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  loaded_ = false;
+}
+
+void LibraryIndex::noteProgressFile(const std::string& hostPath) {
+  // .../.crosspoint/epub_<key>/progress.bin, 8-byte format: spine, page,
+  // page count, percent (u16 each); the old 6-byte format has no percent
+  static const std::string kFile = "/progress.bin";
+  if (hostPath.size() <= kFile.size() ||
+      hostPath.compare(hostPath.size() - kFile.size(), kFile.size(), kFile) != 0)
+    return;
+  const size_t dirEnd = hostPath.size() - kFile.size();
+  const size_t dirStart = hostPath.rfind("/epub_", dirEnd);
+  if (dirStart == std::string::npos) return;
+  const std::string digits = hostPath.substr(dirStart + 6, dirEnd - dirStart - 6);
+  char* end = nullptr;
+  const uint64_t key = strtoull(digits.c_str(), &end, 10);
+  if (digits.empty() || *end != '\0') return;
+  FILE* f = fopen(hostPath.c_str(), "rb");
+  if (!f) return;
+  uint8_t data[8];
+  const size_t n = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  if (n != sizeof(data)) return;
+  const uint64_t percent = getLe(data + 6, 2);
+  if (percent <= 100) recordProgress(key, static_cast<uint8_t>(percent));
+}
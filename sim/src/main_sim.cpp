@@ -1,26 +1,51 @@
 // Emulator entry point: init SDL/sim, then run Crosspoint setup() and loop().
-// setup() and loop() are defined in Crosspoint src/main.cpp.
-// Behavior matches the real device: single core (prewarm on main thread with yields),
-// shared SPI (display and SD serialized).
+// setup() and loop() are defined in Crosspoint src/main.cpp and run on a
+// firmware thread; the main thread keeps SDL (input, presenting frames).
+// Behavior matches the real device: single core (prewarm in the loop with yields),
+// shared SPI (display and SD serialized). Also hosts the SIM_INSTANCES device
+// farm, `--corpus` runs (sim_corpus.h) and the main-thread side of warm-start
+// snapshots (sim_snapshot.h).
 
 #include <Epub.h>
+#include <FreeRTOSStub.h>
 #include <HardwareSerial.h>
+#include <LibraryIndex.h>
 #include <SDCardManager.h>
 #include <SdFat.h>
+#include "sim_config.h"
+#include "sim_corpus.h"
 #include "sim_display.h"
+#include "sim_kosync.h"
+#include "sim_log.h"
+#include "sim_profile.h"
+#include "sim_snapshot.h"
 
 #include <atomic>
 #include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+extern char** environ;
+
 // Crosspoint app entry points (from main.cpp)
 extern void setup();
 extern void loop();
 
 namespace {
 constexpr int kLibraryThumbHeight = 100;
+constexpr int kPumpWaitMs = 100;     // idle wake-up of the SDL loop
+constexpr int kQuitGraceMs = 2000;   // for the firmware to finish its loop() on quit
+constexpr size_t kFirmwareStackBytes = 8 * 1024 * 1024;
 
 bool endsWithEpub(const std::string& name) {
   if (name.size() < 5) return false;
@@ -29,6 +54,10 @@ bool endsWithEpub(const std::string& name) {
   return ext == ".epub";
 }
 
+// Progress saving is firmware code: stand in for its LibIndex.recordProgress()
+// call by watching for written epub_<hash>/progress.bin files
+void noteWrittenFile(const std::string& hostPath) { LibIndex.noteProgressFile(hostPath); }
+
 std::atomic<bool> g_prewarmDone{false};
 
 // Prewarm one EPUB per main-loop iteration so UI gets control between thumbnails
@@ -76,46 +105,211 @@ void prewarmStep() {
 
   const std::string path = "/" + filename;
   Epub epub(path, "/.crosspoint");
-  if (!epub.load(true, true)) {
+  bool loaded;
+  {
+    SIM_PROFILE_SCOPE("Epub::load (prewarm)");
+    loaded = epub.load(true, true);
+  }
+  if (!loaded) {
     Serial.printf("[%lu] [SIM] Failed to load EPUB for thumb prewarm: %s\n", millis(), path.c_str());
     return;
   }
-  if (!epub.generateThumbBmp(kLibraryThumbHeight)) {
+  bool thumbOk;
+  {
+    SIM_PROFILE_SCOPE("Epub::generateThumbBmp");
+    thumbOk = epub.generateThumbBmp(kLibraryThumbHeight);
+  }
+  if (!thumbOk) {
     Serial.printf("[%lu] [SIM] Failed to prewarm thumb: %s\n", millis(), path.c_str());
   } else {
     Serial.printf("[%lu] [SIM] Prewarmed thumb: %s\n", millis(), path.c_str());
   }
+  // The book is loaded anyway: keep the library index current for folder views
+  LibIndex.recordBook(path, epub.getTitle(), epub.getAuthor(), thumbOk);
+}
+
+#if defined(CROSSPOINT_PGO_GENERATE)
+#if defined(__clang__)
+extern "C" int __llvm_profile_write_file(void);
+#else
+extern "C" void __gcov_dump(void);
+#endif
+#endif
+
+// Writes the PGO training profiles (CROSSPOINT_PGO=GENERATE) on paths that
+// end in _Exit(), which skips the atexit handler that normally writes them.
+void writePgoProfiles() {
+#if defined(CROSSPOINT_PGO_GENERATE)
+#if defined(__clang__)
+  __llvm_profile_write_file();
+#else
+  __gcov_dump();
+#endif
+#endif
+}
+
+std::atomic<bool> g_quit{false};
+std::atomic<bool> g_firmwareDone{false};
+pthread_t g_firmwareThread;
+
+// Firmware thread: adopted as loopTask, so every firmware task runs here (or on
+// threads of its own with SIM_CORES != 1) and never waits on SDL. One prewarm
+// step per iteration, then loop(), as on the device; the trailing yield stands
+// in for the tick preemption loopTask gets on the device, so equal-priority
+// tasks (e.g. an activity's display task) run between iterations.
+void* firmwareMain(void*) {
+  sim_rtos_begin();
+  sim_profile_begin();
+  sim_kosync_begin();
+  setup();
+  sim_corpus_book();
+  while (!g_quit.load()) {
+    prewarmStep();
+    {
+      SIM_PROFILE_SCOPE("loop()");
+      loop();
+    }
+    yield();
+  }
+  g_firmwareDone.store(true);
+  return nullptr;
+}
+
+// The main thread's part: SDL input and presenting until the window closes,
+// then the firmware gets kQuitGraceMs to finish its loop().
+void presentUntilQuit() {
+  while (sim_display_pump_events(kPumpWaitMs)) {
+  }
+
+  g_quit.store(true);
+  for (int waited = 0; !g_firmwareDone.load() && waited < kQuitGraceMs; waited += 10) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if (!g_firmwareDone.load()) {
+    // Stuck mid-loop(): exit-time reports would race the running firmware
+    Serial.printf("[%lu] [SIM] Firmware still busy after %d ms, exiting without reports\n", millis(), kQuitGraceMs);
+    sim_log_flush();
+    sim_display_shutdown();
+    writePgoProfiles();
+    std::_Exit(0);
+  }
+  pthread_join(g_firmwareThread, nullptr);
+  sim_display_shutdown();
+}
+
+// A resumed snapshot has only the firmware thread: a new thread takes over
+// the main thread's part and ends the process as main() would.
+void startResumedPresenter() {
+  g_firmwareThread = pthread_self();
+  std::thread([] {
+    presentUntilQuit();
+    exit(0);
+  }).detach();
+}
+
+// SIM_INSTANCES=N: N emulated devices as forked processes over one card. Each
+// instance gets SIM_INSTANCE=<i>, its own copy-on-write overlay (default
+// <SIM_FARM_DIR>/<i>/overlay) and its own serial log, and "{n}" in any SIM_*
+// value becomes <i>, e.g. SIM_INPUT_SCRIPT=session{n}.txt. Called before SDL
+// and before any thread exists, so fork() is safe. Returns in each child, with
+// the child set up as instance <i>; the parent only waits for the children and
+// exits with 1 if any of them failed.
+void runFarm(int instances) {
+  const std::string farmDir = sim_config_str("SIM_FARM_DIR", "farm");
+  mkdir(farmDir.c_str(), 0755);
+  std::vector<pid_t> pids;
+  for (int i = 0; i < instances; i++) {
+    const std::string dir = farmDir + "/" + std::to_string(i);
+    mkdir(dir.c_str(), 0755);
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "Farm: fork failed for instance %d: %s\n", i, strerror(errno));
+      break;
+    }
+    if (pid == 0) {
+      const std::string n = std::to_string(i);
+      setenv("SIM_INSTANCE", n.c_str(), 1);
+      setenv("SIM_OVERLAY", (dir + "/overlay").c_str(), 0);
+      setenv("SDL_VIDEODRIVER", "dummy", 0);  // headless unless a driver was chosen
+      std::vector<std::pair<std::string, std::string>> expanded;
+      for (char** e = environ; *e; e++) {
+        const std::string var(*e);
+        const size_t eq = var.find('=');
+        if (var.compare(0, 4, "SIM_") != 0 || eq == std::string::npos) continue;
+        std::string value = var.substr(eq + 1);
+        bool changed = false;
+        for (size_t at; (at = value.find("{n}")) != std::string::npos; changed = true) value.replace(at, 3, n);
+        if (changed) expanded.emplace_back(var.substr(0, eq), value);
+      }
+      for (const auto& kv : expanded) setenv(kv.first.c_str(), kv.second.c_str(), 1);
+      if (freopen((dir + "/serial.log").c_str(), "w", stdout)) dup2(fileno(stdout), STDERR_FILENO);
+      return;
+    }
+    pids.push_back(pid);
+    printf("Farm: instance %d is pid %d, log %s/serial.log\n", i, static_cast<int>(pid), dir.c_str());
+  }
+
+  int failed = instances - static_cast<int>(pids.size());
+  for (size_t i = 0; i < pids.size(); i++) {
+    int status = 0;
+    while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+    failed++;
+    if (WIFSIGNALED(status)) {
+      printf("Farm: instance %zu killed by signal %d\n", i, WTERMSIG(status));
+    } else {
+      printf("Farm: instance %zu exited with %d\n", i, WEXITSTATUS(status));
+    }
+  }
+  printf("Farm: %d of %d instances finished cleanly\n", instances - failed, instances);
+  fflush(stdout);
+  std::_Exit(failed == 0 ? 0 : 1);  // the firmware never ran here: skip its static destructors
 }
 }  // namespace
 
 int main(int argc, char** argv) {
-  (void)argc;
-  (void)argv;
+  if (argc == 3 && strcmp(argv[1], "--decode-log") == 0) {
+    if (!sim_log_decode(argv[2])) {
+      fprintf(stderr, "Not a SIM_LOG_BINARY file: %s\n", argv[2]);
+      return 1;
+    }
+    return 0;
+  }
 
   // Ensure ./sdcard is findable: if run from build/, chdir to project root
-  if (access("./sdcard", F_OK) != 0 && access("../sdcard", F_OK) == 0) {
+  if (!getenv("SIM_SDCARD") && access("./sdcard", F_OK) != 0 && access("../sdcard", F_OK) == 0) {
     if (chdir("..") != 0) {
       fprintf(stderr, "Could not chdir to project root (../sdcard)\n");
     }
   }
 
+  if (argc == 3 && strcmp(argv[1], "--corpus") == 0) sim_corpus_run(argv[2]);
+  const int instances = sim_config_int("SIM_INSTANCES", 0);
+  if (instances > 0 && !getenv("SIM_INSTANCE")) runFarm(instances);
+
   if (!sim_display_init()) {
     fprintf(stderr, "sim_display_init failed\n");
     return 1;
   }
 
   printf("Crosspoint emulator: running setup() then loop(). Close window to exit.\n");
-  setup();
-
-  // Single main thread: one prewarm step per frame, then events and loop (matches device).
-  while (true) {
-    prewarmStep();
-    if (!sim_display_pump_events()) {
-      break;
-    }
-    loop();
+  sim_snapshot_begin(startResumedPresenter);
+  FsFile::setWriteCloseObserver(noteWrittenFile);
+  // Main-thread-sized stack: loopTask ran on the main thread before, and macOS
+  // gives other threads only 512 KB by default
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, kFirmwareStackBytes);
+  const int err = pthread_create(&g_firmwareThread, &attr, firmwareMain, nullptr);
+  pthread_attr_destroy(&attr);
+  if (err != 0) {
+    fprintf(stderr, "Could not start the firmware thread: %s\n", strerror(err));
+    return 1;
   }
 
-  sim_display_shutdown();
+  // The main thread only drives SDL: input events and presenting published frames
+  presentUntilQuit();
   return 0;
 }
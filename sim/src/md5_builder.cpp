@@ -0,0 +1,216 @@
+// MD5 (RFC 1321) for MD5Builder. The block function is fully unrolled with
+// the round constants inlined; input words are loaded straight from the
+// caller's buffer on little-endian hosts.
+
+#include "MD5Builder.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+constexpr size_t kStreamChunkBytes = 16 * 1024;
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+  (a) += f((b), (c), (d)) + (x) + (t);   \
+  (a) = ((a) << (s)) | ((a) >> (32 - (s))); \
+  (a) += (b)
+
+inline uint32_t load32(const uint8_t* p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+#else
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+#endif
+}
+
+// Processes `blocks` consecutive 64-byte blocks.
+void transform(uint32_t state[4], const uint8_t* data, size_t blocks) {
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  for (; blocks > 0; blocks--, data += 64) {
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++) x[i] = load32(data + i * 4);
+    const uint32_t sa = a, sb = b, sc = c, sd = d;
+
+    MD5_STEP(MD5_F, a, b, c, d, x[0], 0xd76aa478, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[1], 0xe8c7b756, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[2], 0x242070db, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[3], 0xc1bdceee, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[4], 0xf57c0faf, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[5], 0x4787c62a, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[6], 0xa8304613, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[7], 0xfd469501, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[8], 0x698098d8, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[9], 0x8b44f7af, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[11], 0x895cd7be, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[12], 0x6b901122, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[13], 0xfd987193, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[14], 0xa679438e, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+    MD5_STEP(MD5_G, a, b, c, d, x[1], 0xf61e2562, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[6], 0xc040b340, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[11], 0x265e5a51, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[0], 0xe9b6c7aa, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[5], 0xd62f105d, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[10], 0x02441453, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[4], 0xe7d3fbc8, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[9], 0x21e1cde6, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[14], 0xc33707d6, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[3], 0xf4d50d87, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[8], 0x455a14ed, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[13], 0xa9e3e905, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[2], 0xfcefa3f8, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[7], 0x676f02d9, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+    MD5_STEP(MD5_H, a, b, c, d, x[5], 0xfffa3942, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[8], 0x8771f681, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[14], 0xfde5380c, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[1], 0xa4beea44, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[4], 0x4bdecfa9, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[7], 0xf6bb4b60, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[13], 0x289b7ec6, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[0], 0xeaa127fa, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[3], 0xd4ef3085, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[6], 0x04881d05, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[9], 0xd9d4d039, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[2], 0xc4ac5665, 23);
+
+    MD5_STEP(MD5_I, a, b, c, d, x[0], 0xf4292244, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[7], 0x432aff97, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[14], 0xab9423a7, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[5], 0xfc93a039, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[12], 0x655b59c3, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[3], 0x8f0ccc92, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[10], 0xffeff47d, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[1], 0x85845dd1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[8], 0x6fa87e4f, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[6], 0xa3014314, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[4], 0xf7537e82, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[11], 0xbd3af235, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[2], 0x2ad7d2bb, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[9], 0xeb86d391, 21);
+
+    a += sa;
+    b += sb;
+    c += sc;
+    d += sd;
+  }
+  state[0] = a;
+  state[1] = b;
+  state[2] = c;
+  state[3] = d;
+}
+
+#undef MD5_F
+#undef MD5_G
+#undef MD5_H
+#undef MD5_I
+#undef MD5_STEP
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+void MD5Builder::begin() {
+  state_[0] = 0x67452301;
+  state_[1] = 0xefcdab89;
+  state_[2] = 0x98badcfe;
+  state_[3] = 0x10325476;
+  bytes_ = 0;
+  memset(hash_, 0, sizeof(hash_));
+}
+
+void MD5Builder::add(const uint8_t* data, size_t len) {
+  if (!data || len == 0) return;
+  const size_t used = static_cast<size_t>(bytes_ & 63);
+  bytes_ += len;
+  if (used > 0) {
+    const size_t take = std::min(len, sizeof(pending_) - used);
+    memcpy(pending_ + used, data, take);
+    data += take;
+    len -= take;
+    if (used + take < sizeof(pending_)) return;
+    transform(state_, pending_, 1);
+  }
+  // Whole blocks straight from the caller's buffer.
+  transform(state_, data, len / 64);
+  data += len / 64 * 64;
+  len &= 63;
+  if (len > 0) memcpy(pending_, data, len);
+}
+
+void MD5Builder::addHexString(const char* data) {
+  if (!data) return;
+  uint8_t buf[64];
+  size_t n = 0;
+  for (; data[0] && data[1]; data += 2) {
+    const int hi = hexValue(data[0]);
+    const int lo = hexValue(data[1]);
+    if (hi < 0 || lo < 0) break;
+    buf[n++] = static_cast<uint8_t>((hi << 4) | lo);
+    if (n == sizeof(buf)) {
+      add(buf, n);
+      n = 0;
+    }
+  }
+  add(buf, n);
+}
+
+bool MD5Builder::addStream(Stream& stream, const size_t maxLen) {
+  uint8_t buf[kStreamChunkBytes];
+  size_t left = maxLen ? maxLen : SIZE_MAX;
+  while (left > 0) {
+    const size_t n = stream.readBytes(buf, std::min(left, sizeof(buf)));
+    if (n == 0) break;
+    add(buf, n);
+    left -= n;
+  }
+  return maxLen == 0 || left == 0;
+}
+
+void MD5Builder::calculate() {
+  const uint64_t bits = bytes_ * 8;
+  static const uint8_t kPadding[64] = {0x80};
+  const size_t used = static_cast<size_t>(bytes_ & 63);
+  add(kPadding, used < 56 ? 56 - used : 120 - used);
+  uint8_t length[8];
+  for (int i = 0; i < 8; i++) length[i] = static_cast<uint8_t>(bits >> (i * 8));
+  add(length, sizeof(length));
+  for (int i = 0; i < 16; i++) hash_[i] = static_cast<uint8_t>(state_[i / 4] >> ((i % 4) * 8));
+}
+
+void MD5Builder::getChars(char* output) const {
+  static const char kHex[] = "0123456789abcdef";
+  for (int i = 0; i < 16; i++) {
+    output[i * 2] = kHex[hash_[i] >> 4];
+    output[i * 2 + 1] = kHex[hash_[i] & 15];
+  }
+  output[32] = '\0';
+}
+
+String MD5Builder::toString() const {
+  char out[33];
+  getChars(out);
+  return String(out);
+}
@@ -0,0 +1,574 @@
+// QR code encoder (ISO/IEC 18004, model 2, versions 1-10). Reed-Solomon uses
+// GF(256) log/antilog tables and generator polynomials built at compile time;
+// the matrix and the function-pattern map are bit-packed throughout, and the
+// mask is chosen by the standard penalty score.
+
+#include "qrcode.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr uint8_t kMaxVersion = 10;
+constexpr int kMaxSize = 17 + 4 * kMaxVersion;
+constexpr int kMaxMatrixBytes = (kMaxSize * kMaxSize + 7) / 8;
+constexpr int kMaxCodewords = 346;
+constexpr int kMaxEccCodewords = 30;
+constexpr int kMaxBlocks = 8;
+
+// --- GF(256), primitive polynomial x^8 + x^4 + x^3 + x^2 + 1 -------------
+
+struct GaloisTables {
+  uint8_t exp[512] = {};  // doubled so exp[log a + log b] needs no modulo
+  uint8_t log[256] = {};
+};
+
+constexpr GaloisTables makeGaloisTables() {
+  GaloisTables t;
+  int x = 1;
+  for (int i = 0; i < 255; i++) {
+    t.exp[i] = static_cast<uint8_t>(x);
+    t.exp[i + 255] = static_cast<uint8_t>(x);
+    t.log[x] = static_cast<uint8_t>(i);
+    x <<= 1;
+    if (x & 0x100) x ^= 0x11D;
+  }
+  t.exp[510] = t.exp[0];
+  t.exp[511] = t.exp[1];
+  return t;
+}
+
+constexpr GaloisTables kGf = makeGaloisTables();
+
+constexpr uint8_t gfMul(const uint8_t a, const uint8_t b) {
+  return (a == 0 || b == 0) ? 0 : kGf.exp[kGf.log[a] + kGf.log[b]];
+}
+
+// Generator polynomial for each ECC length, highest-degree coefficient (1)
+// omitted, stored as logs: every coefficient of these polynomials is nonzero.
+struct GeneratorTables {
+  uint8_t logCoeff[kMaxEccCodewords + 1][kMaxEccCodewords] = {};
+};
+
+constexpr GeneratorTables makeGeneratorTables() {
+  GeneratorTables t;
+  for (int degree = 1; degree <= kMaxEccCodewords; degree++) {
+    uint8_t poly[kMaxEccCodewords] = {};
+    poly[degree - 1] = 1;
+    uint8_t root = 1;
+    for (int i = 0; i < degree; i++) {
+      for (int j = 0; j < degree; j++) {
+        poly[j] = gfMul(poly[j], root);
+        if (j + 1 < degree) poly[j] ^= poly[j + 1];
+      }
+      root = gfMul(root, 0x02);
+    }
+    for (int j = 0; j < degree; j++) t.logCoeff[degree][j] = kGf.log[poly[j]];
+  }
+  return t;
+}
+
+constexpr GeneratorTables kGenerators = makeGeneratorTables();
+
+void reedSolomonRemainder(const uint8_t* data, const int length, const int degree, uint8_t* out) {
+  const uint8_t* gen = kGenerators.logCoeff[degree];
+  memset(out, 0, degree);
+  for (int i = 0; i < length; i++) {
+    const uint8_t factor = data[i] ^ out[0];
+    memmove(out, out + 1, degree - 1);
+    out[degree - 1] = 0;
+    if (factor == 0) continue;
+    const int logFactor = kGf.log[factor];
+    for (int j = 0; j < degree; j++) out[j] ^= kGf.exp[gen[j] + logFactor];
+  }
+}
+
+// --- Version tables ------------------------------------------------------
+
+// Per version and ECC level (L, M, Q, H): ECC codewords per block, then
+// [count, data codewords] for the short and long block groups.
+struct BlockLayout {
+  uint8_t eccPerBlock;
+  uint8_t shortBlocks;
+  uint8_t shortData;
+  uint8_t longBlocks;
+};
+
+constexpr BlockLayout kBlocks[kMaxVersion][4] = {
+    {{7, 1, 19, 0}, {10, 1, 16, 0}, {13, 1, 13, 0}, {17, 1, 9, 0}},
+    {{10, 1, 34, 0}, {16, 1, 28, 0}, {22, 1, 22, 0}, {28, 1, 16, 0}},
+    {{15, 1, 55, 0}, {26, 1, 44, 0}, {18, 2, 17, 0}, {22, 2, 13, 0}},
+    {{20, 1, 80, 0}, {18, 2, 32, 0}, {26, 2, 24, 0}, {16, 4, 9, 0}},
+    {{26, 1, 108, 0}, {24, 2, 43, 0}, {18, 2, 15, 2}, {22, 2, 11, 2}},
+    {{18, 2, 68, 0}, {16, 4, 27, 0}, {24, 4, 19, 0}, {28, 4, 15, 0}},
+    {{20, 2, 78, 0}, {18, 4, 31, 0}, {18, 2, 14, 4}, {26, 4, 13, 1}},
+    {{24, 2, 97, 0}, {22, 2, 38, 2}, {22, 4, 18, 2}, {26, 4, 14, 2}},
+    {{30, 2, 116, 0}, {22, 3, 36, 2}, {20, 4, 16, 4}, {24, 4, 12, 4}},
+    {{18, 2, 68, 2}, {26, 4, 43, 1}, {24, 6, 19, 2}, {28, 6, 15, 2}},
+};
+
+// Alignment pattern centre coordinates (versions 2-10 have at most three).
+constexpr uint8_t kAlignment[kMaxVersion][3] = {
+    {0, 0, 0},   {6, 18, 0},  {6, 22, 0},  {6, 26, 0},  {6, 30, 0},
+    {6, 34, 0},  {6, 22, 38}, {6, 24, 42}, {6, 26, 46}, {6, 28, 50},
+};
+
+// Format-information ECC level bits, indexed by ECC_LOW..ECC_HIGH.
+constexpr uint8_t kEccFormatBits[4] = {1, 0, 3, 2};
+
+const char kAlphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+int dataCodewords(const BlockLayout& b) {
+  return b.shortBlocks * b.shortData + b.longBlocks * (b.shortData + 1);
+}
+
+// --- Bit buffers ---------------------------------------------------------
+
+class BitWriter {
+ public:
+  BitWriter(uint8_t* buf, const int capacityBits) : buf_(buf), capacity_(capacityBits) {}
+
+  bool put(const uint32_t value, const int bits) {
+    if (length_ + bits > capacity_) return false;
+    for (int i = bits - 1; i >= 0; i--, length_++) {
+      if ((value >> i) & 1) buf_[length_ >> 3] |= static_cast<uint8_t>(0x80 >> (length_ & 7));
+    }
+    return true;
+  }
+  int length() const { return length_; }
+
+ private:
+  uint8_t* buf_;
+  int capacity_;
+  int length_ = 0;
+};
+
+struct Matrix {
+  int size;
+  uint8_t bits[kMaxMatrixBytes];
+
+  bool get(const int x, const int y) const {
+    const int i = y * size + x;
+    return (bits[i >> 3] >> (7 - (i & 7))) & 1;
+  }
+  void set(const int x, const int y, const bool on) {
+    const int i = y * size + x;
+    const uint8_t m = static_cast<uint8_t>(0x80 >> (i & 7));
+    if (on) {
+      bits[i >> 3] |= m;
+    } else {
+      bits[i >> 3] &= static_cast<uint8_t>(~m);
+    }
+  }
+};
+
+// --- Function patterns ---------------------------------------------------
+
+struct Builder {
+  Matrix modules;
+  Matrix isFunction;
+
+  void setFunction(const int x, const int y, const bool dark) {
+    modules.set(x, y, dark);
+    isFunction.set(x, y, true);
+  }
+
+  void drawFinder(const int cx, const int cy) {
+    const int size = modules.size;
+    for (int dy = -4; dy <= 4; dy++) {
+      for (int dx = -4; dx <= 4; dx++) {
+        const int x = cx + dx, y = cy + dy;
+        if (x < 0 || y < 0 || x >= size || y >= size) continue;
+        const int dist = std::max(std::abs(dx), std::abs(dy));
+        setFunction(x, y, dist != 2 && dist != 4);
+      }
+    }
+  }
+
+  void drawAlignment(const int cx, const int cy) {
+    for (int dy = -2; dy <= 2; dy++) {
+      for (int dx = -2; dx <= 2; dx++) setFunction(cx + dx, cy + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
+    }
+  }
+
+  void drawFormat(const uint8_t eccLevel, const uint8_t mask) {
+    const int data = (kEccFormatBits[eccLevel] << 3) | mask;
+    int rem = data;
+    for (int i = 0; i < 10; i++) rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+    const int bits = ((data << 10) | rem) ^ 0x5412;
+    const int size = modules.size;
+    auto bit = [bits](const int i) { return ((bits >> i) & 1) != 0; };
+
+    for (int i = 0; i <= 5; i++) setFunction(8, i, bit(i));
+    setFunction(8, 7, bit(6));
+    setFunction(8, 8, bit(7));
+    setFunction(7, 8, bit(8));
+    for (int i = 9; i < 15; i++) setFunction(14 - i, 8, bit(i));
+
+    for (int i = 0; i < 8; i++) setFunction(size - 1 - i, 8, bit(i));
+    for (int i = 8; i < 15; i++) setFunction(8, size - 15 + i, bit(i));
+    setFunction(8, size - 8, true);  // dark module
+  }
+
+  void drawVersion(const uint8_t version) {
+    if (version < 7) return;
+    int rem = version;
+    for (int i = 0; i < 12; i++) rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+    const long bits = (static_cast<long>(version) << 12) | rem;
+    const int size = modules.size;
+    for (int i = 0; i < 18; i++) {
+      const bool dark = ((bits >> i) & 1) != 0;
+      const int a = size - 11 + i % 3, b = i / 3;
+      setFunction(a, b, dark);
+      setFunction(b, a, dark);
+    }
+  }
+
+  void drawFunctionPatterns(const uint8_t version) {
+    const int size = modules.size;
+    for (int i = 0; i < size; i++) {
+      setFunction(6, i, i % 2 == 0);
+      setFunction(i, 6, i % 2 == 0);
+    }
+    drawFinder(3, 3);
+    drawFinder(size - 4, 3);
+    drawFinder(3, size - 4);
+
+    const uint8_t* centres = kAlignment[version - 1];
+    const int count = version == 1 ? 0 : (centres[2] ? 3 : 2);
+    for (int i = 0; i < count; i++) {
+      for (int j = 0; j < count; j++) {
+        // Skip the three corners occupied by finder patterns.
+        if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) continue;
+        drawAlignment(centres[i], centres[j]);
+      }
+    }
+    // Reserve the format area with a dummy value; the real one is drawn per mask.
+    drawFormat(ECC_LOW, 0);
+    drawVersion(version);
+  }
+
+  void drawCodewords(const uint8_t* data, const int length) {
+    const int size = modules.size;
+    const int totalBits = length * 8;
+    int i = 0;
+    for (int right = size - 1; right >= 1; right -= 2) {
+      if (right == 6) right = 5;
+      const bool upward = ((right + 1) & 2) == 0;
+      for (int vert = 0; vert < size; vert++) {
+        const int y = upward ? size - 1 - vert : vert;
+        for (int j = 0; j < 2; j++) {
+          const int x = right - j;
+          if (isFunction.get(x, y)) continue;
+          // Remainder bits past the last codeword stay light.
+          modules.set(x, y, i < totalBits && ((data[i >> 3] >> (7 - (i & 7))) & 1));
+          i++;
+        }
+      }
+    }
+  }
+
+  void applyMask(const uint8_t mask) {
+    const int size = modules.size;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        bool invert;
+        switch (mask) {
+          case 0: invert = (x + y) % 2 == 0; break;
+          case 1: invert = y % 2 == 0; break;
+          case 2: invert = x % 3 == 0; break;
+          case 3: invert = (x + y) % 3 == 0; break;
+          case 4: invert = (x / 3 + y / 2) % 2 == 0; break;
+          case 5: invert = x * y % 2 + x * y % 3 == 0; break;
+          case 6: invert = (x * y % 2 + x * y % 3) % 2 == 0; break;
+          default: invert = ((x + y) % 2 + x * y % 3) % 2 == 0; break;
+        }
+        if (invert && !isFunction.get(x, y)) modules.set(x, y, !modules.get(x, y));
+      }
+    }
+  }
+
+  long penalty() const {
+    const int size = modules.size;
+    long score = 0;
+    // Rules 1 and 3 over rows (pass 0) and columns (pass 1).
+    for (int pass = 0; pass < 2; pass++) {
+      for (int a = 0; a < size; a++) {
+        auto at = [&](const int b) { return pass == 0 ? modules.get(b, a) : modules.get(a, b); };
+        int run = 1;
+        uint16_t window = at(0);
+        for (int b = 1; b < size; b++) {
+          const bool dark = at(b);
+          if (dark == at(b - 1)) {
+            run++;
+            if (run == 5) {
+              score += 3;
+            } else if (run > 5) {
+              score++;
+            }
+          } else {
+            run = 1;
+          }
+          // Finder-like 1011101 with four light modules on either side.
+          window = static_cast<uint16_t>(((window << 1) | dark) & 0x7FF);
+          if (b >= 10 && (window == 0x05D || window == 0x5D0)) score += 40;
+        }
+      }
+    }
+    // Rule 2: 2x2 blocks of one colour.
+    for (int y = 0; y + 1 < size; y++) {
+      for (int x = 0; x + 1 < size; x++) {
+        const bool c = modules.get(x, y);
+        if (c == modules.get(x + 1, y) && c == modules.get(x, y + 1) && c == modules.get(x + 1, y + 1)) score += 3;
+      }
+    }
+    // Rule 4: dark/light balance.
+    long dark = 0;
+    const long total = static_cast<long>(size) * size;
+    for (int i = 0; i < total; i++) dark += (modules.bits[i >> 3] >> (7 - (i & 7))) & 1;
+    const long k = (std::labs(dark * 20 - total * 10) + total - 1) / total - 1;
+    return score + k * 10;
+  }
+};
+
+// --- Data encoding -------------------------------------------------------
+
+uint8_t chooseMode(const uint8_t* data, const uint16_t length) {
+  bool numeric = true, alphanumeric = true;
+  for (uint16_t i = 0; i < length; i++) {
+    const char c = static_cast<char>(data[i]);
+    if (c < '0' || c > '9') numeric = false;
+    if (c == '\0' || !strchr(kAlphanumeric, c)) alphanumeric = false;
+  }
+  if (numeric) return MODE_NUMERIC;
+  return alphanumeric ? MODE_ALPHANUMERIC : MODE_BYTE;
+}
+
+bool encodeSegment(BitWriter& out, const uint8_t mode, const uint8_t version, const uint8_t* data,
+                   const uint16_t length) {
+  // Character-count field widths for versions 1-9 and 10-26.
+  const bool wide = version >= 10;
+  switch (mode) {
+    case MODE_NUMERIC: {
+      if (!out.put(0x1, 4) || !out.put(length, wide ? 12 : 10)) return false;
+      for (uint16_t i = 0; i < length; i += 3) {
+        const int n = std::min<int>(3, length - i);
+        uint32_t value = 0;
+        for (int j = 0; j < n; j++) value = value * 10 + (data[i + j] - '0');
+        if (!out.put(value, n * 3 + 1)) return false;
+      }
+      return true;
+    }
+    case MODE_ALPHANUMERIC: {
+      if (!out.put(0x2, 4) || !out.put(length, wide ? 11 : 9)) return false;
+      auto index = [](const uint8_t c) { return static_cast<uint32_t>(strchr(kAlphanumeric, c) - kAlphanumeric); };
+      uint16_t i = 0;
+      for (; i + 1 < length; i += 2) {
+        if (!out.put(index(data[i]) * 45 + index(data[i + 1]), 11)) return false;
+      }
+      return i == length || out.put(index(data[i]), 6);
+    }
+    default: {
+      if (!out.put(0x4, 4) || !out.put(length, wide ? 16 : 8)) return false;
+      for (uint16_t i = 0; i < length; i++) {
+        if (!out.put(data[i], 8)) return false;
+      }
+      return true;
+    }
+  }
+}
+
+// Splits the data codewords into blocks, appends each block's ECC and
+// interleaves the lot in transmission order.
+void interleave(const uint8_t* data, const BlockLayout& layout, uint8_t* out) {
+  const int blocks = layout.shortBlocks + layout.longBlocks;
+  const int ecc = layout.eccPerBlock;
+  uint8_t eccBytes[kMaxBlocks][kMaxEccCodewords];
+  const uint8_t* blockData[kMaxBlocks];
+  int blockLength[kMaxBlocks];
+  for (int b = 0, offset = 0; b < blocks; b++) {
+    blockData[b] = data + offset;
+    blockLength[b] = layout.shortData + (b >= layout.shortBlocks ? 1 : 0);
+    reedSolomonRemainder(blockData[b], blockLength[b], ecc, eccBytes[b]);
+    offset += blockLength[b];
+  }
+  int n = 0;
+  for (int i = 0; i <= layout.shortData; i++) {
+    for (int b = 0; b < blocks; b++) {
+      if (i < blockLength[b]) out[n++] = blockData[b][i];
+    }
+  }
+  for (int i = 0; i < ecc; i++) {
+    for (int b = 0; b < blocks; b++) out[n++] = eccBytes[b][i];
+  }
+}
+
+}  // namespace
+
+uint16_t qrcode_getBufferSize(const uint8_t version) {
+  const int size = 17 + 4 * version;
+  return static_cast<uint16_t>((size * size + 7) / 8);
+}
+
+int8_t qrcode_initBytes(QRCode* qrcode, uint8_t* modules, const uint8_t version, const uint8_t ecc,
+                        const uint8_t* data, const uint16_t length) {
+  if (!qrcode || !modules || version < 1 || version > kMaxVersion || ecc > ECC_HIGH) return -1;
+  if (!data && length > 0) return -1;
+
+  const BlockLayout& layout = kBlocks[version - 1][ecc];
+  const int capacity = dataCodewords(layout);
+  const uint8_t mode = chooseMode(data, length);
+
+  uint8_t codewords[kMaxCodewords] = {};
+  BitWriter bits(codewords, capacity * 8);
+  if (!encodeSegment(bits, mode, version, data, length)) return -1;
+  // Terminator (up to four zero bits) and byte alignment are already zero in
+  // the buffer; fill the remaining codewords with the standard pad bytes.
+  int used = (std::min(bits.length() + 4, capacity * 8) + 7) / 8;
+  for (uint8_t pad = 0xEC; used < capacity; pad ^= 0xEC ^ 0x11) codewords[used++] = pad;
+
+  uint8_t stream[kMaxCodewords];
+  interleave(codewords, layout, stream);
+  const int total = capacity + (layout.shortBlocks + layout.longBlocks) * layout.eccPerBlock;
+
+  Builder builder;
+  const int size = 17 + 4 * version;
+  builder.modules.size = builder.isFunction.size = size;
+  memset(builder.modules.bits, 0, sizeof(builder.modules.bits));
+  memset(builder.isFunction.bits, 0, sizeof(builder.isFunction.bits));
+  builder.drawFunctionPatterns(version);
+  builder.drawCodewords(stream, total);
+
+  uint8_t best = 0;
+  long bestPenalty = -1;
+  for (uint8_t mask = 0; mask < 8; mask++) {
+    builder.applyMask(mask);
+    builder.drawFormat(ecc, mask);
+    const long p = builder.penalty();
+    if (bestPenalty < 0 || p < bestPenalty) {
+      best = mask;
+      bestPenalty = p;
+    }
+    builder.applyMask(mask);  // XOR again to undo
+  }
+  builder.applyMask(best);
+  builder.drawFormat(ecc, best);
+
+  memcpy(modules, builder.modules.bits, qrcode_getBufferSize(version));
+  qrcode->version = version;
+  qrcode->size = static_cast<uint8_t>(size);
+  qrcode->ecc = ecc;
+  qrcode->mode = mode;
+  qrcode->mask = best;
+  qrcode->modules = modules;
+  return 0;
+}
+
+int8_t qrcode_initText(QRCode* qrcode, uint8_t* modules, const uint8_t version, const uint8_t ecc, const char* data) {
+  const size_t length = data ? strlen(data) : 0;
+  if (length > 0xFFFF) return -1;
+  return qrcode_initBytes(qrcode, modules, version, ecc, reinterpret_cast<const uint8_t*>(data),
+                          static_cast<uint16_t>(length));
+}
+
+bool qrcode_getModule(const QRCode* qrcode, const uint8_t x, const uint8_t y) {
+  if (!qrcode || !qrcode->modules || x >= qrcode->size || y >= qrcode->size) return false;
+  const int i = y * qrcode->size + x;
+  return (qrcode->modules[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+uint8_t qrcode_getRowSpans(const QRCode* qrcode, const uint8_t y, uint8_t* starts, uint8_t* ends,
+                           const uint8_t maxSpans) {
+  if (!qrcode || !qrcode->modules || y >= qrcode->size) return 0;
+  const int size = qrcode->size;
+  const uint8_t* row = qrcode->modules;
+  const int base = y * size;
+  uint8_t count = 0;
+  int x = 0;
+  while (x < size && count < maxSpans) {
+    // Skip light modules a whole byte at a time where possible.
+    int i = base + x;
+    while (x < size && !((row[i >> 3] >> (7 - (i & 7))) & 1)) {
+      if ((i & 7) == 0 && row[i >> 3] == 0x00 && x + 8 <= size) {
+        x += 8;
+        i += 8;
+      } else {
+        x++;
+        i++;
+      }
+    }
+    if (x >= size) break;
+    const int start = x;
+    while (x < size && ((row[i >> 3] >> (7 - (i & 7))) & 1)) {
+      if ((i & 7) == 0 && row[i >> 3] == 0xFF && x + 8 <= size) {
+        x += 8;
+        i += 8;
+      } else {
+        x++;
+        i++;
+      }
+    }
+    starts[count] = static_cast<uint8_t>(start);
+    ends[count] = static_cast<uint8_t>(x);
+    count++;
+  }
+  return count;
+}
+
+namespace {
+
+// Sets (white) or clears (black) pixels [x0, x1) of one framebuffer row.
+void fillRow(uint8_t* row, int x0, const int x1, const bool white) {
+  if (x0 >= x1) return;
+  const int firstByte = x0 >> 3, lastByte = (x1 - 1) >> 3;
+  const uint8_t head = static_cast<uint8_t>(0xFF >> (x0 & 7));
+  const uint8_t tail = static_cast<uint8_t>(0xFF << (7 - ((x1 - 1) & 7)));
+  if (firstByte == lastByte) {
+    const uint8_t m = head & tail;
+    row[firstByte] = white ? (row[firstByte] | m) : (row[firstByte] & ~m);
+    return;
+  }
+  row[firstByte] = white ? (row[firstByte] | head) : (row[firstByte] & ~head);
+  if (lastByte - firstByte > 1) memset(row + firstByte + 1, white ? 0xFF : 0x00, lastByte - firstByte - 1);
+  row[lastByte] = white ? (row[lastByte] | tail) : (row[lastByte] & ~tail);
+}
+
+}  // namespace
+
+void qrcode_drawToBuffer(const QRCode* qrcode, uint8_t* buffer, const uint16_t widthBytes, const uint16_t height,
+                         const int x, const int y, const uint8_t scale) {
+  if (!qrcode || !qrcode->modules || !buffer || scale == 0) return;
+  const int size = qrcode->size;
+  const int width = widthBytes * 8;
+  const int left = std::max(x, 0), right = std::min(x + size * scale, width);
+  if (left >= right) return;
+
+  uint8_t starts[kMaxSize / 2 + 1], ends[kMaxSize / 2 + 1];
+  for (int my = 0; my < size; my++) {
+    const int top = std::max(y + my * scale, 0), bottom = std::min(y + (my + 1) * scale, static_cast<int>(height));
+    if (top >= bottom) continue;
+    const uint8_t spans = qrcode_getRowSpans(qrcode, static_cast<uint8_t>(my), starts, ends, sizeof(starts));
+    // Build the first pixel row, then copy it for the rest of the module row.
+    uint8_t* first = buffer + static_cast<size_t>(top) * widthBytes;
+    fillRow(first, left, right, true);
+    for (uint8_t s = 0; s < spans; s++) {
+      fillRow(first, std::max(x + starts[s] * scale, left), std::min(x + ends[s] * scale, right), false);
+    }
+    const int firstByte = left >> 3, lastByte = (right - 1) >> 3;
+    const uint8_t head = static_cast<uint8_t>(0xFF >> (left & 7));
+    const uint8_t tail = static_cast<uint8_t>(0xFF << (7 - ((right - 1) & 7)));
+    for (int py = top + 1; py < bottom; py++) {
+      uint8_t* row = buffer + static_cast<size_t>(py) * widthBytes;
+      if (firstByte == lastByte) {
+        const uint8_t m = head & tail;
+        row[firstByte] = static_cast<uint8_t>((row[firstByte] & ~m) | (first[firstByte] & m));
+        continue;
+      }
+      row[firstByte] = static_cast<uint8_t>((row[firstByte] & ~head) | (first[firstByte] & head));
+      memcpy(row + firstByte + 1, first + firstByte + 1, lastByte - firstByte - 1);
+      row[lastByte] = static_cast<uint8_t>((row[lastByte] & ~tail) | (first[lastByte] & tail));
+    }
+  }
+}
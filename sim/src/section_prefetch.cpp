@@ -0,0 +1,145 @@
+/**
+ * SectionPrefetcher — background section builds for the reader (see
+ * SectionPrefetch.h).
+ */
+
+#include "SectionPrefetch.h"
+
+#include <HardwareSerial.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "sim_profile.h"
+
+SectionPrefetcher SectionPrefetcher::instance;
+
+namespace {
+constexpr unsigned kStackBytes = 12 * 1024;  // expat and page layout of one section
+constexpr UBaseType_t kPriority = 1;         // loopTask's: see SectionPrefetch.h
+constexpr size_t kMaxResults = 4;            // results kept for waitFor()
+}  // namespace
+
+void SectionPrefetcher::taskEntry(void* self) { static_cast<SectionPrefetcher*>(self)->run(); }
+
+void SectionPrefetcher::start() {
+  if (task_) return;
+  lock_ = xSemaphoreCreateMutex();
+  wake_ = xSemaphoreCreateBinary();
+  done_ = xSemaphoreCreateBinary();
+  xTaskCreate(&SectionPrefetcher::taskEntry, "SectionPrefetch", kStackBytes, this, kPriority, &task_);
+}
+
+void SectionPrefetcher::run() {
+  for (;;) {
+    xSemaphoreTake(wake_, portMAX_DELAY);
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    if (!queued_.job) {
+      xSemaphoreGive(lock_);
+      continue;
+    }
+    running_ = std::move(queued_);
+    queued_ = Slot();
+    busy_ = true;
+    cancelled_ = false;
+    xSemaphoreGive(lock_);
+
+    const unsigned long start = millis();
+    bool ok;
+    {
+      SIM_PROFILE_SCOPE("SectionPrefetch job");
+      ok = running_.job() && !cancelled_;
+    }
+    if (ok) {
+      Serial.printf("[%lu] [PREFETCH] Section %d built after %lu ms\n", millis(), running_.spineIndex,
+                    millis() - start);
+    } else {
+      Serial.printf("[%lu] [PREFETCH] Section %d not built (%s)\n", millis(), running_.spineIndex,
+                    cancelled_ ? "cancelled" : "failed");
+    }
+
+    // The job may hold the book and files open; let it go before anyone is woken
+    Job finished = std::move(running_.job);
+    finished = nullptr;
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    const Result result{running_.bookKey, running_.spineIndex, ok};
+    const auto same = [&](const Result& r) { return r.bookKey == result.bookKey && r.spineIndex == result.spineIndex; };
+    results_.erase(std::remove_if(results_.begin(), results_.end(), same), results_.end());
+    if (results_.size() == kMaxResults) results_.erase(results_.begin());
+    results_.push_back(result);
+    busy_ = false;
+    xSemaphoreGive(lock_);
+    xSemaphoreGive(done_);
+  }
+}
+
+bool SectionPrefetcher::isRunning(uint64_t bookKey, int spineIndex) const {
+  return busy_ && running_.bookKey == bookKey && running_.spineIndex == spineIndex;
+}
+
+void SectionPrefetcher::waitForJob() {
+  xSemaphoreGive(lock_);
+  xSemaphoreTake(done_, portMAX_DELAY);
+  xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void SectionPrefetcher::schedule(uint64_t bookKey, int spineIndex, Job job) {
+  start();
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  if (isRunning(bookKey, spineIndex)) {
+    xSemaphoreGive(lock_);  // already being built
+    return;
+  }
+  if (busy_) cancelled_ = true;
+  queued_.bookKey = bookKey;
+  queued_.spineIndex = spineIndex;
+  queued_.job = std::move(job);
+  xSemaphoreGive(lock_);
+  xSemaphoreGive(wake_);
+}
+
+bool SectionPrefetcher::waitFor(uint64_t bookKey, int spineIndex) {
+  if (!task_) return false;
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  if (queued_.job && queued_.bookKey == bookKey && queued_.spineIndex == spineIndex) queued_ = Slot();
+  if (isRunning(bookKey, spineIndex)) {
+    const unsigned long start = millis();
+    while (isRunning(bookKey, spineIndex)) waitForJob();
+    Serial.printf("[%lu] [PREFETCH] Waited %lu ms for section %d\n", millis(), millis() - start, spineIndex);
+  }
+  bool ok = false;
+  const auto it = std::find_if(results_.begin(), results_.end(), [&](const Result& r) {
+    return r.bookKey == bookKey && r.spineIndex == spineIndex;
+  });
+  if (it != results_.end()) {
+    ok = it->ok;
+    results_.erase(it);
+  }
+  xSemaphoreGive(lock_);
+  return ok;
+}
+
+void SectionPrefetcher::cancel() {
+  if (!task_) return;
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  queued_ = Slot();
+  if (busy_) cancelled_ = true;
+  while (busy_) waitForJob();
+  results_.clear();
+  xSemaphoreGive(lock_);
+}
+
+bool SectionPrefetcher::busy() {
+  if (!task_) return false;
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  const bool pending = busy_ || queued_.job;
+  xSemaphoreGive(lock_);
+  return pending;
+}
+
+bool SectionPrefetcher::checkpoint() {
+  taskYIELD();
+  return !instance.cancelled_;
+}
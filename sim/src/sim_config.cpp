@@ -0,0 +1,34 @@
+// Emulator runtime settings from the environment (SIM_CORES, SIM_LOG, ...).
+
+#include "sim_config.h"
+
+#include <cstdlib>
+#include <cstring>
+
+int sim_config_int(const char* name, int defaultValue) {
+  const char* v = getenv(name);
+  if (!v || !*v) return defaultValue;
+  char* end = nullptr;
+  const long n = strtol(v, &end, 0);
+  return (end && *end == '\0') ? static_cast<int>(n) : defaultValue;
+}
+
+double sim_config_double(const char* name, double defaultValue) {
+  const char* v = getenv(name);
+  if (!v || !*v) return defaultValue;
+  char* end = nullptr;
+  const double d = strtod(v, &end);
+  return (end && *end == '\0') ? d : defaultValue;
+}
+
+const char* sim_config_str(const char* name, const char* defaultValue) {
+  const char* v = getenv(name);
+  return (v && *v) ? v : defaultValue;
+}
+
+bool sim_config_flag(const char* name, bool defaultValue) {
+  const char* v = getenv(name);
+  if (!v || !*v) return defaultValue;
+  return strcmp(v, "0") != 0 && strcmp(v, "off") != 0 && strcmp(v, "false") != 0 &&
+         strcmp(v, "no") != 0;
+}
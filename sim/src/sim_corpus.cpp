@@ -0,0 +1,322 @@
+// Corpus runs: load and paginate every EPUB under a directory (see sim_corpus.h).
+
+#include "sim_corpus.h"
+#include "ArduinoStub.h"
+#include "HardwareSerial.h"
+#include "sim_config.h"
+#include "sim_heap.h"
+#include "sim_log.h"
+#include "sim_profile.h"
+
+#include <Epub.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+long maxRssKb(const struct rusage& ru) {
+#if defined(__APPLE__)
+  return ru.ru_maxrss / 1024;  // bytes on macOS
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+bool endsWithEpub(const std::string& name) {
+  if (name.size() < 5) return false;
+  std::string ext = name.substr(name.size() - 5);
+  for (char& c : ext) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  return ext == ".epub";
+}
+
+// EPUBs under root + "/" + rel, as paths relative to root; dot entries
+// (.crosspoint caches, hidden files) are skipped.
+void collectBooks(const std::string& root, const std::string& rel, std::vector<std::string>& out) {
+  DIR* d = opendir((root + rel).c_str());
+  if (!d) return;
+  for (dirent* e; (e = readdir(d)) != nullptr;) {
+    if (e->d_name[0] == '.') continue;
+    const std::string path = rel + "/" + e->d_name;
+    struct stat st;
+    if (stat((root + path).c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      collectBooks(root, path, out);
+    } else if (endsWithEpub(path)) {
+      out.push_back(path);
+    }
+  }
+  closedir(d);
+}
+
+void removeTree(const std::string& path) {
+  nftw(
+      path.c_str(), [](const char* p, const struct stat*, int, struct FTW*) { return remove(p); }, 16,
+      FTW_DEPTH | FTW_PHYS);
+}
+
+std::string csvField(const std::string& s) {
+  if (s.find_first_of(",\"\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c == '\n' ? ' ' : c;
+  }
+  return out + "\"";
+}
+
+// One book's process, until it is reaped
+struct Job {
+  size_t book;
+  int slot;
+  int resultFd;
+  Clock::time_point start;
+};
+
+// The child's report: sections, pages, paginated, load ms, total ms, book peak KB, failure
+struct Report {
+  bool present = false;
+  int sections = 0;
+  int pages = 0;
+  int paginated = 1;
+  double loadMs = 0;
+  double totalMs = 0;
+  long bookPeakKb = -1;  // -1: heap not tracked
+  std::string failure;
+};
+
+Report readReport(int fd) {
+  std::string text;
+  char buf[512];
+  for (ssize_t n; (n = read(fd, buf, sizeof(buf))) != 0;) {
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) break;
+    text.append(buf, static_cast<size_t>(n));
+  }
+  Report r;
+  int failureAt = -1;
+  r.present = sscanf(text.c_str(), "%d\t%d\t%d\t%lf\t%lf\t%ld\t%n", &r.sections, &r.pages, &r.paginated,
+                     &r.loadMs, &r.totalMs, &r.bookPeakKb, &failureAt) == 6 &&
+              failureAt >= 0;
+  if (r.present) {
+    r.failure = text.substr(static_cast<size_t>(failureAt));
+    while (!r.failure.empty() && r.failure.back() == '\n') r.failure.pop_back();
+  }
+  return r;
+}
+}  // namespace
+
+// Emulator default when the firmware does not paginate: load only.
+__attribute__((weak)) bool sim_corpus_paginate(const std::string& path, SimCorpusBook& book) {
+  Serial.printf("[%lu] [CORPUS] sim_corpus_paginate() not defined by the firmware: loading only\n", millis());
+  book.paginated = false;
+  Epub epub(path, "/.crosspoint");
+  const auto start = Clock::now();
+  const bool loaded = epub.load(true, true);
+  book.loadMs = msSince(start);
+  if (!loaded) {
+    book.failure = "Epub::load failed";
+    return false;
+  }
+  book.sections = epub.getSpineItemsCount();
+  return true;
+}
+
+void sim_corpus_run(const char* dir) {
+  char root[PATH_MAX];
+  if (!realpath(dir, root)) {
+    fprintf(stderr, "Corpus: %s: %s\n", dir, strerror(errno));
+    std::_Exit(2);
+  }
+  std::vector<std::string> books;
+  collectBooks(root, "", books);
+  std::sort(books.begin(), books.end());
+  if (books.empty()) {
+    fprintf(stderr, "Corpus: no EPUBs under %s\n", root);
+    std::_Exit(1);
+  }
+
+  const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+  const int jobs = std::max(1, sim_config_int("SIM_CORPUS_JOBS", static_cast<int>(cpus)));
+  const int timeoutS = std::max(1, sim_config_int("SIM_CORPUS_TIMEOUT", 600));
+  const std::string workDir = sim_config_str("SIM_CORPUS_DIR", "corpus");
+  mkdir(workDir.c_str(), 0755);
+  fprintf(stderr, "Corpus: %zu books under %s, %d at once\n", books.size(), root, jobs);
+  printf("book,status,sections,pages,load_ms,total_ms,pages_per_s,book_peak_kb,peak_rss_kb,failure\n");
+  fflush(stdout);
+
+  std::map<pid_t, Job> running;
+  std::vector<bool> slotBusy(static_cast<size_t>(jobs), false);
+  size_t next = 0;
+  int passed = 0;
+  int loadOnly = 0;
+  bool loadOnlyStub = false;  // a book reported through the weak sim_corpus_paginate()
+  long pages = 0;
+  const auto runStart = Clock::now();
+
+  while (next < books.size() || !running.empty()) {
+    while (static_cast<int>(running.size()) < jobs && next < books.size()) {
+      const int slot = static_cast<int>(std::find(slotBusy.begin(), slotBusy.end(), false) - slotBusy.begin());
+      const std::string slotDir = workDir + "/" + std::to_string(slot);
+      removeTree(slotDir);
+      mkdir(slotDir.c_str(), 0755);
+      int fds[2];
+      if (pipe(fds) != 0) {
+        fprintf(stderr, "Corpus: pipe failed: %s\n", strerror(errno));
+        std::_Exit(2);
+      }
+      fflush(stdout);
+      fflush(stderr);
+      const pid_t pid = fork();
+      if (pid < 0) {
+        fprintf(stderr, "Corpus: fork failed: %s\n", strerror(errno));
+        std::_Exit(2);
+      }
+      if (pid == 0) {
+        close(fds[0]);
+        setenv("SIM_SDCARD", root, 1);
+        setenv("SIM_OVERLAY", (slotDir + "/overlay").c_str(), 1);
+        setenv("SDL_VIDEODRIVER", "dummy", 0);
+        setenv("SIM_CORPUS_BOOK", books[next].c_str(), 1);
+        setenv("SIM_CORPUS_FD", std::to_string(fds[1]).c_str(), 1);
+        for (const char* var : {"SIM_INSTANCES", "SIM_INPUT_SCRIPT", "SIM_SNAPSHOT_RESUME"}) unsetenv(var);
+        if (freopen((slotDir + "/serial.log").c_str(), "w", stdout)) dup2(fileno(stdout), STDERR_FILENO);
+        alarm(static_cast<unsigned>(timeoutS));
+        return;
+      }
+      close(fds[1]);
+      slotBusy[static_cast<size_t>(slot)] = true;
+      running[pid] = {next++, slot, fds[0], Clock::now()};
+    }
+
+    int status = 0;
+    struct rusage ru {};
+    const pid_t pid = wait4(-1, &status, 0, &ru);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    const auto it = running.find(pid);
+    if (it == running.end()) continue;
+    const Job job = it->second;
+    running.erase(it);
+    slotBusy[static_cast<size_t>(job.slot)] = false;
+    Report report = readReport(job.resultFd);
+    close(job.resultFd);
+
+    std::string failure = report.failure;
+    if (WIFSIGNALED(status)) {
+      failure = WTERMSIG(status) == SIGALRM ? "timeout after " + std::to_string(timeoutS) + " s"
+                                            : "crashed: " + std::string(strsignal(WTERMSIG(status)));
+    } else if (!report.present) {
+      failure = "exited with " + std::to_string(WEXITSTATUS(status)) + " before reporting";
+    }
+    const bool ok = failure.empty();
+    const bool paginated = report.paginated != 0;  // a load-only book has no page count
+    const double totalMs = report.present ? report.totalMs : msSince(job.start);
+    if (ok && paginated) {
+      passed++;
+      pages += report.pages;
+    } else if (ok) {
+      loadOnly++;
+    }
+    if (!paginated) loadOnlyStub = true;
+    const std::string slotDir = workDir + "/" + std::to_string(job.slot);
+    if (!ok) {
+      std::string logName = books[job.book].substr(1);
+      std::replace(logName.begin(), logName.end(), '/', '_');
+      rename((slotDir + "/serial.log").c_str(), (workDir + "/" + logName + ".log").c_str());
+    }
+    removeTree(slotDir);
+
+    // pages and pages_per_s stay empty for a book that was not paginated,
+    // book_peak_kb where the heap was not tracked
+    char pagesField[16] = "";
+    char rateField[32] = "";
+    char heapField[24] = "";
+    if (paginated) {
+      snprintf(pagesField, sizeof(pagesField), "%d", report.pages);
+      snprintf(rateField, sizeof(rateField), "%.1f", totalMs > 0 ? report.pages * 1000.0 / totalMs : 0.0);
+    }
+    if (report.bookPeakKb >= 0) snprintf(heapField, sizeof(heapField), "%ld", report.bookPeakKb);
+    printf("%s,%s,%d,%s,%.1f,%.1f,%s,%s,%ld,%s\n", csvField(books[job.book].substr(1)).c_str(),
+           !ok ? "failed" : paginated ? "ok" : "load-only", report.sections, pagesField, report.loadMs, totalMs,
+           rateField, heapField, maxRssKb(ru), csvField(failure).c_str());
+    fflush(stdout);
+  }
+
+  const double seconds = msSince(runStart) / 1000.0;
+  const int failed = static_cast<int>(books.size()) - passed - loadOnly;
+  fprintf(stderr, "Corpus: %d of %zu books ok, %d load-only, %d failed; %ld pages in %.1f s = %.1f pages/s\n",
+          passed, books.size(), loadOnly, failed, pages, seconds, seconds > 0 ? pages / seconds : 0.0);
+  if (loadOnlyStub) {
+    fprintf(stderr,
+            "Corpus: WARNING: the firmware does not define sim_corpus_paginate(), so books were only loaded; "
+            "pages and pages/s are not measured\n");
+  }
+  if (failed > 0) fprintf(stderr, "Corpus: serial logs of the failed books are in %s/\n", workDir.c_str());
+  std::_Exit(failed == 0 ? 0 : 1);  // the firmware never ran here: skip its static destructors
+}
+
+void sim_corpus_book() {
+  const char* path = getenv("SIM_CORPUS_BOOK");
+  const char* fd = getenv("SIM_CORPUS_FD");
+  if (!path || !fd) return;
+
+  const bool heapTracked = sim_heap_track_begin();
+  SimCorpusBook book;
+  const auto start = Clock::now();
+  bool ok;
+  {
+    SIM_PROFILE_SCOPE("corpus book");
+    ok = sim_corpus_paginate(path, book);
+  }
+  const double totalMs = msSince(start);
+  const long bookPeakKb = heapTracked ? static_cast<long>((sim_heap_peak_bytes() + 1023) / 1024) : -1;
+  if (!ok && book.failure.empty()) book.failure = "failed";
+  for (char& c : book.failure) {
+    if (c == '\n' || c == '\t') c = ' ';
+  }
+  if (book.paginated) {
+    Serial.printf("[%lu] [CORPUS] %s: %d sections, %d pages in %.1f ms%s%s\n", millis(), path, book.sections,
+                  book.pages, totalMs, ok ? "" : ", ", book.failure.c_str());
+  } else {
+    Serial.printf("[%lu] [CORPUS] %s: %d sections, loaded only in %.1f ms%s%s\n", millis(), path, book.sections,
+                  totalMs, ok ? "" : ", ", book.failure.c_str());
+  }
+
+  char line[1024];
+  const int n = snprintf(line, sizeof(line), "%d\t%d\t%d\t%.1f\t%.1f\t%ld\t%s\n", book.sections, book.pages,
+                         book.paginated ? 1 : 0, book.loadMs, totalMs, bookPeakKb,
+                         book.failure.c_str());
+  const int out = atoi(fd);
+  if (write(out, line, static_cast<size_t>(std::min(n, static_cast<int>(sizeof(line)) - 1))) < 0) {
+    perror("corpus report");
+  }
+  close(out);
+  sim_log_flush();
+  fflush(stdout);
+  std::_Exit(0);
+}
@@ -1,10 +1,17 @@
 #include "EInkDisplay.h"
 #include "HalDisplay.h"
+#include "sim_display.h"
+#include "sim_gpio.h"
+#include "sim_profile.h"
 #include "sim_spi_bus.h"
 
 #include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 
 // Rotated 90° clockwise: logical 800×480 → window 480×800
 static const int WINDOW_WIDTH = static_cast<int>(EInkDisplay::DISPLAY_HEIGHT);   // 480
@@ -15,24 +22,113 @@ static SDL_Renderer* g_renderer = nullptr;
 static SDL_Texture* g_texture = nullptr;
 
 namespace {
-bool g_hasBw = false;
-bool g_hasGrayLsb = false;
-bool g_hasGrayMsb = false;
-uint8_t g_bwBuffer[EInkDisplay::BUFFER_SIZE];
-uint8_t g_grayLsbBuffer[EInkDisplay::BUFFER_SIZE];
-uint8_t g_grayMsbBuffer[EInkDisplay::BUFFER_SIZE];
+// Frames handed from the firmware to the window, triple-buffered: the firmware
+// fills `back` (snapshots of its framebuffer and gray planes), publishing swaps
+// it with `ready`, and the presenter swaps `ready` with `front` and converts
+// that. Both handoffs are index swaps under g_frameMutex; a frame published
+// before the previous one was presented replaces it. Only the firmware side
+// writes planes, and only those of `back`.
+struct Frame {
+  uint8_t bw[EInkDisplay::BUFFER_SIZE];
+  uint8_t lsb[EInkDisplay::BUFFER_SIZE];
+  uint8_t msb[EInkDisplay::BUFFER_SIZE];
+  bool gray;
+};
+Frame g_frames[3];
+std::mutex g_frameMutex;
+int g_back = 0;
+int g_ready = 1;
+int g_front = 2;
+bool g_readyFresh = false;
+// Frames holding the current bw image and gray planes (-1: none yet). A plane
+// lives on in the frame it was published in until displayGrayBuffer() copies
+// it forward, so the firmware can show the same planes again.
+int g_bwFrame = -1;
+int g_lsbFrame = -1;
+int g_msbFrame = -1;
+
+// Set while an SDL_USEREVENT announcing a published frame is queued, so a
+// burst of refreshes wakes the presenter once
+std::atomic<bool> g_wakeQueued{false};
+
+// sim_display_park(): the main thread waits here, outside every SDL call.
+// Never destroyed: in a forked copy the parked thread is gone but still counts
+// as a waiter, and destroying the condition variable would wait for it.
+std::mutex* g_parkMutex = new std::mutex();
+std::condition_variable* g_parkCv = new std::condition_variable();
+bool g_parkRequested = false;
+bool g_parked = false;
+
+inline uint64_t load_be64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+  return v;
+}
+
+inline void store_be64(uint8_t* p, uint64_t v) {
+  for (int i = 7; i >= 0; i--, v >>= 8) p[i] = static_cast<uint8_t>(v);
+}
 
 inline bool bit_is_set(const uint8_t* buf, int x, int y) {
   const size_t byteIdx = static_cast<size_t>(y) * EInkDisplay::DISPLAY_WIDTH_BYTES + (x / 8);
   return (buf[byteIdx] & (0x80 >> (x & 7))) != 0;
 }
 
+void present_texture() {
+  SDL_UnlockTexture(g_texture);
+  SDL_RenderClear(g_renderer);
+  SDL_RenderCopy(g_renderer, g_texture, nullptr, nullptr);
+  SDL_RenderPresent(g_renderer);
+}
+
 void render_bw_to_texture(const uint8_t* buf) {
   if (!g_renderer || !g_texture || !buf) return;
   uint8_t* pixels = nullptr;
   int pitch = 0;
   if (SDL_LockTexture(g_texture, nullptr, reinterpret_cast<void**>(&pixels), &pitch) != 0) return;
+  sim_display_convert_bw(buf, pixels, pitch);
+  present_texture();
+}
+
+void render_gray_to_texture(const uint8_t* bw, const uint8_t* lsb, const uint8_t* msb) {
+  if (!g_renderer || !g_texture || !bw || !lsb || !msb) return;
+  uint8_t* pixels = nullptr;
+  int pitch = 0;
+  if (SDL_LockTexture(g_texture, nullptr, reinterpret_cast<void**>(&pixels), &pitch) != 0) return;
+  sim_display_convert_gray(bw, lsb, msb, pixels, pitch);
+  present_texture();
+}
+
+void publish_back() {
+  {
+    std::lock_guard<std::mutex> lock(g_frameMutex);
+    std::swap(g_back, g_ready);
+    g_readyFresh = true;
+  }
+  if (!g_wakeQueued.exchange(true)) {
+    SDL_Event e{};
+    e.type = SDL_USEREVENT;
+    SDL_PushEvent(&e);  // thread-safe; wakes sim_display_pump_events()
+  }
+}
 
+// Presenter: shows the newest published frame, if any. Main (SDL) thread only.
+void present_latest() {
+  {
+    std::lock_guard<std::mutex> lock(g_frameMutex);
+    if (!g_readyFresh) return;
+    std::swap(g_front, g_ready);
+    g_readyFresh = false;
+  }
+  const Frame& f = g_frames[g_front];
+  if (f.gray)
+    render_gray_to_texture(f.bw, f.lsb, f.msb);
+  else
+    render_bw_to_texture(f.bw);
+}
+}  // namespace
+
+void sim_display_convert_bw(const uint8_t* buf, uint8_t* pixels, int pitch) {
   // Process the framebuffer one byte (8 horizontal pixels) at a time.
   // This eliminates per-pixel bit extraction and reduces loop iterations 8×.
   // Rotation: logical (x, y) → window (H-1-y, x).
@@ -61,19 +157,10 @@ void render_bw_to_texture(const uint8_t* buf) {
       }
     }
   }
-
-  SDL_UnlockTexture(g_texture);
-  SDL_RenderClear(g_renderer);
-  SDL_RenderCopy(g_renderer, g_texture, nullptr, nullptr);
-  SDL_RenderPresent(g_renderer);
 }
 
-void render_gray_to_texture(const uint8_t* bw, const uint8_t* lsb, const uint8_t* msb) {
-  if (!g_renderer || !g_texture || !bw || !lsb || !msb) return;
-  uint8_t* pixels = nullptr;
-  int pitch = 0;
-  if (SDL_LockTexture(g_texture, nullptr, reinterpret_cast<void**>(&pixels), &pitch) != 0) return;
-
+void sim_display_convert_gray(const uint8_t* bw, const uint8_t* lsb, const uint8_t* msb, uint8_t* pixels,
+                              int pitch) {
   // Precomputed grayscale LUT: 3 bits (bw, msb, lsb) → shade.
   // Index: bit2 = bwWhite, bit1 = msbBit, bit0 = lsbBit.
   static constexpr uint8_t grayLut[8] = {
@@ -118,13 +205,7 @@ void render_gray_to_texture(const uint8_t* bw, const uint8_t* lsb, const uint8_t
       }
     }
   }
-
-  SDL_UnlockTexture(g_texture);
-  SDL_RenderClear(g_renderer);
-  SDL_RenderCopy(g_renderer, g_texture, nullptr, nullptr);
-  SDL_RenderPresent(g_renderer);
 }
-}  // namespace
 
 EInkDisplay::EInkDisplay(int8_t, int8_t, int8_t, int8_t, int8_t, int8_t)
     : frameBuffer(frameBuffer0), isScreenOn(false) {}
@@ -187,21 +268,38 @@ void EInkDisplay::clearScreen(uint8_t color) const {
 void EInkDisplay::drawImage(const uint8_t* imageData, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
                             bool) const {
   SpiBusGuard guard;
-  if (!imageData || !frameBuffer) return;
-  const uint16_t rowBytes = (w + 7) / 8;
-  for (uint16_t row = 0; row < h; row++) {
-    uint16_t dstY = y + row;
-    if (dstY >= EInkDisplay::DISPLAY_HEIGHT) break;
-    for (uint16_t col = 0; col < w; col += 8) {
-      uint8_t byte = imageData[row * rowBytes + col / 8];
-      for (int b = 0; b < 8 && col + b < w; b++) {
-        uint16_t dstX = x + col + b;
-        if (dstX >= EInkDisplay::DISPLAY_WIDTH) break;
-        if (byte & (0x80 >> b)) {
-          size_t idx = dstY * EInkDisplay::DISPLAY_WIDTH_BYTES + dstX / 8;
-          frameBuffer[idx] &= ~(0x80 >> (dstX & 7));
-        }
-      }
+  if (!imageData || !frameBuffer || w == 0 || h == 0) return;
+  if (x >= EInkDisplay::DISPLAY_WIDTH || y >= EInkDisplay::DISPLAY_HEIGHT) return;
+
+  // Set source bits clear (blacken) destination bits. Each destination row is
+  // the source row shifted right by x & 7, built 64 bits at a time from two
+  // big-endian loads; only the last byte needs a mask (bits past the clipped
+  // width and the source row's padding). Clipping is done once, up front.
+  const size_t srcStride = (w + 7) / 8;
+  const unsigned width = std::min<unsigned>(w, EInkDisplay::DISPLAY_WIDTH - x);
+  const unsigned rows = std::min<unsigned>(h, EInkDisplay::DISPLAY_HEIGHT - y);
+  const unsigned shift = x & 7;
+  const size_t dstBytes = (shift + width + 7) / 8;
+  const uint8_t lastMask = static_cast<uint8_t>(0xFF00 >> ((shift + width - 1) % 8 + 1));
+
+  for (unsigned row = 0; row < rows; row++) {
+    const uint8_t* src = imageData + row * srcStride;
+    uint8_t* dst = frameBuffer + (y + row) * EInkDisplay::DISPLAY_WIDTH_BYTES + x / 8;
+    uint8_t carry = 0;  // source byte whose low bits spill into the next destination byte
+    size_t k = 0;
+    // The last destination byte always goes through the masked tail below
+    for (; k + 8 < dstBytes && k + 8 <= srcStride; k += 8) {
+      uint64_t bits = load_be64(src + k) >> shift;
+      if (shift) bits |= static_cast<uint64_t>(carry) << (64 - shift);
+      store_be64(dst + k, load_be64(dst + k) & ~bits);
+      carry = src[k + 7];
+    }
+    for (; k < dstBytes; k++) {
+      const uint8_t cur = k < srcStride ? src[k] : 0;
+      uint8_t bits = static_cast<uint8_t>((cur >> shift) | (carry << (8 - shift)));
+      if (k == dstBytes - 1) bits &= lastMask;
+      dst[k] &= static_cast<uint8_t>(~bits);
+      carry = cur;
     }
   }
 }
@@ -210,34 +308,43 @@ void EInkDisplay::setFramebuffer(const uint8_t*) const {}
 
 void EInkDisplay::copyGrayscaleBuffers(const uint8_t* lsb, const uint8_t* msb) {
   if (!lsb || !msb) return;
-  memcpy(g_grayLsbBuffer, lsb, EInkDisplay::BUFFER_SIZE);
-  memcpy(g_grayMsbBuffer, msb, EInkDisplay::BUFFER_SIZE);
-  g_hasGrayLsb = true;
-  g_hasGrayMsb = true;
+  memcpy(g_frames[g_back].lsb, lsb, EInkDisplay::BUFFER_SIZE);
+  memcpy(g_frames[g_back].msb, msb, EInkDisplay::BUFFER_SIZE);
+  g_lsbFrame = g_back;
+  g_msbFrame = g_back;
 }
 void EInkDisplay::copyGrayscaleLsbBuffers(const uint8_t* lsb) {
   if (!lsb) return;
-  memcpy(g_grayLsbBuffer, lsb, EInkDisplay::BUFFER_SIZE);
-  g_hasGrayLsb = true;
+  memcpy(g_frames[g_back].lsb, lsb, EInkDisplay::BUFFER_SIZE);
+  g_lsbFrame = g_back;
 }
 void EInkDisplay::copyGrayscaleMsbBuffers(const uint8_t* msb) {
   if (!msb) return;
-  memcpy(g_grayMsbBuffer, msb, EInkDisplay::BUFFER_SIZE);
-  g_hasGrayMsb = true;
+  memcpy(g_frames[g_back].msb, msb, EInkDisplay::BUFFER_SIZE);
+  g_msbFrame = g_back;
 }
 void EInkDisplay::cleanupGrayscaleBuffers(const uint8_t*) {
-  g_hasGrayLsb = false;
-  g_hasGrayMsb = false;
+  g_lsbFrame = -1;
+  g_msbFrame = -1;
 }
 
+// The app keeps drawing into its one framebuffer (GfxRenderer holds the
+// pointer), so a refresh snapshots it into the back frame, the host stand-in
+// for the SPI transfer, and hands that frame off. Conversion and the SDL
+// upload happen later on the main thread, in sim_display_pump_events().
 void EInkDisplay::displayBuffer(RefreshMode, bool) {
-  SpiBusGuard guard;
-  if (!frameBuffer) return;
-  memcpy(g_bwBuffer, frameBuffer, EInkDisplay::BUFFER_SIZE);
-  g_hasBw = true;
-  g_hasGrayLsb = false;
-  g_hasGrayMsb = false;
-  render_bw_to_texture(frameBuffer);
+  {
+    SpiBusGuard guard;
+    if (!frameBuffer) return;
+    Frame& back = g_frames[g_back];
+    memcpy(back.bw, frameBuffer, EInkDisplay::BUFFER_SIZE);
+    back.gray = false;
+    g_bwFrame = g_back;
+    g_lsbFrame = -1;
+    g_msbFrame = -1;
+    publish_back();
+  }
+  sim_profile_refresh();
 }
 
 void EInkDisplay::displayWindow(uint16_t, uint16_t, uint16_t, uint16_t) {
@@ -245,9 +352,18 @@ void EInkDisplay::displayWindow(uint16_t, uint16_t, uint16_t, uint16_t) {
 }
 
 void EInkDisplay::displayGrayBuffer(bool) {
-  SpiBusGuard guard;
-  if (!g_hasBw || !g_hasGrayLsb || !g_hasGrayMsb) return;
-  render_gray_to_texture(g_bwBuffer, g_grayLsbBuffer, g_grayMsbBuffer);
+  {
+    SpiBusGuard guard;
+    if (g_bwFrame < 0 || g_lsbFrame < 0 || g_msbFrame < 0) return;
+    Frame& back = g_frames[g_back];
+    if (g_bwFrame != g_back) memcpy(back.bw, g_frames[g_bwFrame].bw, EInkDisplay::BUFFER_SIZE);
+    if (g_lsbFrame != g_back) memcpy(back.lsb, g_frames[g_lsbFrame].lsb, EInkDisplay::BUFFER_SIZE);
+    if (g_msbFrame != g_back) memcpy(back.msb, g_frames[g_msbFrame].msb, EInkDisplay::BUFFER_SIZE);
+    back.gray = true;
+    g_bwFrame = g_lsbFrame = g_msbFrame = g_back;
+    publish_back();
+  }
+  sim_profile_refresh();
 }
 void EInkDisplay::refreshDisplay(RefreshMode mode, bool) { displayBuffer(mode); }
 void EInkDisplay::grayscaleRevert() {}
@@ -286,10 +402,44 @@ void HalDisplay::cleanupGrayscaleBuffers(const uint8_t* b) {
 }
 void HalDisplay::displayGrayBuffer(bool fadingFix) { einkDisplay.displayGrayBuffer(fadingFix); }
 
-bool sim_display_pump_events(void) {
+bool sim_display_pump_events(int timeoutMs) {
   SDL_Event e;
-  while (SDL_PollEvent(&e)) {
-    if (e.type == SDL_QUIT) return false;
+  bool quit = false;
+  bool have = timeoutMs > 0 ? SDL_WaitEventTimeout(&e, timeoutMs) != 0 : SDL_PollEvent(&e) != 0;
+  for (; have; have = SDL_PollEvent(&e) != 0) {
+    if (e.type == SDL_QUIT) quit = true;
+    else if (e.type == SDL_KEYDOWN && !e.key.repeat) sim_gpio_key_event(e.key.keysym.sym, true);
+    else if (e.type == SDL_KEYUP) sim_gpio_key_event(e.key.keysym.sym, false);
   }
-  return true;
+  g_wakeQueued.store(false);
+  present_latest();
+  std::unique_lock<std::mutex> lock(*g_parkMutex);
+  if (g_parkRequested) {
+    g_parked = true;
+    g_parkCv->notify_all();
+    g_parkCv->wait(lock, [] { return !g_parkRequested; });
+    g_parked = false;
+  }
+  return !quit;
+}
+
+void sim_display_park() {
+  std::unique_lock<std::mutex> lock(*g_parkMutex);
+  g_parkRequested = true;
+  SDL_Event e{};
+  e.type = SDL_USEREVENT;
+  SDL_PushEvent(&e);
+  g_parkCv->wait(lock, [] { return g_parked; });
+}
+
+void sim_display_after_fork() {
+  g_parkMutex = new std::mutex();
+  g_parkCv = new std::condition_variable();
+  g_parkRequested = false;
+  g_parked = false;
+}
+
+bool sim_display_headless() {
+  const char* driver = SDL_GetCurrentVideoDriver();
+  return driver && (strcmp(driver, "dummy") == 0 || strcmp(driver, "offscreen") == 0);
 }
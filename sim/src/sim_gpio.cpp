@@ -1,8 +1,16 @@
 #include "HalGPIO.h"
 #include "ArduinoStub.h"
+#include "sim_config.h"
+#include "sim_profile.h"
+#include "sim_snapshot.h"
 
 #include <SDL.h>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 static uint8_t s_keyToButton(SDL_Keycode key) {
   switch (key) {
@@ -19,27 +27,169 @@ static uint8_t s_keyToButton(SDL_Keycode key) {
   }
 }
 
+// Keyboard state, written by the SDL thread and read by HalGPIO::update().
+// s_keyCount is the number of keys held per button (Backspace and Escape share
+// BACK) and is only touched on the SDL thread.
+static uint8_t s_keyCount[8];
+static std::atomic<uint8_t> s_keysHeld{0};
+static std::atomic<uint8_t> s_keysPressed{0};  // presses since the last update()
+
+void sim_gpio_key_event(int keycode, bool down) {
+  const uint8_t button = s_keyToButton(static_cast<SDL_Keycode>(keycode));
+  if (button == 0xFF) return;
+  const uint8_t bit = static_cast<uint8_t>(1 << button);
+  if (down) {
+    s_keyCount[button]++;
+    s_keysPressed.fetch_or(bit);
+  } else if (s_keyCount[button] > 0) {
+    s_keyCount[button]--;
+  }
+  if (s_keyCount[button])
+    s_keysHeld.fetch_or(bit);
+  else
+    s_keysHeld.fetch_and(static_cast<uint8_t>(~bit));
+}
+
+// SIM_INPUT_SCRIPT: replay button presses from a file, for unattended runs
+// (PGO training, regression farms). One command per line, '#' comments:
+//   wait <ms>              idle
+//   press <BUTTON> [ms]    hold for ms (default 80), then release
+//   repeat <n> ... end     loop (nestable)
+//   quit                   close the emulator as if the window was closed
+//   snapshot               fork a copy per SIM_SNAPSHOT_RESUME script (sim_snapshot.h)
+// BUTTON is LEFT, RIGHT, UP, DOWN, CONFIRM, BACK or POWER. Times are millis().
+struct ScriptStep {
+  enum Kind : uint8_t { Wait, Press, Quit, Snapshot } kind;
+  uint8_t button;
+  uint32_t ms;
+};
+
+static std::vector<ScriptStep> s_script;
+static bool s_scriptLoaded = false;
+static size_t s_scriptPos = 0;
+static bool s_stepStarted = false;
+static unsigned long s_stepStartMs = 0;
+
+static uint8_t s_buttonByName(const std::string& name) {
+  static const char* const kNames[] = {"BACK", "CONFIRM", "LEFT", "RIGHT", "UP", "DOWN", "POWER"};
+  static const uint8_t kButtons[] = {HalGPIO::BTN_BACK, HalGPIO::BTN_CONFIRM, HalGPIO::BTN_LEFT, HalGPIO::BTN_RIGHT,
+                                     HalGPIO::BTN_UP,   HalGPIO::BTN_DOWN,    HalGPIO::BTN_POWER};
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+    if (name == kNames[i]) return kButtons[i];
+  }
+  return 0xFF;
+}
+
+// Parses lines from `f` until EOF or a matching "end", appending to `out`.
+static bool s_parseScript(FILE* f, std::vector<ScriptStep>& out, int& lineNo, const bool nested) {
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    line[strcspn(line, "#\r\n")] = '\0';
+    char word[32] = {}, arg[32] = {};
+    unsigned long ms = 0;
+    const int n = sscanf(line, "%31s %31s %lu", word, arg, &ms);
+    if (n <= 0) continue;
+    for (char* c = word; *c; c++) *c = static_cast<char>(tolower(static_cast<unsigned char>(*c)));
+    for (char* c = arg; *c; c++) *c = static_cast<char>(toupper(static_cast<unsigned char>(*c)));
+
+    if (!strcmp(word, "wait") && n >= 2) {
+      out.push_back({ScriptStep::Wait, 0, static_cast<uint32_t>(strtoul(arg, nullptr, 10))});
+    } else if (!strcmp(word, "press") && n >= 2 && s_buttonByName(arg) != 0xFF) {
+      out.push_back({ScriptStep::Press, s_buttonByName(arg), n >= 3 ? static_cast<uint32_t>(ms) : 80u});
+    } else if (!strcmp(word, "repeat") && n >= 2) {
+      std::vector<ScriptStep> body;
+      if (!s_parseScript(f, body, lineNo, true)) return false;
+      for (unsigned long i = strtoul(arg, nullptr, 10); i > 0; i--) out.insert(out.end(), body.begin(), body.end());
+    } else if (!strcmp(word, "end") && nested) {
+      return true;
+    } else if (!strcmp(word, "quit")) {
+      out.push_back({ScriptStep::Quit, 0, 0});
+    } else if (!strcmp(word, "snapshot")) {
+      out.push_back({ScriptStep::Snapshot, 0, 0});
+    } else {
+      Serial.printf("[%lu] [INPUT] Script line %d not understood: %s\n", millis(), lineNo, line);
+      return false;
+    }
+  }
+  if (nested) Serial.printf("[%lu] [INPUT] Script: repeat without end\n", millis());
+  return !nested;
+}
+
+// Button bits the script holds down for this update.
+static uint8_t s_scriptState() {
+  unsigned long now = millis();
+  while (s_scriptPos < s_script.size()) {
+    const ScriptStep& step = s_script[s_scriptPos];
+    if (step.kind == ScriptStep::Snapshot) {
+      s_scriptPos++;
+      // Returns when snapshots are off, or in a resumed copy with its own script
+      sim_snapshot_take();
+      now = millis();
+      continue;
+    }
+    if (step.kind == ScriptStep::Quit) {
+      Serial.printf("[%lu] [INPUT] Script finished, quitting\n", now);
+      s_scriptPos = s_script.size();
+      SDL_Event e{};
+      e.type = SDL_QUIT;
+      SDL_PushEvent(&e);
+      return 0;
+    }
+    if (!s_stepStarted) {
+      s_stepStarted = true;
+      s_stepStartMs = now;
+      // A press is always seen down for at least one update
+      if (step.kind == ScriptStep::Press) return static_cast<uint8_t>(1 << step.button);
+    }
+    if (now - s_stepStartMs < step.ms) {
+      return step.kind == ScriptStep::Press ? static_cast<uint8_t>(1 << step.button) : 0;
+    }
+    s_scriptPos++;
+    s_stepStarted = false;
+    // ...and up for at least one update before the next step
+    if (step.kind == ScriptStep::Press) return 0;
+  }
+  return 0;
+}
+
+static bool s_loadScript(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    Serial.printf("[%lu] [INPUT] Could not open input script %s\n", millis(), path);
+    return false;
+  }
+  int lineNo = 0;
+  std::vector<ScriptStep> steps;
+  const bool ok = s_parseScript(f, steps, lineNo, false);
+  fclose(f);
+  if (!ok) return false;
+  s_script = std::move(steps);
+  s_scriptPos = 0;
+  s_stepStarted = false;
+  Serial.printf("[%lu] [INPUT] Replaying %s (%zu steps)\n", millis(), path, s_script.size());
+  return true;
+}
+
+bool sim_gpio_replace_script(const char* path) {
+  s_scriptLoaded = true;
+  return s_loadScript(path);
+}
+
 void HalGPIO::begin() {}
 
 void HalGPIO::update() {
-  // Pump SDL events so keyboard state is current when we read it.
-  // SDL_PumpEvents is safe to call from the main thread and updates
-  // the internal key state array used by SDL_GetKeyboardState.
-  SDL_PumpEvents();
+  if (!s_scriptLoaded) {
+    s_scriptLoaded = true;
+    if (const char* path = sim_config_str("SIM_INPUT_SCRIPT", nullptr)) s_loadScript(path);
+  }
 
   prevState_ = lastState_;
   anyPressed_ = false;
   anyReleased_ = false;
 
-  const Uint8* keys = SDL_GetKeyboardState(nullptr);
-  uint8_t state = 0;
-  if (keys[SDL_SCANCODE_LEFT]) state |= (1 << BTN_LEFT);
-  if (keys[SDL_SCANCODE_RIGHT]) state |= (1 << BTN_RIGHT);
-  if (keys[SDL_SCANCODE_UP]) state |= (1 << BTN_UP);
-  if (keys[SDL_SCANCODE_DOWN]) state |= (1 << BTN_DOWN);
-  if (keys[SDL_SCANCODE_RETURN]) state |= (1 << BTN_CONFIRM);
-  if (keys[SDL_SCANCODE_BACKSPACE] || keys[SDL_SCANCODE_ESCAPE]) state |= (1 << BTN_BACK);
-  if (keys[SDL_SCANCODE_P]) state |= (1 << BTN_POWER);
+  uint8_t state = s_keysHeld.load() | s_keysPressed.exchange(0);
+  if (s_scriptPos < s_script.size()) state |= s_scriptState();
 
   lastState_ = state;
   for (int i = 0; i <= 6; i++) {
@@ -47,6 +197,7 @@ void HalGPIO::update() {
     if ((state & bit) && !(prevState_ & bit)) anyPressed_ = true;
     if (!(state & bit) && (prevState_ & bit)) anyReleased_ = true;
   }
+  if (anyPressed_) sim_profile_input();
   if (state & ((1 << BTN_CONFIRM) | (1 << BTN_POWER)))
     pressStartMs_ = pressStartMs_ ? pressStartMs_ : millis();
   else
@@ -82,10 +233,3 @@ void HalGPIO::startDeepSleep() {
 }
 
 int HalGPIO::getBatteryPercentage() const { return 100; }
-
-void sim_gpio_pump_events() {
-  SDL_Event e;
-  while (SDL_PollEvent(&e)) {
-    if (e.type == SDL_QUIT) std::exit(0);
-  }
-}
@@ -0,0 +1,93 @@
+// Heap accounting behind corpus runs (see sim_heap.h). Same glibc
+// interposition as sim/bench/opds_bench.cpp, gated so it costs nothing until
+// a corpus book starts tracking.
+
+#include "sim_heap.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+
+std::atomic<bool> s_tracking{false};
+std::atomic<int64_t> s_liveBytes{0};
+std::atomic<int64_t> s_peakBytes{0};
+
+void noteAlloc(size_t bytes) {
+  const int64_t live = s_liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) +
+                       static_cast<int64_t>(bytes);
+  int64_t peak = s_peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !s_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void noteFree(size_t bytes) { s_liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed); }
+
+bool tracking() { return s_tracking.load(std::memory_order_relaxed); }
+
+}  // namespace
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t n) {
+  void* p = __libc_malloc(n);
+  if (p && tracking()) noteAlloc(malloc_usable_size(p));
+  return p;
+}
+void* calloc(size_t n, size_t size) {
+  void* p = __libc_calloc(n, size);
+  if (p && tracking()) noteAlloc(malloc_usable_size(p));
+  return p;
+}
+void* realloc(void* old, size_t n) {
+  const bool counted = tracking();
+  const size_t oldBytes = old && counted ? malloc_usable_size(old) : 0;
+  void* p = __libc_realloc(old, n);
+  if (p && counted) {
+    noteFree(oldBytes);
+    noteAlloc(malloc_usable_size(p));
+  }
+  return p;
+}
+void* memalign(size_t alignment, size_t n) {
+  void* p = __libc_memalign(alignment, n);
+  if (p && tracking()) noteAlloc(malloc_usable_size(p));
+  return p;
+}
+void* aligned_alloc(size_t alignment, size_t n) { return memalign(alignment, n); }
+int posix_memalign(void** out, size_t alignment, size_t n) {
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+  void* p = memalign(alignment, n);
+  if (!p) return ENOMEM;
+  *out = p;
+  return 0;
+}
+void free(void* p) {
+  if (p && tracking()) noteFree(malloc_usable_size(p));
+  __libc_free(p);
+}
+}
+
+bool sim_heap_track_begin() {
+  s_liveBytes.store(0);
+  s_peakBytes.store(0);
+  s_tracking.store(true);
+  return true;
+}
+#else
+bool sim_heap_track_begin() { return false; }
+#endif
+
+size_t sim_heap_peak_bytes() { return static_cast<size_t>(s_peakBytes.load()); }
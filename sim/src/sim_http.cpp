@@ -0,0 +1,536 @@
+// Host-side HTTP for the emulator. See sim_http.h.
+
+#include "sim_http.h"
+
+#include "ArduinoStub.h"
+#include "sim_config.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS: SIGPIPE is ignored per socket instead
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kMaxRedirects = 5;
+constexpr size_t kChunkBytes = 4096;
+
+struct Url {
+  std::string scheme;
+  std::string host;
+  std::string port;
+  std::string target;  // path and query
+};
+
+bool parseUrl(const std::string& url, Url& out) {
+  const size_t schemeEnd = url.find("://");
+  if (schemeEnd == std::string::npos) return false;
+  out.scheme = url.substr(0, schemeEnd);
+  for (char& c : out.scheme) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  const size_t hostStart = schemeEnd + 3;
+  const size_t pathStart = url.find('/', hostStart);
+  std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos
+                                                                               : pathStart - hostStart);
+  const size_t at = authority.rfind('@');
+  if (at != std::string::npos) authority = authority.substr(at + 1);
+  const size_t colon = authority.rfind(':');
+  if (colon != std::string::npos && authority.find(']') == std::string::npos) {
+    out.host = authority.substr(0, colon);
+    out.port = authority.substr(colon + 1);
+  } else {
+    out.host = authority;
+    out.port = out.scheme == "https" ? "443" : "80";
+  }
+  out.target = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+  return !out.host.empty() || out.scheme == "file";
+}
+
+bool equalsNoCase(const std::string& a, const char* b) {
+  const size_t n = strlen(b);
+  if (a.size() != n) return false;
+  for (size_t i = 0; i < n; i++)
+    if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+      return false;
+  return true;
+}
+
+std::string percentDecode(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+        std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+      out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+// ---------------------------------------------------------------------------
+// Shaping
+// ---------------------------------------------------------------------------
+
+// Paces body delivery to SIM_HTTP_KBPS and applies SIM_HTTP_LATENCY_MS once.
+class Shaper {
+ public:
+  Shaper()
+      : latencyMs_(std::max(0, sim_config_int("SIM_HTTP_LATENCY_MS", 0))),
+        bytesPerMs_(std::max(0, sim_config_int("SIM_HTTP_KBPS", 0)) * 1024.0 / 1000.0) {}
+
+  void firstByte() {
+    if (latencyMs_ > 0) sim_task_delay(static_cast<unsigned long>(latencyMs_));
+    start_ = Clock::now();
+  }
+
+  void delivered(size_t bytes) {
+    if (bytesPerMs_ <= 0) return;
+    sent_ += bytes;
+    const auto due = start_ + std::chrono::microseconds(static_cast<int64_t>(sent_ / bytesPerMs_ * 1000));
+    const auto now = Clock::now();
+    if (due > now)
+      sim_task_delay(static_cast<unsigned long>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1));
+  }
+
+ private:
+  int latencyMs_;
+  double bytesPerMs_;
+  Clock::time_point start_ = Clock::now();
+  double sent_ = 0;
+};
+
+// Splits data into chunks for the sink, pacing each. False if the sink aborted.
+bool deliver(const uint8_t* data, size_t len, const SimHttpBodySink& onBody, Shaper& shaper) {
+  while (len > 0) {
+    const size_t n = std::min(len, kChunkBytes);
+    if (onBody && !onBody(data, n)) return false;
+    shaper.delivered(n);
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// File-backed URLs
+// ---------------------------------------------------------------------------
+
+struct MapEntry {
+  std::string prefix;
+  std::string path;
+};
+
+const std::vector<MapEntry>& urlMap() {
+  static const std::vector<MapEntry> entries = [] {
+    std::vector<MapEntry> result;
+    const char* file = sim_config_str("SIM_HTTP_MAP", nullptr);
+    if (!file) return result;
+    std::ifstream in(file);
+    if (!in) {
+      Serial.printf("[%lu] [HTTP] Could not read SIM_HTTP_MAP %s\n", millis(), file);
+      return result;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      char p[1024], h[1024];
+      if (sscanf(line.c_str(), "%1023s %1023s", p, h) == 2) result.push_back({p, h});
+    }
+    // Longest prefix wins.
+    std::sort(result.begin(), result.end(),
+              [](const MapEntry& a, const MapEntry& b) { return a.prefix.size() > b.prefix.size(); });
+    return result;
+  }();
+  return entries;
+}
+
+bool mappedPath(const std::string& url, std::string& path) {
+  std::string bare = url.substr(0, url.find_first_of("?#"));
+  if (bare.compare(0, 7, "file://") == 0) {
+    path = percentDecode(bare.substr(7));
+    return true;
+  }
+  for (const MapEntry& e : urlMap()) {
+    if (bare.compare(0, e.prefix.size(), e.prefix) != 0) continue;
+    path = e.path + percentDecode(bare.substr(e.prefix.size()));
+    return true;
+  }
+  return false;
+}
+
+SimHttpResponse serveFile(const std::string& path, const SimHttpBodySink& onBody,
+                          const SimHttpHeadersSink& onHeaders) {
+  SimHttpResponse response;
+  Shaper shaper;
+  shaper.firstByte();
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    response.status = 404;
+    response.contentLength = 0;
+    if (onHeaders) onHeaders(response);
+    return response;
+  }
+  fseek(f, 0, SEEK_END);
+  response.status = 200;
+  response.contentLength = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  response.headers.emplace_back("Content-Length", std::to_string(response.contentLength));
+  if (onHeaders) onHeaders(response);
+  uint8_t buf[kChunkBytes];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    if (!deliver(buf, n, onBody, shaper)) {
+      response.error = "aborted";
+      break;
+    }
+  }
+  fclose(f);
+  return response;
+}
+
+// ---------------------------------------------------------------------------
+// In-process handlers
+// ---------------------------------------------------------------------------
+
+struct HandlerEntry {
+  std::string prefix;
+  SimHttpHandler handler;
+};
+
+std::mutex s_handlersMutex;
+std::vector<HandlerEntry> s_handlers;  // longest prefix first
+
+bool findHandler(const std::string& url, SimHttpHandler& handler) {
+  std::lock_guard<std::mutex> lock(s_handlersMutex);
+  for (const HandlerEntry& e : s_handlers) {
+    if (url.compare(0, e.prefix.size(), e.prefix) != 0) continue;
+    handler = e.handler;
+    return true;
+  }
+  return false;
+}
+
+SimHttpResponse serveHandler(const SimHttpHandler& handler, const SimHttpRequest& request,
+                             const SimHttpBodySink& onBody, const SimHttpHeadersSink& onHeaders) {
+  SimHttpResponse response;
+  const std::string body = handler(request, response);
+  if (response.status < 0) {
+    if (response.error.empty()) response.error = "no HTTP response";
+    return response;
+  }
+  Shaper shaper;
+  shaper.firstByte();
+  response.contentLength = static_cast<int64_t>(body.size());
+  if (!sim_http_header(response.headers, "Content-Length"))
+    response.headers.emplace_back("Content-Length", std::to_string(body.size()));
+  if (onHeaders) onHeaders(response);
+  if (!deliver(reinterpret_cast<const uint8_t*>(body.data()), body.size(), onBody, shaper))
+    response.error = "aborted";
+  return response;
+}
+
+// ---------------------------------------------------------------------------
+// Sockets
+// ---------------------------------------------------------------------------
+
+class Connection {
+ public:
+  explicit Connection(int timeoutMs)
+      : timeoutMs_(timeoutMs > 0 ? timeoutMs : std::max(1, sim_config_int("SIM_HTTP_TIMEOUT_MS", 15000))) {}
+  ~Connection() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  bool open(const Url& url, std::string& error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &res) != 0 || !res) {
+      error = "cannot resolve " + url.host;
+      return false;
+    }
+    for (addrinfo* ai = res; ai && fd_ < 0; ai = ai->ai_next) {
+      const int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || (errno == EINPROGRESS && waitFor(fd, POLLOUT))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err == 0) {
+          fd_ = fd;
+          break;
+        }
+      }
+      ::close(fd);
+    }
+    freeaddrinfo(res);
+    if (fd_ < 0) error = "cannot connect to " + url.host + ":" + url.port;
+    return fd_ >= 0;
+  }
+
+  bool sendAll(const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+      const ssize_t n = ::send(fd_, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+      if (n > 0) {
+        off += static_cast<size_t>(n);
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (!waitFor(fd_, POLLOUT)) return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Reads what is available (waiting for at least one byte). 0 on EOF, -1 on error.
+  ssize_t recvSome(uint8_t* buf, size_t cap) {
+    for (;;) {
+      const ssize_t n = ::recv(fd_, buf, cap, 0);
+      if (n >= 0) return n;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+      if (!waitFor(fd_, POLLIN)) return -1;
+    }
+  }
+
+ private:
+  // Blocks the calling task until the socket is ready or the timeout has
+  // passed; other tasks run meanwhile, as behind a blocking lwIP call.
+  bool waitFor(int fd, short events) const { return sim_task_wait_fd(fd, events, timeoutMs_) != 0; }
+
+  int timeoutMs_;
+  int fd_ = -1;
+};
+
+// Buffered reader over a connection for the status line, headers and chunks.
+class Reader {
+ public:
+  explicit Reader(Connection& conn) : conn_(conn) {}
+
+  bool readLine(std::string& line) {
+    line.clear();
+    for (;;) {
+      while (pos_ < len_) {
+        const char c = static_cast<char>(buf_[pos_++]);
+        if (c == '\n') {
+          if (!line.empty() && line.back() == '\r') line.pop_back();
+          return true;
+        }
+        line += c;
+        if (line.size() > 16 * 1024) return false;
+      }
+      if (!fill()) return false;
+    }
+  }
+
+  // Points data at up to max buffered or newly received bytes. 0 on EOF.
+  size_t readSome(size_t max, const uint8_t*& data) {
+    if (pos_ == len_ && !fill()) return 0;
+    const size_t n = std::min(max, len_ - pos_);
+    data = buf_ + pos_;
+    pos_ += n;
+    return n;
+  }
+
+ private:
+  bool fill() {
+    const ssize_t n = conn_.recvSome(buf_, sizeof(buf_));
+    if (n <= 0) return false;
+    pos_ = 0;
+    len_ = static_cast<size_t>(n);
+    return true;
+  }
+
+  Connection& conn_;
+  uint8_t buf_[kChunkBytes];
+  size_t pos_ = 0;
+  size_t len_ = 0;
+};
+
+// Reads a body of known length, chunked, or delimited by connection close.
+bool readBody(Reader& reader, const SimHttpResponse& response, const SimHttpBodySink& onBody,
+              Shaper& shaper, std::string& error) {
+  const std::string* te = sim_http_header(response.headers, "Transfer-Encoding");
+  if (te && te->find("chunked") != std::string::npos) {
+    std::string line;
+    for (;;) {
+      if (!reader.readLine(line)) {
+        error = "truncated chunked body";
+        return false;
+      }
+      const size_t size = strtoul(line.c_str(), nullptr, 16);
+      if (size == 0) {
+        while (reader.readLine(line) && !line.empty()) {
+        }  // trailers
+        return true;
+      }
+      size_t left = size;
+      while (left > 0) {
+        const uint8_t* data;
+        const size_t n = reader.readSome(left, data);
+        if (n == 0) {
+          error = "truncated chunk";
+          return false;
+        }
+        if (!deliver(data, n, onBody, shaper)) {
+          error = "aborted";
+          return false;
+        }
+        left -= n;
+      }
+      reader.readLine(line);  // CRLF after the chunk
+    }
+  }
+
+  int64_t left = response.contentLength;
+  for (;;) {
+    if (left == 0) return true;
+    const uint8_t* data;
+    const size_t n = reader.readSome(left < 0 ? kChunkBytes : static_cast<size_t>(std::min<int64_t>(left, kChunkBytes)), data);
+    if (n == 0) {
+      if (left > 0) error = "connection closed before the end of the body";
+      return left < 0;
+    }
+    if (!deliver(data, n, onBody, shaper)) {
+      error = "aborted";
+      return false;
+    }
+    if (left > 0) left -= static_cast<int64_t>(n);
+  }
+}
+
+SimHttpResponse fetchOverSocket(const SimHttpRequest& request, const Url& url,
+                                const SimHttpBodySink& onBody, const SimHttpHeadersSink& onHeaders,
+                                bool& redirect) {
+  SimHttpResponse response;
+  redirect = false;
+  if (url.scheme != "http") {
+    response.error = url.scheme + " is not supported; serve fixtures over http or map them with SIM_HTTP_MAP";
+    return response;
+  }
+  Connection conn(request.timeoutMs);
+  if (!conn.open(url, response.error)) return response;
+
+  std::string head = request.method + " " + url.target + " HTTP/1.1\r\nHost: " + url.host;
+  if (url.port != "80") head += ":" + url.port;
+  head += "\r\nConnection: close\r\n";
+  bool hasAgent = false;
+  for (const auto& h : request.headers) {
+    head += h.first + ": " + h.second + "\r\n";
+    hasAgent = hasAgent || equalsNoCase(h.first, "User-Agent");
+  }
+  if (!hasAgent) head += "User-Agent: CrossPoint-Emulator\r\n";
+  if (!request.body.empty() || request.method == "POST" || request.method == "PUT")
+    head += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+  head += "\r\n";
+  if (!conn.sendAll(head + request.body)) {
+    response.error = "send failed";
+    return response;
+  }
+
+  Shaper shaper;
+  Reader reader(conn);
+  std::string line;
+  if (!reader.readLine(line) || line.compare(0, 5, "HTTP/") != 0) {
+    response.error = "no HTTP response";
+    return response;
+  }
+  shaper.firstByte();
+  const size_t sp = line.find(' ');
+  response.status = sp == std::string::npos ? -1 : atoi(line.c_str() + sp + 1);
+  while (reader.readLine(line) && !line.empty()) {
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    size_t v = colon + 1;
+    while (v < line.size() && line[v] == ' ') v++;
+    response.headers.emplace_back(line.substr(0, colon), line.substr(v));
+  }
+  if (const std::string* len = sim_http_header(response.headers, "Content-Length"))
+    response.contentLength = strtoll(len->c_str(), nullptr, 10);
+  if (request.method == "HEAD" || response.status == 204 || response.status == 304)
+    response.contentLength = 0;
+
+  if (response.status >= 300 && response.status < 400 && response.status != 304 &&
+      sim_http_header(response.headers, "Location")) {
+    redirect = true;
+    return response;
+  }
+  if (onHeaders) onHeaders(response);
+  readBody(reader, response, onBody, shaper, response.error);
+  return response;
+}
+
+std::string resolveLocation(const Url& base, const std::string& location) {
+  if (location.find("://") != std::string::npos) return location;
+  std::string origin = base.scheme + "://" + base.host;
+  if (base.port != (base.scheme == "https" ? "443" : "80")) origin += ":" + base.port;
+  if (!location.empty() && location[0] == '/') return origin + location;
+  const std::string dir = base.target.substr(0, base.target.rfind('/') + 1);
+  return origin + dir + location;
+}
+
+}  // namespace
+
+void sim_http_register_handler(const std::string& prefix, SimHttpHandler handler) {
+  std::lock_guard<std::mutex> lock(s_handlersMutex);
+  s_handlers.push_back({prefix, std::move(handler)});
+  std::stable_sort(s_handlers.begin(), s_handlers.end(),
+                   [](const HandlerEntry& a, const HandlerEntry& b) { return a.prefix.size() > b.prefix.size(); });
+}
+
+const std::string* sim_http_header(const SimHttpHeaders& headers, const char* name) {
+  for (const auto& h : headers)
+    if (equalsNoCase(h.first, name)) return &h.second;
+  return nullptr;
+}
+
+SimHttpResponse sim_http_request(const SimHttpRequest& request, const SimHttpBodySink& onBody,
+                                 const SimHttpHeadersSink& onHeaders) {
+  SimHttpRequest current = request;
+  for (int hop = 0;; hop++) {
+    SimHttpHandler handler;
+    if (findHandler(current.url, handler)) return serveHandler(handler, current, onBody, onHeaders);
+    std::string path;
+    if (mappedPath(current.url, path)) return serveFile(path, onBody, onHeaders);
+
+    Url url;
+    if (!parseUrl(current.url, url)) {
+      SimHttpResponse bad;
+      bad.error = "malformed URL " + current.url;
+      return bad;
+    }
+    bool redirect = false;
+    SimHttpResponse response = fetchOverSocket(current, url, onBody, onHeaders, redirect);
+    if (!redirect) return response;
+    if (hop == kMaxRedirects) {
+      response.error = "too many redirects";
+      if (onHeaders) onHeaders(response);
+      return response;
+    }
+    current.url = resolveLocation(url, *sim_http_header(response.headers, "Location"));
+    if (response.status == 303) {
+      current.method = "GET";
+      current.body.clear();
+    }
+  }
+}
@@ -0,0 +1,330 @@
+// Local kosync server for the emulator. See sim_kosync.h.
+
+#include "sim_kosync.h"
+
+#include "ArduinoStub.h"
+#include "sim_config.h"
+#include "sim_http.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Progress {
+  std::string progress;
+  std::string percentage = "0";  // kept as the client's JSON number text
+  std::string device;
+  std::string deviceId;
+  long long timestamp = 0;
+};
+
+struct EndpointStats {
+  unsigned long requests = 0;
+  unsigned long injectedFailures = 0;
+  long long totalMs = 0;
+  long long maxMs = 0;
+};
+
+struct Config {
+  std::string base;
+  int latencyMs;
+  int jitterMs;
+  double failRate;
+  std::string failMode;
+  const char* dbPath;
+  bool autoRegister;
+};
+
+Config s_config;
+std::mutex s_mutex;  // guards everything below; never held while sleeping
+std::map<std::string, std::string> s_users;  // username -> key (MD5 of the password)
+std::map<std::string, Progress> s_progress;  // "user\tdocument" -> progress
+std::map<std::string, EndpointStats> s_stats;
+std::mt19937 s_rng(1);
+
+// ---------------------------------------------------------------------------
+// Minimal JSON: flat objects of strings and numbers are all kosync speaks.
+// ---------------------------------------------------------------------------
+
+std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+// Top-level field as a string (unescaped) or raw number text. False if absent.
+bool jsonField(const std::string& json, const char* key, std::string& out) {
+  const std::string quoted = std::string("\"") + key + "\"";
+  size_t p = json.find(quoted);
+  if (p == std::string::npos) return false;
+  p = json.find_first_not_of(" \t\r\n", p + quoted.size());
+  if (p == std::string::npos || json[p] != ':') return false;
+  p = json.find_first_not_of(" \t\r\n", p + 1);
+  if (p == std::string::npos) return false;
+  out.clear();
+  if (json[p] != '"') {
+    const size_t end = json.find_first_of(",} \t\r\n", p);
+    out = json.substr(p, end == std::string::npos ? std::string::npos : end - p);
+    return !out.empty();
+  }
+  for (p++; p < json.size() && json[p] != '"'; p++) {
+    if (json[p] == '\\' && p + 1 < json.size()) {
+      p++;
+      if (json[p] == 'u' && p + 4 < json.size()) {
+        const long cp = strtol(json.substr(p + 1, 4).c_str(), nullptr, 16);
+        out += cp < 0x80 ? static_cast<char>(cp) : '?';
+        p += 4;
+        continue;
+      }
+      out += json[p] == 'n' ? '\n' : json[p] == 't' ? '\t' : json[p];
+      continue;
+    }
+    out += json[p];
+  }
+  return true;
+}
+
+std::string message(const char* text) { return std::string("{\"message\":\"") + text + "\"}"; }
+
+// ---------------------------------------------------------------------------
+// Persistence (SIM_KOSYNC_DB): tab-separated "U user key" and
+// "P user document percentage timestamp device device_id progress" lines.
+// ---------------------------------------------------------------------------
+
+void load() {
+  if (!s_config.dbPath) return;
+  std::ifstream in(s_config.dbPath);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> f;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) f.push_back(field);
+    if (f.size() == 3 && f[0] == "U") {
+      s_users[f[1]] = f[2];
+    } else if (f.size() >= 8 && f[0] == "P") {
+      Progress& p = s_progress[f[1] + "\t" + f[2]];
+      p.percentage = f[3];
+      p.timestamp = atoll(f[4].c_str());
+      p.device = f[5];
+      p.deviceId = f[6];
+      p.progress = f[7];
+    }
+  }
+}
+
+void save() {
+  if (!s_config.dbPath) return;
+  const std::string tmp = std::string(s_config.dbPath) + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) return;
+  for (const auto& u : s_users) fprintf(f, "U\t%s\t%s\n", u.first.c_str(), u.second.c_str());
+  for (const auto& e : s_progress) {
+    const Progress& p = e.second;
+    fprintf(f, "P\t%s\t%s\t%lld\t%s\t%s\t%s\n", e.first.c_str(), p.percentage.c_str(), p.timestamp,
+            p.device.c_str(), p.deviceId.c_str(), p.progress.c_str());
+  }
+  fclose(f);
+  rename(tmp.c_str(), s_config.dbPath);
+}
+
+// ---------------------------------------------------------------------------
+// Endpoints
+// ---------------------------------------------------------------------------
+
+// Checks x-auth-user / x-auth-key. Sets 401 and returns false on mismatch.
+bool authorize(const SimHttpRequest& request, SimHttpResponse& response, std::string& user) {
+  const std::string* name = sim_http_header(request.headers, "x-auth-user");
+  const std::string* key = sim_http_header(request.headers, "x-auth-key");
+  if (name && key && !name->empty()) {
+    auto it = s_users.find(*name);
+    if (it == s_users.end() && s_config.autoRegister) {
+      it = s_users.emplace(*name, *key).first;
+      save();
+      Serial.printf("[%lu] [KOSYNC] Registered user '%s'\n", millis(), name->c_str());
+    }
+    if (it != s_users.end() && it->second == *key) {
+      user = *name;
+      return true;
+    }
+  }
+  response.status = 401;
+  return false;
+}
+
+std::string handle(const SimHttpRequest& request, const std::string& path, SimHttpResponse& response) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  std::string user;
+  if (request.method == "POST" && path == "/users/create") {
+    std::string name, key;
+    if (!jsonField(request.body, "username", name) || !jsonField(request.body, "password", key) || name.empty()) {
+      response.status = 400;
+      return message("Invalid request");
+    }
+    if (s_users.count(name)) {
+      response.status = 402;
+      return message("Username is already registered.");
+    }
+    s_users[name] = key;
+    save();
+    response.status = 201;
+    return "{\"username\":\"" + jsonEscape(name) + "\"}";
+  }
+  if (request.method == "GET" && path == "/users/auth") {
+    if (!authorize(request, response, user)) return message("Unauthorized");
+    response.status = 200;
+    return "{\"authorized\":\"OK\"}";
+  }
+  if (request.method == "PUT" && path == "/syncs/progress") {
+    if (!authorize(request, response, user)) return message("Unauthorized");
+    std::string document;
+    if (!jsonField(request.body, "document", document) || document.empty()) {
+      response.status = 403;
+      return message("Field 'document' not provided.");
+    }
+    Progress& p = s_progress[user + "\t" + document];
+    jsonField(request.body, "progress", p.progress);
+    jsonField(request.body, "percentage", p.percentage);
+    jsonField(request.body, "device", p.device);
+    jsonField(request.body, "device_id", p.deviceId);
+    p.timestamp = static_cast<long long>(time(nullptr));
+    save();
+    response.status = 200;
+    return "{\"document\":\"" + jsonEscape(document) + "\",\"timestamp\":" + std::to_string(p.timestamp) + "}";
+  }
+  static const std::string kGetProgress = "/syncs/progress/";
+  if (request.method == "GET" && path.compare(0, kGetProgress.size(), kGetProgress) == 0) {
+    if (!authorize(request, response, user)) return message("Unauthorized");
+    const std::string document = path.substr(kGetProgress.size());
+    response.status = 200;
+    const auto it = s_progress.find(user + "\t" + document);
+    if (it == s_progress.end()) return "{}";  // what kosync answers for an unknown document
+    const Progress& p = it->second;
+    return "{\"document\":\"" + jsonEscape(document) + "\",\"progress\":\"" + jsonEscape(p.progress) +
+           "\",\"percentage\":" + p.percentage + ",\"device\":\"" + jsonEscape(p.device) +
+           "\",\"device_id\":\"" + jsonEscape(p.deviceId) + "\",\"timestamp\":" + std::to_string(p.timestamp) +
+           "}";
+  }
+  response.status = 404;
+  return message("Not found");
+}
+
+// Collapses /syncs/progress/<document> so stats group by endpoint.
+std::string endpointName(const SimHttpRequest& request, const std::string& path) {
+  static const std::string kGetProgress = "/syncs/progress/";
+  const std::string route = path.compare(0, kGetProgress.size(), kGetProgress) == 0 ? kGetProgress + "*" : path;
+  return request.method + " " + route;
+}
+
+std::string serve(const SimHttpRequest& request, SimHttpResponse& response) {
+  const auto start = Clock::now();
+  std::string path = request.url.substr(s_config.base.size());
+  path = path.substr(0, path.find_first_of("?#"));
+  if (path.empty() || path[0] != '/') path.insert(0, "/");
+
+  int delayMs = s_config.latencyMs;
+  bool fail = false;
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_config.jitterMs > 0) delayMs += std::uniform_int_distribution<int>(0, s_config.jitterMs)(s_rng);
+    fail = s_config.failRate > 0 && std::uniform_real_distribution<double>(0, 1)(s_rng) < s_config.failRate;
+  }
+
+  std::string body;
+  if (fail && s_config.failMode == "refused") {
+    response.error = "cannot connect to " + s_config.base;
+  } else if (fail && s_config.failMode == "timeout") {
+    const int timeoutMs =
+        request.timeoutMs > 0 ? request.timeoutMs : std::max(1, sim_config_int("SIM_HTTP_TIMEOUT_MS", 15000));
+    sim_task_delay(static_cast<unsigned long>(timeoutMs));
+    response.error = "no HTTP response";
+  } else {
+    if (delayMs > 0) sim_task_delay(static_cast<unsigned long>(delayMs));
+    if (fail) {
+      const int status = atoi(s_config.failMode.c_str());
+      response.status = status >= 100 ? status : 500;
+      body = message("Injected failure");
+    } else {
+      body = handle(request, path, response);
+    }
+  }
+  response.headers.emplace_back("Content-Type", "application/json");
+
+  const long long elapsedMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+  const std::string endpoint = endpointName(request, path);
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    EndpointStats& st = s_stats[endpoint];
+    st.requests++;
+    st.injectedFailures += fail ? 1 : 0;
+    st.totalMs += elapsedMs;
+    st.maxMs = std::max(st.maxMs, elapsedMs);
+  }
+  if (response.status < 0)
+    Serial.printf("[%lu] [KOSYNC] %s: injected %s after %lld ms\n", millis(), endpoint.c_str(),
+                  s_config.failMode.c_str(), elapsedMs);
+  else
+    Serial.printf("[%lu] [KOSYNC] %s -> %d (%lld ms%s)\n", millis(), endpoint.c_str(), response.status, elapsedMs,
+                  fail ? ", injected" : "");
+  return body;
+}
+
+void report() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  if (s_stats.empty()) return;
+  Serial.printf("[%lu] [KOSYNC] Requests (latency %d+%d ms, fail rate %.2f %s):\n", millis(), s_config.latencyMs,
+                s_config.jitterMs, s_config.failRate, s_config.failMode.c_str());
+  for (const auto& e : s_stats) {
+    const EndpointStats& st = e.second;
+    Serial.printf("[%lu] [KOSYNC]   %-26s %5lu requests  %3lu failed  avg %5lld ms  max %5lld ms  blocked %lld ms\n",
+                  millis(), e.first.c_str(), st.requests, st.injectedFailures, st.totalMs / (long long)st.requests,
+                  st.maxMs, st.totalMs);
+  }
+}
+
+}  // namespace
+
+void sim_kosync_begin() {
+  const char* setting = sim_config_str("SIM_KOSYNC", nullptr);
+  if (!setting || !sim_config_flag("SIM_KOSYNC")) return;
+  s_config.base = strstr(setting, "://") ? setting : "http://kosync.sim";
+  while (!s_config.base.empty() && s_config.base.back() == '/') s_config.base.pop_back();
+  s_config.latencyMs = std::max(0, sim_config_int("SIM_KOSYNC_LATENCY_MS", 150));
+  s_config.jitterMs = std::max(0, sim_config_int("SIM_KOSYNC_JITTER_MS", 0));
+  s_config.failRate = std::min(1.0, std::max(0.0, sim_config_double("SIM_KOSYNC_FAIL_RATE", 0.0)));
+  s_config.failMode = sim_config_str("SIM_KOSYNC_FAIL", "refused");
+  s_config.dbPath = sim_config_str("SIM_KOSYNC_DB", nullptr);
+  s_config.autoRegister = sim_config_flag("SIM_KOSYNC_REGISTER", true);
+  load();
+
+  sim_http_register_handler(s_config.base + "/", serve);
+  std::atexit(report);
+  Serial.printf("[%lu] [KOSYNC] Local sync server at %s (latency %d ms)\n", millis(), s_config.base.c_str(),
+                s_config.latencyMs);
+}
@@ -0,0 +1,792 @@
+// Asynchronous log sink behind Serial. See sim_log.h.
+//
+// Producers claim slots of a bounded lock-free ring (Vyukov's sequence-number
+// queue) and copy in either raw text or a printf format string plus its
+// arguments, packed by walking the format string. Everything is copied, so
+// nothing the caller owns needs to outlive the call. The single writer thread
+// formats records in batches and writes each batch with one fwrite. It sleeps
+// on a condition variable when the ring is empty; producers only touch the
+// mutex to wake it, and only if it is actually asleep.
+
+#include "sim_log.h"
+
+#include "sim_config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t kSlotCount = 4096;  // power of two
+constexpr size_t kSlotBytes = 512;
+constexpr size_t kMaxLine = 1024;     // longest formatted line
+
+enum class RecordKind : uint8_t { Text, Deferred };
+
+// A Deferred payload is the NUL-terminated format string followed by the
+// packed arguments. droppedBefore is how many lines the ring dropped since
+// the previous record; the writer reports them ahead of this one.
+struct Slot {
+  std::atomic<uint64_t> seq;
+  uint32_t droppedBefore;
+  uint16_t len;
+  RecordKind kind;
+  uint8_t data[kSlotBytes - sizeof(std::atomic<uint64_t>) - 8];
+};
+constexpr size_t kPayloadBytes = sizeof(Slot::data);
+
+Slot s_slots[kSlotCount];
+std::atomic<uint64_t> s_tail{0};  // next position producers claim
+uint64_t s_head = 0;              // next position the writer reads
+std::atomic<uint64_t> s_written{0};
+std::atomic<uint64_t> s_dropped{0};  // drops not yet handed to a record
+
+// Writer thread state. Reinitialized in a forked child, which has no writer.
+std::mutex* s_mutex = new std::mutex();
+std::condition_variable* s_wake = new std::condition_variable();
+std::condition_variable* s_flushed = new std::condition_variable();
+std::atomic<bool> s_writerIdle{false};
+std::atomic<pid_t> s_writerPid{0};
+std::atomic<bool> s_stopping{false};
+std::atomic<bool> s_stopped{false};
+std::thread* s_writer = nullptr;
+
+FILE* s_binaryOut = nullptr;
+std::unordered_map<std::string, uint32_t> s_formatIds;  // writer thread only
+
+bool syncMode() {
+  static const bool sync = sim_config_flag("SIM_LOG_SYNC");
+  return sync;
+}
+
+// ---------------------------------------------------------------------------
+// Per-tag filtering
+// ---------------------------------------------------------------------------
+
+enum Level { kOff = 0, kError = 1, kWarn = 2, kInfo = 3 };
+
+struct Filter {
+  bool active = false;
+  int defaultLevel = kInfo;
+  std::vector<std::pair<std::string, int>> tags;
+};
+
+int parseLevel(const std::string& name) {
+  if (name == "off" || name == "none") return kOff;
+  if (name == "error" || name == "err") return kError;
+  if (name == "warn" || name == "warning") return kWarn;
+  return kInfo;
+}
+
+const Filter& filter() {
+  static const Filter f = [] {
+    Filter result;
+    const char* spec = sim_config_str("SIM_LOG", nullptr);
+    if (!spec) return result;
+    result.active = true;
+    std::string s(spec);
+    size_t start = 0;
+    while (start <= s.size()) {
+      size_t end = s.find(',', start);
+      if (end == std::string::npos) end = s.size();
+      const std::string item = s.substr(start, end - start);
+      const size_t eq = item.find_first_of("=:");
+      if (eq != std::string::npos) {
+        const std::string tag = item.substr(0, eq);
+        const int level = parseLevel(item.substr(eq + 1));
+        if (tag == "*")
+          result.defaultLevel = level;
+        else
+          result.tags.emplace_back(tag, level);
+      } else if (!item.empty()) {
+        result.defaultLevel = parseLevel(item);
+      }
+      start = end + 1;
+    }
+    return result;
+  }();
+  return f;
+}
+
+bool containsNoCase(const char* text, size_t len, const char* needle) {
+  const size_t n = strlen(needle);
+  for (size_t i = 0; i + n <= len; i++) {
+    size_t j = 0;
+    while (j < n && std::tolower(static_cast<unsigned char>(text[i + j])) == needle[j]) j++;
+    if (j == n) return true;
+  }
+  return false;
+}
+
+// Works on the format string as well as on formatted text: the tag is the
+// first bracket that is not a timestamp or conversion.
+bool allowed(const char* text, size_t len) {
+  const Filter& f = filter();
+  if (!f.active) return true;
+  int limit = f.defaultLevel;
+  for (size_t i = 0; i < len && i < 48; i++) {
+    if (text[i] != '[') continue;
+    const char* tag = text + i + 1;
+    const char* close = static_cast<const char*>(memchr(tag, ']', len - i - 1));
+    if (!close) break;
+    if (*tag == '%' || std::isdigit(static_cast<unsigned char>(*tag))) continue;
+    const size_t tagLen = static_cast<size_t>(close - tag);
+    for (const auto& rule : f.tags)
+      if (rule.first.size() == tagLen && memcmp(rule.first.data(), tag, tagLen) == 0) limit = rule.second;
+    break;
+  }
+  if (limit == kOff) return false;
+  int level = kInfo;
+  if (containsNoCase(text, len, "fail") || containsNoCase(text, len, "error"))
+    level = kError;
+  else if (containsNoCase(text, len, "warn"))
+    level = kWarn;
+  return level <= limit;
+}
+
+// ---------------------------------------------------------------------------
+// Format walking, shared by packing (caller) and rendering (writer, decoder)
+// ---------------------------------------------------------------------------
+
+struct Spec {
+  std::string flags;
+  std::string width;      // digits, "*" or empty
+  std::string precision;  // digits, "*" or empty (without the dot)
+  bool hasPrecision = false;
+  char length[3] = {};
+  char conv = 0;
+};
+
+// Parses the conversion after a '%'. Advances p past it.
+bool parseSpec(const char*& p, Spec& s) {
+  while (*p && strchr("-+ #0'", *p)) s.flags += *p++;
+  if (*p == '*') {
+    s.width = "*";
+    p++;
+  } else {
+    while (std::isdigit(static_cast<unsigned char>(*p))) s.width += *p++;
+  }
+  if (*p == '.') {
+    s.hasPrecision = true;
+    p++;
+    if (*p == '*') {
+      s.precision = "*";
+      p++;
+    } else {
+      while (std::isdigit(static_cast<unsigned char>(*p))) s.precision += *p++;
+    }
+  }
+  int n = 0;
+  while (*p && strchr("hlLqjzt", *p) && n < 2) s.length[n++] = *p++;
+  if (!*p) return false;
+  s.conv = *p++;
+  return true;
+}
+
+bool isSigned(char c) { return c == 'd' || c == 'i'; }
+bool isUnsigned(char c) { return c == 'u' || c == 'o' || c == 'x' || c == 'X'; }
+bool isFloat(char c) { return c && strchr("fFeEgGaA", c) != nullptr; }
+
+class Packer {
+ public:
+  Packer(uint8_t* out, size_t cap) : out_(out), cap_(cap) {}
+  template <typename T>
+  bool put(const T& v) {
+    if (len_ + sizeof(T) > cap_) return false;
+    memcpy(out_ + len_, &v, sizeof(T));
+    len_ += sizeof(T);
+    return true;
+  }
+  bool putBytes(const void* s, size_t n) {
+    if (len_ + n > cap_) return false;
+    memcpy(out_ + len_, s, n);
+    len_ += n;
+    return true;
+  }
+  bool putString(const char* s, size_t n) {
+    if (n > 0xFFFF || len_ + 2 + n > cap_) return false;
+    const auto n16 = static_cast<uint16_t>(n);
+    put(n16);
+    memcpy(out_ + len_, s, n);
+    len_ += n;
+    return true;
+  }
+  template <typename T>
+  T last() const {
+    T v;
+    memcpy(&v, out_ + len_ - sizeof(T), sizeof(T));
+    return v;
+  }
+  size_t size() const { return len_; }
+
+ private:
+  uint8_t* out_;
+  size_t cap_;
+  size_t len_ = 0;
+};
+
+// Copies the arguments fmt consumes into out. False for anything it cannot
+// defer (%n, wide strings, an oversized payload); the caller then formats now.
+bool packArgs(const char* fmt, va_list args, Packer& pk) {
+  for (const char* p = fmt; *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      p++;
+      continue;
+    }
+    Spec s;
+    if (!parseSpec(p, s)) return false;
+    if (s.width == "*" && !pk.put<int64_t>(va_arg(args, int))) return false;
+    if (s.precision == "*" && !pk.put<int64_t>(va_arg(args, int))) return false;
+    const std::string len(s.length);
+    bool ok;
+    if (isSigned(s.conv)) {
+      int64_t v;
+      if (len == "hh") v = static_cast<signed char>(va_arg(args, int));
+      else if (len == "h") v = static_cast<short>(va_arg(args, int));
+      else if (len == "l") v = va_arg(args, long);
+      else if (len == "ll" || len == "q") v = va_arg(args, long long);
+      else if (len == "z") v = static_cast<ssize_t>(va_arg(args, size_t));
+      else if (len == "j") v = va_arg(args, intmax_t);
+      else if (len == "t") v = va_arg(args, ptrdiff_t);
+      else v = va_arg(args, int);
+      ok = pk.put(v);
+    } else if (isUnsigned(s.conv)) {
+      uint64_t v;
+      if (len == "hh") v = static_cast<unsigned char>(va_arg(args, unsigned));
+      else if (len == "h") v = static_cast<unsigned short>(va_arg(args, unsigned));
+      else if (len == "l") v = va_arg(args, unsigned long);
+      else if (len == "ll" || len == "q") v = va_arg(args, unsigned long long);
+      else if (len == "z") v = va_arg(args, size_t);
+      else if (len == "j") v = va_arg(args, uintmax_t);
+      else if (len == "t") v = static_cast<uint64_t>(va_arg(args, ptrdiff_t));
+      else v = va_arg(args, unsigned);
+      ok = pk.put(v);
+    } else if (isFloat(s.conv)) {
+      ok = len == "L" ? pk.put(va_arg(args, long double)) : pk.put(va_arg(args, double));
+    } else if (s.conv == 'c' && len.empty()) {
+      ok = pk.put<int64_t>(va_arg(args, int));
+    } else if (s.conv == 's' && len.empty()) {
+      const char* str = va_arg(args, const char*);
+      if (!str) str = "(null)";
+      // Honour a precision: the argument need not be NUL-terminated.
+      size_t maxLen = SIZE_MAX;
+      if (s.precision == "*") {
+        const int64_t prec = pk.last<int64_t>();
+        if (prec >= 0) maxLen = static_cast<size_t>(prec);
+      } else if (s.hasPrecision) {
+        maxLen = strtoul(s.precision.c_str(), nullptr, 10);
+      }
+      ok = pk.putString(str, strnlen(str, std::min<size_t>(maxLen, kPayloadBytes)));
+    } else if (s.conv == 'p' && len.empty()) {
+      ok = pk.put(reinterpret_cast<uintptr_t>(va_arg(args, void*)));
+    } else {
+      return false;
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+class Reader {
+ public:
+  Reader(const uint8_t* in, size_t len) : in_(in), len_(len) {}
+  template <typename T>
+  bool get(T& v) {
+    if (pos_ + sizeof(T) > len_) return false;
+    memcpy(&v, in_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+  bool getString(const char*& s, size_t& n) {
+    uint16_t n16;
+    if (!get(n16) || pos_ + n16 > len_) return false;
+    s = reinterpret_cast<const char*>(in_ + pos_);
+    n = n16;
+    pos_ += n16;
+    return true;
+  }
+
+ private:
+  const uint8_t* in_;
+  size_t len_;
+  size_t pos_ = 0;
+};
+
+template <typename T>
+int formatOne(char* out, size_t cap, const char* spec, const int* stars, int starCount, T v) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+  switch (starCount) {
+    case 0: return snprintf(out, cap, spec, v);
+    case 1: return snprintf(out, cap, spec, stars[0], v);
+    default: return snprintf(out, cap, spec, stars[0], stars[1], v);
+  }
+#pragma GCC diagnostic pop
+}
+
+// Formats a deferred record into out (always NUL-terminated). Returns length.
+size_t renderDeferred(const char* fmt, const uint8_t* payload, size_t payloadLen, char* out,
+                      size_t cap) {
+  Reader rd(payload, payloadLen);
+  size_t n = 0;
+  auto append = [&](const char* s, size_t len) {
+    const size_t take = std::min(len, cap - 1 - n);
+    memcpy(out + n, s, take);
+    n += take;
+  };
+  auto appendFormatted = [&](int written) {
+    if (written > 0) n = std::min(n + static_cast<size_t>(written), cap - 1);
+  };
+  for (const char* p = fmt; *p && n < cap - 1;) {
+    if (*p != '%') {
+      const char* next = strchr(p, '%');
+      const size_t len = next ? static_cast<size_t>(next - p) : strlen(p);
+      append(p, len);
+      p += len;
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      append("%", 1);
+      p++;
+      continue;
+    }
+    Spec s;
+    if (!parseSpec(p, s)) break;
+    int stars[2];
+    int starCount = 0;
+    int64_t star;
+    if (s.width == "*") {
+      if (!rd.get(star)) break;
+      stars[starCount++] = static_cast<int>(star);
+    }
+    if (s.precision == "*") {
+      if (!rd.get(star)) break;
+      stars[starCount++] = static_cast<int>(star);
+    }
+    std::string spec = "%" + s.flags + s.width;
+    const std::string len(s.length);
+    char* dst = out + n;
+    const size_t room = cap - n;
+    if (s.conv == 's') {
+      const char* str;
+      size_t strLen;
+      if (!rd.getString(str, strLen)) break;
+      if (s.precision == "*") starCount--;  // replaced by the copied length
+      stars[starCount++] = static_cast<int>(strLen);
+      spec += ".*s";
+      appendFormatted(formatOne(dst, room, spec.c_str(), stars, starCount, str));
+      continue;
+    }
+    if (s.hasPrecision) spec += "." + s.precision;
+    if (isSigned(s.conv)) {
+      int64_t v;
+      if (!rd.get(v)) break;
+      spec += std::string("ll") + s.conv;
+      appendFormatted(formatOne(dst, room, spec.c_str(), stars, starCount, static_cast<long long>(v)));
+    } else if (isUnsigned(s.conv)) {
+      uint64_t v;
+      if (!rd.get(v)) break;
+      spec += std::string("ll") + s.conv;
+      appendFormatted(
+          formatOne(dst, room, spec.c_str(), stars, starCount, static_cast<unsigned long long>(v)));
+    } else if (isFloat(s.conv) && len == "L") {
+      long double v;
+      if (!rd.get(v)) break;
+      spec += std::string("L") + s.conv;
+      appendFormatted(formatOne(dst, room, spec.c_str(), stars, starCount, v));
+    } else if (isFloat(s.conv)) {
+      double v;
+      if (!rd.get(v)) break;
+      spec += s.conv;
+      appendFormatted(formatOne(dst, room, spec.c_str(), stars, starCount, v));
+    } else if (s.conv == 'c') {
+      int64_t v;
+      if (!rd.get(v)) break;
+      spec += 'c';
+      appendFormatted(formatOne(dst, room, spec.c_str(), stars, starCount, static_cast<int>(v)));
+    } else if (s.conv == 'p') {
+      uintptr_t v;
+      if (!rd.get(v)) break;
+      spec += 'p';
+      appendFormatted(
+          formatOne(dst, room, spec.c_str(), stars, starCount, reinterpret_cast<void*>(v)));
+    } else {
+      break;
+    }
+  }
+  out[n] = '\0';
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// Writer
+// ---------------------------------------------------------------------------
+
+void writeBinary(const void* data, size_t len) { fwrite(data, 1, len, s_binaryOut); }
+
+template <typename T>
+void writeBinaryValue(const T& v) {
+  writeBinary(&v, sizeof(v));
+}
+
+// Splits a Deferred payload into its format string and packed arguments.
+bool splitDeferred(const Slot& slot, const char*& fmt, const uint8_t*& args, size_t& argsLen) {
+  const void* nul = memchr(slot.data, '\0', slot.len);
+  if (!nul) return false;
+  fmt = reinterpret_cast<const char*>(slot.data);
+  args = static_cast<const uint8_t*>(nul) + 1;
+  argsLen = slot.len - static_cast<size_t>(args - slot.data);
+  return true;
+}
+
+void emitDropNote(uint64_t dropped, std::string& batch) {
+  char note[96];
+  const int n = snprintf(note, sizeof(note), "[LOG] %llu lines dropped (log ring full)\n",
+                         static_cast<unsigned long long>(dropped));
+  if (s_binaryOut) {
+    writeBinary("T", 1);
+    writeBinaryValue(static_cast<uint32_t>(n));
+    writeBinary(note, static_cast<size_t>(n));
+  } else {
+    batch.append(note, static_cast<size_t>(n));
+  }
+}
+
+// Appends one record to the batch (text) or straight to the binary file.
+void emitRecord(const Slot& slot, std::string& batch) {
+  const char* fmt = nullptr;
+  const uint8_t* args = nullptr;
+  size_t argsLen = 0;
+  const bool deferred = slot.kind == RecordKind::Deferred && splitDeferred(slot, fmt, args, argsLen);
+  if (s_binaryOut) {
+    if (!deferred) {
+      writeBinary("T", 1);
+      writeBinaryValue(static_cast<uint32_t>(slot.len));
+      writeBinary(slot.data, slot.len);
+      return;
+    }
+    // Each distinct format is written once; messages refer to it by id.
+    const auto known = s_formatIds.emplace(fmt, static_cast<uint32_t>(s_formatIds.size()));
+    const uint32_t id = known.first->second;
+    if (known.second) {
+      writeBinary("F", 1);
+      writeBinaryValue(id);
+      writeBinaryValue(static_cast<uint32_t>(strlen(fmt)));
+      writeBinary(fmt, strlen(fmt));
+    }
+    writeBinary("M", 1);
+    writeBinaryValue(id);
+    writeBinaryValue(static_cast<uint32_t>(argsLen));
+    writeBinary(args, argsLen);
+    return;
+  }
+  if (!deferred) {
+    if (slot.kind == RecordKind::Text) batch.append(reinterpret_cast<const char*>(slot.data), slot.len);
+    return;
+  }
+  char line[kMaxLine];
+  batch.append(line, renderDeferred(fmt, args, argsLen, line, sizeof(line)));
+}
+
+// Drains everything available. Returns false if the ring was empty.
+bool drainOnce(std::string& batch) {
+  bool any = false;
+  bool empty = false;
+  for (;;) {
+    Slot& slot = s_slots[s_head & (kSlotCount - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != s_head + 1) {
+      empty = true;
+      break;
+    }
+    if (slot.droppedBefore) emitDropNote(slot.droppedBefore, batch);
+    emitRecord(slot, batch);
+    slot.seq.store(s_head + kSlotCount, std::memory_order_release);
+    s_head++;
+    any = true;
+    if (batch.size() >= 64 * 1024) break;
+  }
+  // Drops no later line has claimed yet (the burst ended the log)
+  if (empty && s_dropped.load(std::memory_order_relaxed) != 0) {
+    emitDropNote(s_dropped.exchange(0, std::memory_order_relaxed), batch);
+  }
+  if (!batch.empty()) {
+    fwrite(batch.data(), 1, batch.size(), stdout);
+    batch.clear();
+  }
+  if (any) {
+    fflush(s_binaryOut ? s_binaryOut : stdout);
+    {
+      std::lock_guard<std::mutex> lock(*s_mutex);
+      s_written.store(s_head, std::memory_order_release);
+    }
+    s_flushed->notify_all();
+  }
+  return any;
+}
+
+void writerMain() {
+  std::string batch;
+  batch.reserve(64 * 1024);
+  for (;;) {
+    if (drainOnce(batch)) continue;
+    std::unique_lock<std::mutex> lock(*s_mutex);
+    s_writerIdle.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const Slot& next = s_slots[s_head & (kSlotCount - 1)];
+    if (next.seq.load(std::memory_order_acquire) != s_head + 1) {
+      if (s_stopping.load()) {
+        s_writerIdle.store(false);
+        return;
+      }
+      s_wake->wait_for(lock, std::chrono::milliseconds(100));
+    }
+    s_writerIdle.store(false);
+  }
+}
+
+void stopWriter() {
+  if (!s_writer) return;
+  sim_log_flush();
+  s_stopping.store(true);
+  {
+    std::lock_guard<std::mutex> lock(*s_mutex);
+    s_wake->notify_all();
+  }
+  s_writer->join();
+  s_stopped.store(true);  // later lines (other atexit handlers) are written inline
+  if (s_binaryOut) fclose(s_binaryOut);
+  s_binaryOut = nullptr;
+}
+
+void onForkChild() {
+  // The writer thread does not exist in the child and the mutex may have been
+  // held at fork time. Start over; the child starts its own writer on demand.
+  s_mutex = new std::mutex();
+  s_wake = new std::condition_variable();
+  s_flushed = new std::condition_variable();
+  s_writer = nullptr;
+  s_writerIdle.store(false);
+  s_writerPid.store(0);
+  s_written.store(s_head);
+}
+
+// Starts the writer on first use (and again in a forked child).
+bool ensureWriter() {
+  if (s_stopped.load() || syncMode()) return false;
+  const pid_t pid = getpid();
+  if (s_writerPid.load(std::memory_order_acquire) == pid) return true;
+  static std::mutex startMutex;
+  std::lock_guard<std::mutex> lock(startMutex);
+  if (s_writerPid.load() == pid) return true;
+  static bool registered = false;
+  if (!registered) {
+    registered = true;
+    pthread_atfork(nullptr, nullptr, onForkChild);
+    std::atexit(stopWriter);
+    for (size_t i = 0; i < kSlotCount; i++) s_slots[i].seq.store(i, std::memory_order_relaxed);
+    if (const char* path = sim_config_str("SIM_LOG_BINARY", nullptr)) {
+      s_binaryOut = fopen(path, "wb");
+      if (s_binaryOut) fwrite("SIMLOG1\n", 1, 8, s_binaryOut);
+      else fprintf(stderr, "[LOG] Could not open %s, logging text to stdout\n", path);
+    }
+  }
+  s_writer = new std::thread(writerMain);
+  s_writerPid.store(pid, std::memory_order_release);
+  return true;
+}
+
+// Claims a slot, or returns nullptr (and counts a drop) when the ring stays
+// full after giving the writer a couple of chances to run. A claimed slot
+// takes over the drops counted so far, so they are reported right before it.
+Slot* claim(uint64_t& pos) {
+  int fullRetries = 3;
+  pos = s_tail.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = s_slots[pos & (kSlotCount - 1)];
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    const auto diff = static_cast<int64_t>(seq - pos);
+    if (diff == 0) {
+      if (s_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        slot.droppedBefore = 0;
+        if (s_dropped.load(std::memory_order_relaxed) != 0) {
+          const uint64_t dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+          slot.droppedBefore = static_cast<uint32_t>(std::min<uint64_t>(dropped, UINT32_MAX));
+        }
+        return &slot;
+      }
+    } else if (diff < 0) {
+      if (fullRetries-- == 0) {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      std::this_thread::yield();
+      pos = s_tail.load(std::memory_order_relaxed);
+    } else {
+      pos = s_tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void publish(Slot& slot, uint64_t pos) {
+  slot.seq.store(pos + 1, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (s_writerIdle.load()) {
+    std::lock_guard<std::mutex> lock(*s_mutex);
+    s_wake->notify_one();
+  }
+}
+
+void enqueueText(const char* text, size_t len) {
+  while (len > 0) {
+    uint64_t pos;
+    Slot* slot = claim(pos);
+    if (!slot) return;
+    const size_t take = std::min(len, kPayloadBytes);
+    slot->kind = RecordKind::Text;
+    slot->len = static_cast<uint16_t>(take);
+    memcpy(slot->data, text, take);
+    publish(*slot, pos);
+    text += take;
+    len -= take;
+  }
+}
+
+thread_local std::string t_pendingLine;
+
+}  // namespace
+
+size_t sim_log_vprintf(const char* fmt, va_list args) {
+  const size_t fmtLen = strlen(fmt);
+  if (!allowed(fmt, fmtLen)) return 0;
+  if (!ensureWriter()) {
+    char buf[512];
+    const int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    if (n <= 0) return 0;
+    fwrite(buf, 1, std::min(static_cast<size_t>(n), sizeof(buf) - 1), stdout);
+    return static_cast<size_t>(n);
+  }
+
+  uint64_t pos;
+  Slot* slot = claim(pos);
+  if (!slot) return 0;
+  // A deferred line is not formatted yet, so its length is unknown: report
+  // the format string's, which is non-zero like any successful print
+  size_t result = fmtLen;
+  size_t len = 0;
+  Packer pk(slot->data, kPayloadBytes);
+  va_list packArgsCopy;
+  va_copy(packArgsCopy, args);
+  const bool deferred = pk.putBytes(fmt, fmtLen + 1) && packArgs(fmt, packArgsCopy, pk);
+  va_end(packArgsCopy);
+  if (deferred) {
+    slot->kind = RecordKind::Deferred;
+    len = pk.size();
+  } else {
+    const int n = vsnprintf(reinterpret_cast<char*>(slot->data), kPayloadBytes, fmt, args);
+    len = n > 0 ? std::min(static_cast<size_t>(n), kPayloadBytes - 1) : 0;
+    result = n > 0 ? static_cast<size_t>(n) : 0;
+    slot->kind = RecordKind::Text;
+  }
+  slot->len = static_cast<uint16_t>(len);
+  publish(*slot, pos);
+  return result;
+}
+
+void sim_log_write(const char* data, size_t len) {
+  std::string& line = t_pendingLine;
+  line.append(data, len);
+  size_t start = 0;
+  for (;;) {
+    const size_t nl = line.find('\n', start);
+    if (nl == std::string::npos) break;
+    const size_t lineLen = nl + 1 - start;
+    if (allowed(line.data() + start, lineLen)) {
+      if (ensureWriter())
+        enqueueText(line.data() + start, lineLen);
+      else
+        fwrite(line.data() + start, 1, lineLen, stdout);
+    }
+    start = nl + 1;
+  }
+  line.erase(0, start);
+  if (line.size() >= kPayloadBytes) {  // no newline coming soon; don't hoard
+    if (ensureWriter())
+      enqueueText(line.data(), line.size());
+    else
+      fwrite(line.data(), 1, line.size(), stdout);
+    line.clear();
+  }
+}
+
+void sim_log_flush() {
+  if (!t_pendingLine.empty()) {
+    const std::string rest = std::move(t_pendingLine);
+    t_pendingLine.clear();
+    if (ensureWriter())
+      enqueueText(rest.data(), rest.size());
+    else
+      fwrite(rest.data(), 1, rest.size(), stdout);
+  }
+  if (s_writerPid.load() != getpid() || !s_writer) {
+    fflush(stdout);
+    return;
+  }
+  const uint64_t target = s_tail.load();
+  std::unique_lock<std::mutex> lock(*s_mutex);
+  s_wake->notify_one();
+  // Dropped-on-full slots never advance s_tail, so target is always reachable.
+  s_flushed->wait_for(lock, std::chrono::seconds(2),
+                      [target] { return s_written.load(std::memory_order_acquire) >= target; });
+}
+
+bool sim_log_decode(const char* path) {
+  FILE* in = fopen(path, "rb");
+  if (!in) return false;
+  char magic[8];
+  if (fread(magic, 1, 8, in) != 8 || memcmp(magic, "SIMLOG1\n", 8) != 0) {
+    fclose(in);
+    return false;
+  }
+  std::vector<std::string> formats;  // indexed by id
+  std::vector<uint8_t> buf;
+  char line[kMaxLine];
+  char kind;
+  while (fread(&kind, 1, 1, in) == 1) {
+    uint32_t id = 0;
+    uint32_t len = 0;
+    if (kind != 'T' && fread(&id, sizeof(id), 1, in) != 1) break;
+    if (fread(&len, sizeof(len), 1, in) != 1) break;
+    buf.resize(len);
+    if (len && fread(buf.data(), 1, len, in) != len) break;
+    if (kind == 'T') {
+      fwrite(buf.data(), 1, len, stdout);
+    } else if (kind == 'F') {
+      if (formats.size() <= id) formats.resize(id + 1);
+      formats[id].assign(buf.begin(), buf.end());
+    } else if (kind == 'M') {
+      if (id >= formats.size()) continue;
+      fwrite(line, 1, renderDeferred(formats[id].c_str(), buf.data(), len, line, sizeof(line)), stdout);
+    } else {
+      break;
+    }
+  }
+  fclose(in);
+  return true;
+}
@@ -0,0 +1,146 @@
+// Socket helpers for the emulator's network stubs. See sim_net.h.
+
+#include "sim_net.h"
+
+#include "ArduinoStub.h"
+#include "sim_config.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS: SIGPIPE is ignored per socket instead
+#endif
+
+namespace {
+
+void makeNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+int listenOn(const char* address, uint16_t port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1 ||
+      bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+    const int err = errno;
+    ::close(fd);
+    errno = err;
+    return -1;
+  }
+  makeNonBlocking(fd);
+  return fd;
+}
+
+}  // namespace
+
+int sim_net_listen(uint16_t port, uint16_t& boundPort) {
+  const char* address = sim_config_str("SIM_WEB_BIND", "127.0.0.1");
+  // Farm instances (SIM_INSTANCES) each get their own block of SIM_PORT_STRIDE
+  // ports, wider than the gap between a device's servers (80 and 81)
+  const int stride = sim_config_int("SIM_PORT_STRIDE", 100);
+  const uint16_t wanted = static_cast<uint16_t>(port + stride * sim_config_int("SIM_INSTANCE", 0));
+  boundPort = wanted;
+  int fd = listenOn(address, wanted);
+  if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+    boundPort = static_cast<uint16_t>(wanted + sim_config_int("SIM_WEB_PORT_OFFSET", 8000));
+    fd = listenOn(address, boundPort);
+  }
+  if (fd < 0) {
+    Serial.printf("[%lu] [NET] Cannot listen on %s:%u: %s\n", millis(), address, boundPort, strerror(errno));
+    return -1;
+  }
+  if (boundPort != wanted)
+    Serial.printf("[%lu] [NET] Port %u needs privileges; listening on %s:%u instead\n", millis(), wanted, address,
+                  boundPort);
+  else if (wanted != port)
+    Serial.printf("[%lu] [NET] Port %u is listening on %s:%u for this instance\n", millis(), port, address, wanted);
+  return fd;
+}
+
+int sim_net_accept(int listenFd, std::string* peer) {
+  if (listenFd < 0) return -1;
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  const int fd = ::accept(listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+  if (fd < 0) return -1;
+  makeNonBlocking(fd);
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (peer) {
+    char buf[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf));
+    *peer = buf;
+  }
+  return fd;
+}
+
+bool sim_net_wait(int fd, short events, int timeoutMs) {
+  return (sim_task_wait_fd(fd, events, timeoutMs) & (events | POLLHUP | POLLERR)) != 0;
+}
+
+ssize_t sim_net_recv(int fd, void* buf, size_t cap) {
+  const ssize_t n = ::recv(fd, buf, cap, 0);
+  if (n >= 0) return n;
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? -2 : -1;
+}
+
+bool sim_net_send_all(int fd, const void* data, size_t len, int timeoutMs) {
+  const auto* p = static_cast<const uint8_t*>(data);
+  while (len > 0) {
+    const ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+    if (n > 0) {
+      p += n;
+      len -= static_cast<size_t>(n);
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      if (!sim_net_wait(fd, POLLOUT, timeoutMs)) return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void sim_net_close(int& fd) {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+}
+
+std::string sim_net_base64(const uint8_t* data, size_t len) {
+  static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < len; i += 3) {
+    const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out += kAlphabet[v >> 18];
+    out += kAlphabet[(v >> 12) & 63];
+    out += kAlphabet[(v >> 6) & 63];
+    out += kAlphabet[v & 63];
+  }
+  if (i < len) {
+    const uint32_t v = (data[i] << 16) | (i + 1 < len ? data[i + 1] << 8 : 0);
+    out += kAlphabet[v >> 18];
+    out += kAlphabet[(v >> 12) & 63];
+    out += i + 1 < len ? kAlphabet[(v >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
@@ -0,0 +1,179 @@
+// CPU-cost model for the emulator. See sim_profile.h.
+
+#include "sim_profile.h"
+
+#include "ArduinoStub.h"
+#include "sim_config.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<long long> g_simClockSkewUs{0};
+
+namespace {
+
+// CPU accounting for one task. In fiber mode several tasks share a host
+// thread, so a task's CPU time is what the thread used while it was switched in.
+struct CpuContext {
+  double baseMs = 0;        // CPU time banked before the last switch-in
+  double switchedInMs = 0;  // thread CPU time at the last switch-in
+  double chargedMs = 0;     // CPU time already turned into clock skew
+  double burstStartMs = 0;  // CPU time when the task was last switched in
+};
+
+struct Latency {
+  std::string activity;
+  unsigned long inputAt = 0;
+  bool pending = false;
+};
+
+bool s_enabled = false;
+double s_scale = 1.0;
+
+std::mutex s_mutex;  // guards s_samples and s_latency
+std::map<std::string, std::vector<float>> s_samples;  // estimated device ms
+std::map<std::string, std::vector<float>> s_latencies;
+Latency s_latency;
+
+thread_local CpuContext t_threadContext;
+thread_local CpuContext* t_context = &t_threadContext;
+std::unordered_map<const void*, CpuContext*> s_fiberContexts;  // firmware thread only
+
+double threadCpuMs() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+}
+
+double contextCpuMs(const CpuContext& ctx, double threadNowMs) {
+  return ctx.baseMs + (threadNowMs - ctx.switchedInMs);
+}
+
+// Moves the clock forward by the device time the CPU used since the last
+// charge would have taken on top of the host time.
+void charge(CpuContext& ctx, double cpuMs) {
+  const double delta = cpuMs - ctx.chargedMs;
+  ctx.chargedMs = cpuMs;
+  if (s_scale > 1.0 && delta > 0)
+    g_simClockSkewUs.fetch_add(static_cast<long long>(delta * (s_scale - 1.0) * 1e3),
+                               std::memory_order_relaxed);
+}
+
+void addSample(std::map<std::string, std::vector<float>>& into, const std::string& name, double ms) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  into[name].push_back(static_cast<float>(ms));
+}
+
+float percentile(std::vector<float>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  const size_t i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+void printTable(const char* title, std::map<std::string, std::vector<float>>& table) {
+  if (table.empty()) return;
+  Serial.printf("[%lu] [PROF] %-28s %8s %10s %9s %9s %9s\n", millis(), title, "count", "total ms",
+                "p50 ms", "p95 ms", "max ms");
+  for (auto& entry : table) {
+    std::vector<float>& v = entry.second;
+    std::sort(v.begin(), v.end());
+    double total = 0;
+    for (float ms : v) total += ms;
+    Serial.printf("[%lu] [PROF] %-28s %8zu %10.1f %9.2f %9.2f %9.2f\n", millis(), entry.first.c_str(),
+                  v.size(), total, percentile(v, 0.50), percentile(v, 0.95), v.back());
+  }
+}
+
+void report() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  Serial.printf("[%lu] [PROF] CPU cost at SIM_CPU_SCALE=%.1f (estimated device ms), clock skew %lld ms\n",
+                millis(), s_scale, g_simClockSkewUs.load() / 1000);
+  printTable("region", s_samples);
+  printTable("input -> refresh", s_latencies);
+  fflush(stdout);
+}
+
+}  // namespace
+
+void sim_profile_begin() {
+  static bool begun = false;
+  if (begun) return;
+  begun = true;
+  s_scale = std::max(1.0, sim_config_double("SIM_CPU_SCALE", 1.0));
+  s_enabled = sim_config_flag("SIM_PROFILE") || sim_config_str("SIM_CPU_SCALE", nullptr);
+  if (!s_enabled) return;
+  s_latency.activity = "-";
+  Serial.printf("[%lu] [PROF] CPU-cost model on, host-to-device scale %.1f\n", millis(), s_scale);
+  std::atexit(report);
+}
+
+bool sim_profile_enabled() { return s_enabled; }
+
+SimProfileScope::SimProfileScope(const char* region) : region_(region) {
+  if (!s_enabled) return;
+  startCpuMs_ = contextCpuMs(*t_context, threadCpuMs());
+  charge(*t_context, startCpuMs_);
+}
+
+SimProfileScope::~SimProfileScope() {
+  if (!s_enabled) return;
+  const double cpuMs = contextCpuMs(*t_context, threadCpuMs());
+  charge(*t_context, cpuMs);
+  addSample(s_samples, region_, (cpuMs - startCpuMs_) * s_scale);
+}
+
+void sim_profile_task_switch(const void* from, const char* fromName, const void* to) {
+  if (!s_enabled) return;
+  const double nowMs = threadCpuMs();
+
+  CpuContext& prev = *t_context;
+  s_fiberContexts.emplace(from, &prev);  // loopTask's context is the thread's own
+  const double prevCpuMs = contextCpuMs(prev, nowMs);
+  prev.baseMs = prevCpuMs;
+  charge(prev, prevCpuMs);
+  if (fromName && strcmp(fromName, "loopTask") != 0)
+    addSample(s_samples, std::string("task ") + fromName, (prevCpuMs - prev.burstStartMs) * s_scale);
+
+  CpuContext*& next = s_fiberContexts[to];
+  if (!next) next = new CpuContext();
+  next->switchedInMs = nowMs;
+  next->burstStartMs = next->baseMs;
+  t_context = next;
+}
+
+void sim_profile_task_end(const void* task) {
+  if (!s_enabled) return;
+  auto it = s_fiberContexts.find(task);
+  if (it == s_fiberContexts.end()) return;
+  if (it->second != &t_threadContext && it->second != t_context) delete it->second;
+  s_fiberContexts.erase(it);
+}
+
+void sim_profile_input() {
+  if (!s_enabled) return;
+  std::lock_guard<std::mutex> lock(s_mutex);
+  if (s_latency.pending) return;  // measure from the first unanswered press
+  s_latency.pending = true;
+  s_latency.inputAt = millis();
+}
+
+void sim_profile_refresh() {
+  if (!s_enabled) return;
+  std::lock_guard<std::mutex> lock(s_mutex);
+  if (!s_latency.pending) return;
+  s_latency.pending = false;
+  s_latencies[s_latency.activity].push_back(static_cast<float>(millis() - s_latency.inputAt));
+}
+
+void sim_profile_set_activity(const char* name) {
+  if (!s_enabled) return;
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_latency.activity = name ? name : "-";
+}
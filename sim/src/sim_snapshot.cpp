@@ -0,0 +1,171 @@
+// Fork-server snapshots of the emulated device (see sim_snapshot.h).
+
+#include "sim_snapshot.h"
+#include "ArduinoStub.h"
+#include "SdFat.h"
+#include "sim_config.h"
+#include "sim_display.h"
+#include "sim_gpio.h"
+#include "sim_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+void (*s_startPresenter)() = nullptr;
+
+std::vector<std::string> splitList(const char* list) {
+  std::vector<std::string> out;
+  std::string item;
+  for (const char* c = list;; ++c) {
+    if (*c == ',' || *c == '\0') {
+      if (!item.empty()) out.push_back(item);
+      item.clear();
+      if (*c == '\0') break;
+    } else if (*c != ' ') {
+      item += *c;
+    }
+  }
+  return out;
+}
+
+bool copyTree(const std::string& from, const std::string& to) {
+  struct stat st;
+  if (lstat(from.c_str(), &st) != 0) return false;
+  if (S_ISDIR(st.st_mode)) {
+    if (mkdir(to.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    DIR* d = opendir(from.c_str());
+    if (!d) return false;
+    bool ok = true;
+    for (dirent* e; ok && (e = readdir(d)) != nullptr;) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+      ok = copyTree(from + "/" + e->d_name, to + "/" + e->d_name);
+    }
+    closedir(d);
+    return ok;
+  }
+  FILE* in = fopen(from.c_str(), "rb");
+  if (!in) return false;
+  FILE* out = fopen(to.c_str(), "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  char buf[16384];
+  bool ok = true;
+  for (size_t n; ok && (n = fread(buf, 1, sizeof(buf), in)) > 0;) ok = fwrite(buf, 1, n, out) == n;
+  fclose(in);
+  return (fclose(out) == 0) && ok;
+}
+
+// In the forked copy: become run `index` of the snapshot.
+void resume(int index, const std::string& dir, const std::string& script, long long frozenUs) {
+  if (freopen((dir + "/serial.log").c_str(), "w", stdout)) dup2(fileno(stdout), STDERR_FILENO);
+  // millis() continues from the snapshot, however long this run waited to start
+  g_simClockSkewUs.fetch_sub(frozenUs);
+  // Later writes go to a copy of the overlay (or a fresh one over the card)
+  const std::string overlay = dir + "/overlay";
+  bool ok = FsFile::overlayPath().empty() ? mkdir(overlay.c_str(), 0755) == 0 || errno == EEXIST
+                                          : copyTree(FsFile::overlayPath(), overlay);
+  char resolved[PATH_MAX];
+  FsFile::setOverlayPath(realpath(overlay.c_str(), resolved) != nullptr ? resolved : overlay);
+  setenv("SIM_SNAPSHOT_RUN", std::to_string(index).c_str(), 1);
+  Serial.printf("[%lu] [SNAP] Resumed as run %d, overlay %s\n", millis(), index, FsFile::overlayPath().c_str());
+  ok = ok && sim_gpio_replace_script(script.c_str());
+  if (!ok) {
+    Serial.printf("[%lu] [SNAP] Could not set up run %d\n", millis(), index);
+    sim_log_flush();
+    std::_Exit(2);
+  }
+  sim_display_after_fork();
+  s_startPresenter();
+}
+
+// Waits for one run; returns 1 if it failed.
+int reap(const std::vector<pid_t>& pids) {
+  int status = 0;
+  pid_t pid;
+  while ((pid = wait(&status)) < 0 && errno == EINTR) {
+  }
+  if (pid < 0) return 0;
+  const size_t run = std::find(pids.begin(), pids.end(), pid) - pids.begin();
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    Serial.printf("[%lu] [SNAP] Run %zu finished\n", millis(), run);
+    return 0;
+  }
+  if (WIFSIGNALED(status)) {
+    Serial.printf("[%lu] [SNAP] Run %zu killed by signal %d\n", millis(), run, WTERMSIG(status));
+  } else {
+    Serial.printf("[%lu] [SNAP] Run %zu exited with %d\n", millis(), run, WEXITSTATUS(status));
+  }
+  return 1;
+}
+}  // namespace
+
+void sim_snapshot_begin(void (*startPresenter)()) { s_startPresenter = startPresenter; }
+
+void sim_snapshot_take() {
+  const char* list = sim_config_str("SIM_SNAPSHOT_RESUME", nullptr);
+  if (!list || !s_startPresenter) {
+    Serial.printf("[%lu] [SNAP] Snapshot point reached (SIM_SNAPSHOT_RESUME not set)\n", millis());
+    return;
+  }
+  // Thread mode tasks and a windowed SDL would not survive fork()
+  if (sim_config_int("SIM_CORES", 1) != 1 || !sim_display_headless()) {
+    Serial.printf("[%lu] [SNAP] Snapshots need SIM_CORES=1 and SDL_VIDEODRIVER=dummy; running on\n", millis());
+    return;
+  }
+  const std::vector<std::string> scripts = splitList(list);
+  const std::string base = sim_config_str("SIM_SNAPSHOT_DIR", "snapshot");
+  const int jobs = std::max(1, sim_config_int("SIM_SNAPSHOT_JOBS", static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN))));
+  mkdir(base.c_str(), 0755);
+  Serial.printf("[%lu] [SNAP] Snapshot taken; resuming %zu runs, %d at a time, in %s/\n", millis(), scripts.size(),
+                jobs, base.c_str());
+
+  // Nothing may hold a lock that only a thread missing from the copies could release
+  sim_display_park();
+  sim_log_flush();
+  fflush(stdout);
+  const auto frozenAt = std::chrono::steady_clock::now();
+
+  std::vector<pid_t> pids(scripts.size(), -1);
+  int running = 0;
+  int failed = 0;
+  for (size_t i = 0; i < scripts.size(); i++) {
+    for (; running >= jobs; running--) failed += reap(pids);
+    const std::string dir = base + "/" + std::to_string(i);
+    mkdir(dir.c_str(), 0755);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      const auto frozen = std::chrono::steady_clock::now() - frozenAt;
+      resume(static_cast<int>(i), dir, scripts[i],
+             std::chrono::duration_cast<std::chrono::microseconds>(frozen).count());
+      return;
+    }
+    if (pid < 0) {
+      Serial.printf("[%lu] [SNAP] fork failed for run %zu: %s\n", millis(), i, strerror(errno));
+      failed++;
+      continue;
+    }
+    pids[i] = pid;
+    running++;
+  }
+  for (; running > 0; running--) failed += reap(pids);
+
+  Serial.printf("[%lu] [SNAP] %zu of %zu runs finished cleanly\n", millis(), scripts.size() - failed,
+                scripts.size());
+  sim_log_flush();
+  fflush(stdout);
+  std::_Exit(failed == 0 ? 0 : 1);  // the frozen device itself never runs on
+}
@@ -1,6 +1,7 @@
 #include "SDCardManager.h"
 #include "ArduinoStub.h"
 #include "SdFat.h"
+#include "sim_config.h"
 #include "sim_spi_bus.h"
 #include "WString.h"
 
@@ -8,14 +9,166 @@
 #include <cerrno>
 #include <climits>
 #include <cstring>
+#include <ctime>
 #include <dirent.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 std::string FsFile::s_rootPath = "./sdcard";
+std::string FsFile::s_overlayPath;
+FsFile::WriteCloseObserver FsFile::s_writeCloseObserver = nullptr;
+
+namespace {
+// Copy-on-write overlay (SIM_OVERLAY). The card root becomes a read-only
+// lower layer and every write lands in the overlay directory, so farm
+// instances can share one library. Deleting something that exists below
+// leaves a ".wh.<name>" whiteout beside it in the overlay; a directory made
+// over a whiteout gets a ".wh..opq" marker that hides the layer below it.
+constexpr char kWhiteout[] = ".wh.";
+constexpr size_t kWhiteoutLen = sizeof(kWhiteout) - 1;
+constexpr char kOpaque[] = ".wh..opq";
+
+bool hasOverlay() { return !FsFile::overlayPath().empty(); }
+
+bool pathExists(const std::string& p) {
+  struct stat st;
+  return lstat(p.c_str(), &st) == 0;
+}
+
+bool isDirPath(const std::string& p) {
+  struct stat st;
+  return stat(p.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool touch(const std::string& p) {
+  FILE* f = fopen(p.c_str(), "wb");
+  if (!f) return false;
+  fclose(f);
+  return true;
+}
+
+// mkdir -p. Example: /a/b/c -> mkdir(/a), mkdir(/a/b), mkdir(/a/b/c)
+bool makeDirs(const std::string& full) {
+  const size_t start = (!full.empty() && full[0] == '/') ? 1 : 0;
+  for (size_t i = start; i <= full.size(); ++i) {
+    if (i == full.size() || full[i] == '/') {
+      if (i == 0) continue;
+      const std::string part = full.substr(0, i);
+      if (part.empty()) continue;
+      if (::mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    }
+  }
+  return true;
+}
+
+bool copyFile(const std::string& from, const std::string& to) {
+  FILE* in = fopen(from.c_str(), "rb");
+  if (!in) return false;
+  FILE* out = fopen(to.c_str(), "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  char buf[16384];
+  bool ok = true;
+  for (size_t n; ok && (n = fread(buf, 1, sizeof(buf), in)) > 0;) ok = fwrite(buf, 1, n, out) == n;
+  fclose(in);
+  return (fclose(out) == 0) && ok;
+}
+
+std::vector<std::string> splitPath(const char* path) {
+  std::vector<std::string> parts;
+  std::string part;
+  for (const char* c = path ? path : "";; ++c) {
+    if (*c == '/' || *c == '\0') {
+      if (!part.empty() && part != ".") parts.push_back(part);
+      part.clear();
+      if (*c == '\0') break;
+    } else {
+      part += *c;
+    }
+  }
+  return parts;
+}
+
+// Where a card path lives in each layer. inLower is only set while the
+// root-layer copy is visible, i.e. neither whited out nor under an opaque
+// overlay directory.
+struct Layers {
+  std::string overlay;
+  std::string lower;
+  bool inOverlay = false;
+  bool inLower = false;
+};
+
+Layers locate(const char* path) {
+  Layers l;
+  l.overlay = FsFile::overlayPath();
+  l.lower = FsFile::rootPath();
+  bool lowerVisible = true;
+  for (const std::string& part : splitPath(path)) {
+    if (lowerVisible && pathExists(l.overlay + "/" + kWhiteout + part)) lowerVisible = false;
+    l.overlay += "/" + part;
+    l.lower += "/" + part;
+    if (lowerVisible && pathExists(l.overlay + "/" + kOpaque)) lowerVisible = false;
+  }
+  l.inOverlay = pathExists(l.overlay);
+  l.inLower = lowerVisible && pathExists(l.lower);
+  return l;
+}
+
+// Creates the overlay directories above a card path (and the path itself when
+// it is a directory), clearing whiteouts on the way so the new entry shows.
+// Returns the path's overlay location.
+std::string prepareOverlay(const char* path, bool isDir) {
+  std::string dir = FsFile::overlayPath();
+  const std::vector<std::string> parts = splitPath(path);
+  for (size_t i = 0; i < parts.size(); i++) {
+    const std::string whiteout = dir + "/" + kWhiteout + parts[i];
+    const bool hidden = pathExists(whiteout);
+    if (hidden) ::remove(whiteout.c_str());
+    dir += "/" + parts[i];
+    if (i + 1 == parts.size() && !isDir) break;
+    if (::mkdir(dir.c_str(), 0755) == 0 && hidden) touch(dir + "/" + kOpaque);
+  }
+  return dir;
+}
+
+// Hides a card path's root-layer copy behind a whiteout.
+bool hideLower(const char* path) {
+  const std::string target = prepareOverlay(path, false);
+  const size_t slash = target.find_last_of('/');
+  return touch(target.substr(0, slash + 1) + kWhiteout + target.substr(slash + 1));
+}
+
+// rmdir for an overlay directory that may still hold whiteout markers.
+bool removeOverlayDir(const std::string& dir) {
+  std::vector<std::string> markers;
+  if (DIR* d = opendir(dir.c_str())) {
+    for (dirent* e; (e = readdir(d)) != nullptr;) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+      if (strncmp(e->d_name, kWhiteout, kWhiteoutLen) != 0) {
+        closedir(d);
+        errno = ENOTEMPTY;
+        return false;
+      }
+      markers.push_back(dir + "/" + e->d_name);
+    }
+    closedir(d);
+  }
+  for (const std::string& m : markers) ::remove(m.c_str());
+  return ::rmdir(dir.c_str()) == 0;
+}
+}  // namespace
 
 std::string FsFile::resolvePath(const char* path) {
+  if (hasOverlay()) {
+    // Reads find the top copy; write paths are created by prepareOverlay()
+    const Layers l = locate(path);
+    return !l.inOverlay && l.inLower ? l.lower : l.overlay;
+  }
   std::string p(path ? path : "");
   while (!p.empty() && p[0] == '/') p.erase(0, 1);
   if (p.empty()) return s_rootPath;
@@ -25,46 +178,71 @@ std::string FsFile::resolvePath(const char* path) {
 FsFile::FsFile(FsFile&& other) noexcept
     : fp_(other.fp_),
       dir_(other.dir_),
+      lowerDir_(other.lowerDir_),
       isDir_(other.isDir_),
+      written_(other.written_),
       dirPath_(std::move(other.dirPath_)),
+      lowerDirPath_(std::move(other.lowerDirPath_)),
+      logicalPath_(std::move(other.logicalPath_)),
       currentName_(std::move(other.currentName_)),
       filePath_(std::move(other.filePath_)) {
   other.fp_ = nullptr;
   other.dir_ = nullptr;
+  other.lowerDir_ = nullptr;
 }
 
 FsFile& FsFile::operator=(FsFile&& other) noexcept {
   close();
   fp_ = other.fp_;
   dir_ = other.dir_;
+  lowerDir_ = other.lowerDir_;
   isDir_ = other.isDir_;
+  written_ = other.written_;
   dirPath_ = std::move(other.dirPath_);
+  lowerDirPath_ = std::move(other.lowerDirPath_);
+  logicalPath_ = std::move(other.logicalPath_);
   currentName_ = std::move(other.currentName_);
   filePath_ = std::move(other.filePath_);
   other.fp_ = nullptr;
   other.dir_ = nullptr;
+  other.lowerDir_ = nullptr;
   return *this;
 }
 
 void FsFile::close() {
+  // Called before the bus is taken by open(), so the observer runs unlocked
+  const bool notify = fp_ && written_ && s_writeCloseObserver;
+  const std::string writtenPath = notify ? filePath_ : std::string();
+  closeLocked();
+  if (notify) s_writeCloseObserver(writtenPath);
+}
+
+void FsFile::closeLocked() {
   SpiBusGuard guard;
   if (fp_) {
     fclose(fp_);
     fp_ = nullptr;
   }
+  written_ = false;
   if (dir_) {
     closedir(static_cast<DIR*>(dir_));
     dir_ = nullptr;
   }
+  if (lowerDir_) {
+    closedir(static_cast<DIR*>(lowerDir_));
+    lowerDir_ = nullptr;
+  }
   isDir_ = false;
   dirPath_.clear();
+  lowerDirPath_.clear();
+  logicalPath_.clear();
   currentName_.clear();
   filePath_.clear();
 }
 
 bool FsFile::openFullPath(const char* fullPath, oflag_t oflag) {
-  SpiBusGuard guard;
   close();
+  SpiBusGuard guard;
   if (!fullPath) return false;
   struct stat st;
   if (stat(fullPath, &st) != 0) {
@@ -89,18 +267,53 @@ bool FsFile::openFullPath(const char* fullPath, oflag_t oflag) {
     dirPath_ = fullPath;
     return true;
   }
-  const char* mode = (oflag & O_RDWR) ? "wb+" : ((oflag & O_WRONLY) ? "wb" : "rb");
-  if ((oflag & O_CREAT) && (oflag & O_TRUNC)) mode = "wb";
-  if ((oflag & O_RDWR) && (oflag & O_CREAT)) mode = "wb+";
+  // As SdFat: an existing file keeps its contents unless O_TRUNC is given
+  const char* mode = "rb";
+  if (oflag & O_TRUNC) {
+    mode = (oflag & O_RDWR) ? "wb+" : "wb";
+  } else if (oflag & (O_WRONLY | O_RDWR)) {
+    mode = "rb+";
+  }
+  if (oflag & O_APPEND) mode = (oflag & O_RDWR) ? "ab+" : "ab";
   fp_ = fopen(fullPath, mode);
   if (fp_) filePath_ = fullPath;
   return fp_ != nullptr;
 }
 
 bool FsFile::open(const char* path, oflag_t oflag) {
+  close();
+  if (hasOverlay()) return openMerged(path, oflag);
   return openFullPath(resolvePath(path).c_str(), oflag);
 }
 
+// open() with an overlay: writes always go to the overlay, and a write open
+// without O_TRUNC first copies the card's file up so it keeps its contents;
+// reads take the top copy, and a directory present in both layers lists the
+// two merged.
+bool FsFile::openMerged(const char* path, oflag_t oflag) {
+  SpiBusGuard guard;
+  const Layers l = locate(path);
+  if (oflag & (O_WRONLY | O_RDWR)) {
+    const std::string target = prepareOverlay(path, false);
+    if (!(oflag & O_TRUNC) && !l.inOverlay && l.inLower && !isDirPath(l.lower) && !copyFile(l.lower, target))
+      return false;
+    return openFullPath(target.c_str(), oflag);
+  }
+  if (!l.inOverlay && !l.inLower) {
+    close();
+    return false;
+  }
+  if (!openFullPath((l.inOverlay ? l.overlay : l.lower).c_str(), oflag)) return false;
+  if (isDir_) {
+    logicalPath_ = path ? path : "";
+    if (l.inOverlay && l.inLower && isDirPath(l.lower)) {
+      lowerDir_ = opendir(l.lower.c_str());
+      lowerDirPath_ = l.lower;
+    }
+  }
+  return true;
+}
+
 int FsFile::read() {
   SpiBusGuard guard;
   if (!fp_) return -1;
@@ -124,11 +337,13 @@ int FsFile::read(uint8_t* buf, size_t size) {
 size_t FsFile::write(const uint8_t* buf, size_t size) {
   SpiBusGuard guard;
   if (!fp_) return 0;
+  written_ = true;
   return fwrite(buf, 1, size, fp_);
 }
 
 size_t FsFile::write(uint8_t c) {
   SpiBusGuard guard;
+  written_ = true;
   return fp_ && fputc(c, fp_) >= 0 ? 1 : 0;
 }
 
@@ -150,6 +365,7 @@ uint32_t FsFile::position() const {
 
 size_t FsFile::print(const String& s) {
   if (!fp_) return 0;
+  written_ = true;
   const char* c = s.c_str();
   size_t n = 0;
   while (*c) {
@@ -169,6 +385,7 @@ int FsFile::available() {
 
 void FsFile::rewindDirectory() {
   if (dir_) rewinddir(static_cast<DIR*>(dir_));
+  if (lowerDir_) rewinddir(static_cast<DIR*>(lowerDir_));
 }
 
 bool FsFile::getName(char* name, size_t size) const {
@@ -192,23 +409,64 @@ size_t FsFile::size() const {
   return sz >= 0 ? static_cast<size_t>(sz) : 0;
 }
 
+// Next visible entry of an open directory: the top half first, then entries
+// of a merged root-layer half that the overlay neither replaces nor whites out.
+const char* FsFile::nextEntryName() {
+  for (dirent* e; dir_ && (e = readdir(static_cast<DIR*>(dir_))) != nullptr;) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+    if (hasOverlay() && strncmp(e->d_name, kWhiteout, kWhiteoutLen) == 0) continue;
+    return e->d_name;
+  }
+  for (dirent* e; lowerDir_ && (e = readdir(static_cast<DIR*>(lowerDir_))) != nullptr;) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+    if (pathExists(dirPath_ + "/" + e->d_name) || pathExists(dirPath_ + "/" + kWhiteout + e->d_name)) continue;
+    return e->d_name;
+  }
+  return nullptr;
+}
+
 FsFile FsFile::openNextFile() {
-  if (!dir_) return FsFile();
-  struct dirent* ent = readdir(static_cast<DIR*>(dir_));
-  while (ent && (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0))
-    ent = readdir(static_cast<DIR*>(dir_));
-  if (!ent) return FsFile();
-  std::string fullPath = dirPath_ + "/" + ent->d_name;
+  const char* entry = nextEntryName();
+  if (!entry) return FsFile();
+  const std::string name(entry);
   FsFile next;
-  if (!next.openFullPath(fullPath.c_str(), O_RDONLY)) return FsFile();
-  next.setCurrentName(ent->d_name);
+  const bool opened = logicalPath_.empty() ? next.openFullPath((dirPath_ + "/" + name).c_str(), O_RDONLY)
+                                           : next.open((logicalPath_ + "/" + name).c_str(), O_RDONLY);
+  if (!opened) return FsFile();
+  next.setCurrentName(name);
   return next;
 }
 
+bool FsFile::getModifyDateTime(uint16_t* pdate, uint16_t* ptime) const {
+  struct stat st;
+  if (fp_ ? fstat(fileno(fp_), &st) != 0 : (dirPath_.empty() || stat(dirPath_.c_str(), &st) != 0)) return false;
+  struct tm t;
+  if (!localtime_r(&st.st_mtime, &t)) return false;
+  const int year = t.tm_year + 1900 < 1980 ? 0 : t.tm_year + 1900 - 1980;
+  if (pdate) *pdate = static_cast<uint16_t>(year << 9 | (t.tm_mon + 1) << 5 | t.tm_mday);
+  if (ptime) *ptime = static_cast<uint16_t>(t.tm_hour << 11 | t.tm_min << 5 | t.tm_sec / 2);
+  return true;
+}
+
 bool FsFile::rename(const char* newPath) {
   if (filePath_.empty() || !newPath) return false;
-  const std::string dest = resolvePath(newPath);
-  if (::rename(filePath_.c_str(), dest.c_str()) != 0) return false;
+  if (!hasOverlay()) {
+    const std::string dest = resolvePath(newPath);
+    if (::rename(filePath_.c_str(), dest.c_str()) != 0) return false;
+    filePath_ = dest;
+    return true;
+  }
+  const std::string dest = prepareOverlay(newPath, false);
+  const std::string overlayRoot = s_overlayPath + "/";
+  if (filePath_.compare(0, overlayRoot.size(), overlayRoot) == 0) {
+    const std::string source = filePath_.substr(overlayRoot.size());
+    if (::rename(filePath_.c_str(), dest.c_str()) != 0) return false;
+    if (locate(source.c_str()).inLower && !hideLower(source.c_str())) return false;
+  } else {
+    // Opened from the read-only card: copy up, then hide the original
+    const std::string source = filePath_.substr(s_rootPath.size());
+    if (!copyFile(filePath_, dest) || !hideLower(source.c_str())) return false;
+  }
   filePath_ = dest;
   return true;
 }
@@ -224,36 +482,48 @@ FsFile SdFat::open(const char* path, oflag_t oflag) {
 }
 
 bool SdFat::mkdir(const char* path, bool pFlag) {
+  if (hasOverlay()) {
+    const Layers l = locate(path);
+    if (l.inOverlay || l.inLower) return true;
+    return isDirPath(prepareOverlay(path, true));
+  }
   std::string full = FsFile::resolvePath(path);
   if (full.empty()) return false;
-  if (pFlag) {
-    // Create parent directories incrementally.
-    // Example: /a/b/c -> mkdir(/a), mkdir(/a/b), mkdir(/a/b/c)
-    const size_t start = (full[0] == '/') ? 1 : 0;
-    for (size_t i = start; i <= full.size(); ++i) {
-      if (i == full.size() || full[i] == '/') {
-        if (i == 0) continue;
-        const std::string part = full.substr(0, i);
-        if (part.empty()) continue;
-        if (::mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
-      }
-    }
-    return true;
-  }
+  if (pFlag) return makeDirs(full);
   return ::mkdir(full.c_str(), 0755) == 0 || errno == EEXIST;
 }
 
 bool SdFat::exists(const char* path) {
+  if (hasOverlay()) {
+    const Layers l = locate(path);
+    return l.inOverlay || l.inLower;
+  }
   std::string full = FsFile::resolvePath(path);
   struct stat st;
   return stat(full.c_str(), &st) == 0;
 }
 
 bool SdFat::remove(const char* path) {
+  if (hasOverlay()) {
+    const Layers l = locate(path);
+    if (l.inOverlay && ::remove(l.overlay.c_str()) != 0) return false;
+    if (l.inLower) return hideLower(path);
+    return l.inOverlay;
+  }
   return ::remove(FsFile::resolvePath(path).c_str()) == 0;
 }
 
 bool SdFat::rmdir(const char* path) {
+  if (hasOverlay()) {
+    const Layers l = locate(path);
+    if (l.inLower) {
+      FsFile dir = open(path, O_RDONLY);
+      if (!dir || !dir.isDirectory() || dir.openNextFile()) return false;
+    }
+    if (l.inOverlay && !removeOverlayDir(l.overlay)) return false;
+    if (l.inLower) return hideLower(path);
+    return l.inOverlay;
+  }
   return ::rmdir(FsFile::resolvePath(path).c_str()) == 0;
 }
 
@@ -264,7 +534,12 @@ SDCardManager::SDCardManager() = default;
 bool SDCardManager::begin() {
   // Use absolute path so directory listing works regardless of process cwd (e.g. when run from build/)
   char resolved[PATH_MAX];
-  if (realpath("./sdcard", resolved) != nullptr) {
+  if (const char* dir = sim_config_str("SIM_SDCARD", nullptr)) {
+    // Explicit card directory (e.g. a generated sample library for training runs)
+    const char* root = realpath(dir, resolved) != nullptr ? resolved : dir;
+    FsFile::setRootPath(root);
+    Serial.printf("[%lu] [SD] Sim SD card %s (SIM_SDCARD)\n", millis(), root);
+  } else if (realpath("./sdcard", resolved) != nullptr) {
     FsFile::setRootPath(resolved);
     Serial.printf("[%lu] [SD] Sim SD card %s\n", millis(), resolved);
   } else if (realpath("../sdcard", resolved) != nullptr) {
@@ -274,6 +549,13 @@ bool SDCardManager::begin() {
     FsFile::setRootPath("./sdcard");
     Serial.printf("[%lu] [SD] Sim SD card (./sdcard, realpath failed)\n", millis());
   }
+  if (const char* dir = sim_config_str("SIM_OVERLAY", nullptr)) {
+    // Copy-on-write layer, e.g. one per farm instance over a shared library
+    makeDirs(dir);
+    const char* overlay = realpath(dir, resolved) != nullptr ? resolved : dir;
+    FsFile::setOverlayPath(overlay);
+    Serial.printf("[%lu] [SD] Writes go to overlay %s (SIM_OVERLAY)\n", millis(), overlay);
+  }
   initialized = true;
   return initialized;
 }
@@ -0,0 +1,200 @@
+#include "sim_task_stack.h"
+
+#include "ArduinoStub.h"
+#include "sim_config.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+namespace {
+
+// Tasks call into the host's libc and sockets (stdio formatting, getaddrinfo
+// in sim_http), which need far more stack than their ESP-IDF counterparts
+// whatever the task's own frames take. So no task gets less than this on the
+// host. Only touched pages cost memory.
+constexpr size_t kMinHostBytes = 256 * 1024;
+
+// This thread's alternate signal stack (malloc'd), freed when the thread ends
+thread_local void* t_altStack = nullptr;
+
+constexpr int kGuardSlots = 128;
+
+// Guard pages of live stacks, read by the signal handler. A slot is in use
+// while `hi` is non-zero.
+struct GuardSlot {
+  std::atomic<uintptr_t> lo{0};
+  std::atomic<uintptr_t> hi{0};
+  char name[32] = {};
+};
+
+GuardSlot s_guards[kGuardSlots];
+std::atomic<bool> s_handlerInstalled{false};
+struct sigaction s_previousAction;
+
+size_t pageSize() {
+  static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return page;
+}
+
+// Headroom for the host allocation only
+int stackScale() {
+  static const int scale = std::max(1, sim_config_int("SIM_STACK_SCALE", 16));
+  return scale;
+}
+
+// Host bytes per device byte when estimating device usage. x86-64 frames run
+// about twice RV32's; erring low over-reports, the safe side for sizing.
+int frameRatio() {
+  static const int ratio = std::max(1, sim_config_int("SIM_STACK_FRAME_RATIO", 2));
+  return ratio;
+}
+
+size_t deviceEstimate(size_t hostBytes) { return (hostBytes + frameRatio() - 1) / frameRatio(); }
+
+int claimGuardSlot(uintptr_t lo, uintptr_t hi, const char* name) {
+  for (int i = 0; i < kGuardSlots; i++) {
+    uintptr_t expected = 0;
+    if (!s_guards[i].hi.compare_exchange_strong(expected, hi)) continue;
+    strncpy(s_guards[i].name, name ? name : "", sizeof(s_guards[i].name) - 1);
+    s_guards[i].name[sizeof(s_guards[i].name) - 1] = '\0';
+    s_guards[i].lo.store(lo);
+    return i;
+  }
+  return -1;  // still guarded by the kernel, just reported anonymously
+}
+
+// Async-signal-safe output helpers.
+void writeStr(const char* s) {
+  const ssize_t ignored = write(STDERR_FILENO, s, strlen(s));
+  (void)ignored;
+}
+
+void onSegv(int sig, siginfo_t* info, void* uctx) {
+  const auto addr = reinterpret_cast<uintptr_t>(info->si_addr);
+  for (const GuardSlot& g : s_guards) {
+    const uintptr_t lo = g.lo.load();
+    if (g.hi.load() != 0 && addr >= lo && addr < g.hi.load()) {
+      writeStr("[RTOS] Stack overflow in task '");
+      writeStr(g.name);
+      writeStr("': hit the guard page. Raise its xTaskCreate() stack size or SIM_STACK_SCALE.\n");
+      break;
+    }
+  }
+  // Hand the fault to whoever had it before (default: terminate with a core).
+  if (s_previousAction.sa_flags & SA_SIGINFO) {
+    if (s_previousAction.sa_sigaction) {
+      s_previousAction.sa_sigaction(sig, info, uctx);
+      return;
+    }
+  } else if (s_previousAction.sa_handler != SIG_DFL && s_previousAction.sa_handler != SIG_IGN) {
+    s_previousAction.sa_handler(sig);
+    return;
+  }
+  signal(sig, SIG_DFL);  // the faulting instruction re-runs and kills the process
+}
+
+}  // namespace
+
+bool sim_stack_alloc(SimTaskStack& stack, unsigned deviceBytes, const char* taskName) {
+  const size_t page = pageSize();
+  size_t bytes = std::max(static_cast<size_t>(deviceBytes) * stackScale(), kMinHostBytes);
+  bytes = (bytes + page - 1) / page * page;
+  void* mem = mmap(nullptr, bytes + page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED) return false;
+  if (mprotect(mem, page, PROT_NONE) != 0) {
+    munmap(mem, bytes + page);
+    return false;
+  }
+  stack.map = mem;
+  stack.mapBytes = bytes + page;
+  stack.base = static_cast<uint8_t*>(mem) + page;
+  stack.bytes = bytes;
+  stack.deviceBytes = deviceBytes;
+  const auto lo = reinterpret_cast<uintptr_t>(mem);
+  stack.guardSlot = claimGuardSlot(lo, lo + page, taskName);
+  return true;
+}
+
+void sim_stack_free(SimTaskStack& stack) {
+  if (!stack.map) return;
+  if (stack.guardSlot >= 0) {
+    s_guards[stack.guardSlot].lo.store(0);
+    s_guards[stack.guardSlot].hi.store(0);
+  }
+  munmap(stack.map, stack.mapBytes);
+  stack = SimTaskStack();
+}
+
+size_t sim_stack_peak_bytes(const SimTaskStack& stack) {
+  if (!stack.base) return 0;
+  // The stack grows down, so untouched pages sit at the low end. Every page
+  // from the lowest resident one up counts as used: a frame that only holds
+  // zeros still touched its page. Rounds up to a page, never down.
+  const size_t page = pageSize();
+  size_t untouched = 0;
+#if defined(__APPLE__)
+  std::vector<char> resident(stack.bytes / page);
+#else
+  std::vector<unsigned char> resident(stack.bytes / page);
+#endif
+  if (mincore(stack.base, stack.bytes, resident.data()) != 0) return stack.bytes;
+  while (untouched < stack.bytes && !(resident[untouched / page] & 1)) untouched += page;
+  return stack.bytes - untouched;
+}
+
+unsigned sim_stack_high_water_mark(const SimTaskStack& stack) {
+  const size_t deviceUsed = deviceEstimate(sim_stack_peak_bytes(stack));
+  return deviceUsed >= stack.deviceBytes ? 0 : static_cast<unsigned>(stack.deviceBytes - deviceUsed);
+}
+
+void sim_stack_report(const SimTaskStack& stack, const char* taskName) {
+  if (!stack.base) return;
+  const size_t peak = sim_stack_peak_bytes(stack);
+  const size_t deviceUsed = deviceEstimate(peak);
+  Serial.printf("[%lu] [RTOS] Task '%s' stack peak: %zu host bytes, ~%zu of %u device bytes%s\n",
+                millis(), taskName ? taskName : "", peak, deviceUsed, stack.deviceBytes,
+                deviceUsed > stack.deviceBytes ? " (WOULD OVERFLOW ON DEVICE)" : "");
+}
+
+void sim_stack_install_guard_handler() {
+  if (!t_altStack) {
+    const size_t altBytes = std::max<size_t>(SIGSTKSZ, 64 * 1024);
+    stack_t alt{};
+    alt.ss_sp = malloc(altBytes);
+    alt.ss_size = altBytes;
+    if (alt.ss_sp && sigaltstack(&alt, nullptr) == 0) {
+      t_altStack = alt.ss_sp;
+    } else {
+      free(alt.ss_sp);
+    }
+  }
+
+  bool expected = false;
+  if (!s_handlerInstalled.compare_exchange_strong(expected, true)) return;
+  struct sigaction action{};
+  action.sa_sigaction = onSegv;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &s_previousAction);
+}
+
+void sim_stack_release_guard_handler() {
+  if (!t_altStack) return;
+  stack_t alt{};
+  alt.ss_flags = SS_DISABLE;
+  sigaltstack(&alt, nullptr);
+  free(t_altStack);
+  t_altStack = nullptr;
+}
@@ -0,0 +1,610 @@
+// WebServer for the emulator: HTTP/1.1 on a host socket. See WebServer.h.
+
+#include "WebServer.h"
+
+#include <HardwareSerial.h>
+
+#include "sim_config.h"
+#include "sim_net.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Pairs = std::vector<std::pair<std::string, std::string>>;
+
+constexpr int kIdleTimeoutMs = 5000;  // HTTP_MAX_DATA_WAIT on the device
+constexpr int kReadTimeoutMs = 5000;
+constexpr size_t kMaxHeaderBytes = 16 * 1024;
+constexpr size_t kBufferBytes = 64 * 1024;
+constexpr long long kSlowRequestMs = 100;
+
+long long msSince(Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t).count();
+}
+
+bool equalsNoCase(const std::string& a, const char* b) {
+  const size_t n = strlen(b);
+  if (a.size() != n) return false;
+  for (size_t i = 0; i < n; i++)
+    if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) return false;
+  return true;
+}
+
+const std::string* find(const Pairs& pairs, const char* name) {
+  for (const auto& p : pairs)
+    if (equalsNoCase(p.first, name)) return &p.second;
+  return nullptr;
+}
+
+std::string urlDecode(const std::string& s, bool plusIsSpace = true) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '+' && plusIsSpace) {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size() && isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+               isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+      out += static_cast<char>(strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+void parseQuery(const std::string& query, Pairs& args) {
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos) amp = query.size();
+    const std::string item = query.substr(pos, amp - pos);
+    if (!item.empty()) {
+      const size_t eq = item.find('=');
+      args.emplace_back(urlDecode(item.substr(0, eq)), eq == std::string::npos ? "" : urlDecode(item.substr(eq + 1)));
+    }
+    pos = amp + 1;
+  }
+}
+
+// Value of `key="..."` (or key=token) in a header such as Content-Disposition.
+std::string headerParam(const std::string& header, const char* key) {
+  const std::string needle = std::string(key) + "=";
+  size_t p = 0;
+  while ((p = header.find(needle, p)) != std::string::npos) {
+    if (p == 0 || header[p - 1] == ' ' || header[p - 1] == ';') break;
+    p += needle.size();
+  }
+  if (p == std::string::npos) return "";
+  p += needle.size();
+  if (p < header.size() && header[p] == '"') {
+    const size_t end = header.find('"', p + 1);
+    return header.substr(p + 1, end == std::string::npos ? std::string::npos : end - p - 1);
+  }
+  return header.substr(p, header.find(';', p) - p);
+}
+
+const char* reason(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 507: return "Insufficient Storage";
+    default: return "";
+  }
+}
+
+// Buffered request reader. Body bytes are paced to SIM_WEB_KBPS and never
+// read past Content-Length.
+class Input {
+ public:
+  explicit Input(int fd) : fd_(fd), buf_(kBufferBytes) {
+    static const double bytesPerMs = std::max(0, sim_config_int("SIM_WEB_KBPS", 0)) * 1024.0 / 1000.0;
+    bytesPerMs_ = bytesPerMs;
+  }
+
+  const uint8_t* data() const { return buf_.data() + start_; }
+  size_t size() const { return end_ - start_; }
+  void consume(size_t n) { start_ += std::min(n, size()); }
+
+  // Switches to body mode: `length` bytes follow the headers already consumed.
+  void beginBody(int64_t length) {
+    inBody_ = true;
+    bodyLeft_ = length - static_cast<int64_t>(size());
+    bodyStart_ = Clock::now();
+  }
+
+  // Reads more bytes. False on EOF, error, timeout or the end of the body.
+  bool fill() {
+    if (inBody_ && bodyLeft_ <= 0) return false;
+    if (start_ > 0 && (end_ == buf_.size() || start_ == end_)) {
+      memmove(buf_.data(), buf_.data() + start_, end_ - start_);
+      end_ -= start_;
+      start_ = 0;
+    }
+    size_t cap = buf_.size() - end_;
+    if (inBody_) cap = std::min(cap, static_cast<size_t>(bodyLeft_));
+    if (cap == 0) return false;
+    for (;;) {
+      const ssize_t n = sim_net_recv(fd_, buf_.data() + end_, cap);
+      if (n > 0) {
+        end_ += static_cast<size_t>(n);
+        if (inBody_) {
+          bodyLeft_ -= n;
+          pace(static_cast<size_t>(n));
+        }
+        return true;
+      }
+      if (n != -2 || !sim_net_wait(fd_, POLLIN, kReadTimeoutMs)) return false;
+    }
+  }
+
+  // Discards the rest of the body so the response is not sent mid-upload.
+  void drain() {
+    start_ = end_ = 0;
+    while (bodyLeft_ > 0 && fill()) start_ = end_ = 0;
+  }
+
+ private:
+  void pace(size_t bytes) {
+    if (bytesPerMs_ <= 0) return;
+    paced_ += bytes;
+    const auto due = bodyStart_ + std::chrono::microseconds(static_cast<int64_t>(paced_ / bytesPerMs_ * 1000));
+    const auto now = Clock::now();
+    if (due > now)
+      sim_task_delay(static_cast<unsigned long>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1));
+  }
+
+  int fd_;
+  std::vector<uint8_t> buf_;
+  size_t start_ = 0;
+  size_t end_ = 0;
+  bool inBody_ = false;
+  int64_t bodyLeft_ = 0;
+  Clock::time_point bodyStart_;
+  double bytesPerMs_ = 0;
+  double paced_ = 0;
+};
+
+struct Route {
+  std::string path;
+  int method;
+  WebServer::THandlerFunction fn;
+  WebServer::THandlerFunction uploadFn;
+};
+
+}  // namespace
+
+struct WebServer::Impl {
+  uint16_t port;
+  int listenFd = -1;
+  int fd = -1;  // connection being served or waited on
+  Clock::time_point acceptedAt;
+  std::vector<Route> routes;
+  THandlerFunction notFound;
+
+  // Current request
+  HTTPMethod method = HTTP_GET;
+  std::string uri;
+  Pairs args;
+  Pairs headers;
+  HTTPUpload upload;
+  uint8_t uploadBuf[HTTP_UPLOAD_BUFLEN];  // upload.buf
+
+  // Current response
+  bool headersSent = false;
+  bool chunked = false;
+  long long contentLength = CONTENT_LENGTH_NOT_SET;
+  std::string extraHeaders;
+
+  bool readHead(Input& in, std::string& head);
+  void serve();
+  void readMultipart(Input& in, const std::string& boundary, const Route* route);
+  void emitUpload(const Route* route, int status);
+  void finish();
+};
+
+namespace {
+
+// Totals across server instances (activities recreate theirs), for the exit report.
+struct Totals {
+  unsigned long requests = 0;
+  unsigned long long uploadedBytes = 0;
+  long long longestMs = 0;
+  std::string longestRequest;
+};
+Totals s_totals;
+
+void report() {
+  if (s_totals.requests == 0) return;
+  Serial.printf("[%lu] [WEB] Served %lu requests, %.1f MB uploaded; longest handleClient() %lld ms (%s)\n", millis(),
+                s_totals.requests, s_totals.uploadedBytes / (1024.0 * 1024.0), s_totals.longestMs,
+                s_totals.longestRequest.c_str());
+}
+
+}  // namespace
+
+bool WebServer::Impl::readHead(Input& in, std::string& head) {
+  for (;;) {
+    const auto* begin = reinterpret_cast<const char*>(in.data());
+    const char* end = static_cast<const char*>(memmem(begin, in.size(), "\r\n\r\n", 4));
+    if (end) {
+      head.assign(begin, end - begin);
+      in.consume(end - begin + 4);
+      return true;
+    }
+    if (in.size() > kMaxHeaderBytes || !in.fill()) return false;
+  }
+}
+
+void WebServer::Impl::emitUpload(const Route* route, int status) {
+  upload.status = status;
+  upload.buf = uploadBuf;
+  upload.size = upload.totalSize + upload.currentSize;
+  if (route && route->uploadFn) route->uploadFn();
+}
+
+// Streams multipart/form-data: file parts go to the upload handler in
+// HTTP_UPLOAD_BUFLEN pieces, other fields become args.
+void WebServer::Impl::readMultipart(Input& in, const std::string& boundary, const Route* route) {
+  const std::string first = "--" + boundary;
+  const std::string delim = "\r\n--" + boundary;
+  auto findIn = [&in](const std::string& needle) -> long {
+    const void* hit = memmem(in.data(), in.size(), needle.data(), needle.size());
+    return hit ? static_cast<const uint8_t*>(hit) - in.data() : -1;
+  };
+
+  long at;
+  while ((at = findIn(first)) < 0) {
+    if (!in.fill()) return;
+  }
+  in.consume(static_cast<size_t>(at) + first.size());
+
+  for (;;) {
+    // "--" ends the form, CRLF starts another part.
+    while (in.size() < 2)
+      if (!in.fill()) return;
+    if (in.data()[0] == '-' && in.data()[1] == '-') return;
+    in.consume(2);
+
+    std::string partHead;
+    if (!readHead(in, partHead)) return;
+    std::string disposition, type;
+    size_t pos = 0;
+    while (pos < partHead.size()) {
+      size_t eol = partHead.find("\r\n", pos);
+      if (eol == std::string::npos) eol = partHead.size();
+      const std::string line = partHead.substr(pos, eol - pos);
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        const std::string value = line.substr(line.find_first_not_of(' ', colon + 1));
+        if (equalsNoCase(line.substr(0, colon), "Content-Disposition")) disposition = value;
+        if (equalsNoCase(line.substr(0, colon), "Content-Type")) type = value;
+      }
+      pos = eol + 2;
+    }
+    const std::string name = headerParam(disposition, "name");
+    const bool isFile = disposition.find("filename=") != std::string::npos;
+
+    std::string field;
+    if (isFile) {
+      upload.filename = String(headerParam(disposition, "filename"));
+      upload.name = String(name);
+      upload.type = String(type.empty() ? "application/octet-stream" : type);
+      upload.totalSize = 0;
+      upload.currentSize = 0;
+      emitUpload(route, UPLOAD_FILE_START);
+    }
+    auto emit = [&](const uint8_t* p, size_t n) {
+      if (!isFile) {
+        field.append(reinterpret_cast<const char*>(p), n);
+        return;
+      }
+      while (n > 0) {
+        const size_t take = std::min(n, sizeof(uploadBuf) - upload.currentSize);
+        memcpy(uploadBuf + upload.currentSize, p, take);
+        upload.currentSize += take;
+        p += take;
+        n -= take;
+        if (upload.currentSize == sizeof(uploadBuf)) {
+          emitUpload(route, UPLOAD_FILE_WRITE);
+          upload.totalSize += upload.currentSize;
+          upload.currentSize = 0;
+        }
+      }
+    };
+
+    // Part data runs up to the next delimiter; keep a delimiter's worth of
+    // bytes back until we know it is not the start of one.
+    for (;;) {
+      at = findIn(delim);
+      if (at >= 0) {
+        emit(in.data(), static_cast<size_t>(at));
+        in.consume(static_cast<size_t>(at) + delim.size());
+        break;
+      }
+      if (in.size() >= delim.size()) {
+        const size_t safe = in.size() - (delim.size() - 1);
+        emit(in.data(), safe);
+        in.consume(safe);
+      }
+      if (!in.fill()) {
+        if (isFile) {
+          Serial.printf("[%lu] [WEB] Upload '%s' aborted after %zu bytes\n", millis(), upload.filename.c_str(),
+                        upload.totalSize + upload.currentSize);
+          emitUpload(route, UPLOAD_FILE_ABORTED);
+        }
+        return;
+      }
+    }
+
+    if (isFile) {
+      if (upload.currentSize > 0) {
+        emitUpload(route, UPLOAD_FILE_WRITE);
+        upload.totalSize += upload.currentSize;
+        upload.currentSize = 0;
+      }
+      emitUpload(route, UPLOAD_FILE_END);
+      s_totals.uploadedBytes += upload.totalSize;
+    } else {
+      args.emplace_back(name, field);
+    }
+  }
+}
+
+void WebServer::Impl::serve() {
+  const auto start = Clock::now();
+  Input in(fd);
+  std::string head;
+  if (!readHead(in, head)) return;
+
+  method = HTTP_GET;
+  uri.clear();
+  args.clear();
+  headers.clear();
+  headersSent = false;
+  chunked = false;
+  contentLength = CONTENT_LENGTH_NOT_SET;
+  extraHeaders.clear();
+
+  const size_t lineEnd = head.find("\r\n");
+  const std::string requestLine = head.substr(0, lineEnd);
+  const size_t sp1 = requestLine.find(' ');
+  const size_t sp2 = requestLine.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos) return;
+  const std::string verb = requestLine.substr(0, sp1);
+  const std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+  method = verb == "POST" ? HTTP_POST : verb == "PUT" ? HTTP_PUT : verb == "DELETE" ? HTTP_DELETE : HTTP_GET;
+  const size_t q = target.find('?');
+  uri = urlDecode(target.substr(0, q), false);
+  if (q != std::string::npos) parseQuery(target.substr(q + 1), args);
+
+  size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+  while (pos < head.size()) {
+    size_t eol = head.find("\r\n", pos);
+    if (eol == std::string::npos) eol = head.size();
+    const std::string line = head.substr(pos, eol - pos);
+    const size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      const size_t v = line.find_first_not_of(' ', colon + 1);
+      headers.emplace_back(line.substr(0, colon), v == std::string::npos ? "" : line.substr(v));
+    }
+    pos = eol + 2;
+  }
+
+  const Route* route = nullptr;
+  for (const Route& r : routes) {
+    if (r.path == uri && (r.method == HTTP_ANY || r.method == method)) {
+      route = &r;
+      break;
+    }
+  }
+
+  const std::string* expect = find(headers, "Expect");
+  if (expect && equalsNoCase(*expect, "100-continue")) {
+    static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    sim_net_send_all(fd, kContinue, sizeof(kContinue) - 1);
+  }
+  const std::string* lengthHeader = find(headers, "Content-Length");
+  const int64_t length = lengthHeader ? strtoll(lengthHeader->c_str(), nullptr, 10) : 0;
+  in.beginBody(length);
+  if (length > 0) {
+    const std::string* typeHeader = find(headers, "Content-Type");
+    const std::string contentType = typeHeader ? *typeHeader : "";
+    if (contentType.compare(0, 19, "multipart/form-data") == 0) {
+      readMultipart(in, headerParam(contentType, "boundary"), route);
+    } else {
+      std::string body(reinterpret_cast<const char*>(in.data()), in.size());
+      in.consume(in.size());
+      while (in.fill()) {
+        body.append(reinterpret_cast<const char*>(in.data()), in.size());
+        in.consume(in.size());
+      }
+      if (contentType.compare(0, 33, "application/x-www-form-urlencoded") == 0) parseQuery(body, args);
+      args.emplace_back("plain", body);
+    }
+  }
+  in.drain();
+
+  if (route) {
+    route->fn();
+  } else if (notFound) {
+    notFound();
+  } else {
+    const std::string body = "Not found: " + uri;
+    const std::string response = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: " +
+                                 std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    sim_net_send_all(fd, response.data(), response.size());
+  }
+  finish();
+
+  s_totals.requests++;
+  const long long elapsed = msSince(start);
+  if (elapsed > s_totals.longestMs) {
+    s_totals.longestMs = elapsed;
+    s_totals.longestRequest = verb + " " + uri;
+  }
+  if (elapsed >= kSlowRequestMs) {
+    const double mb = length / (1024.0 * 1024.0);
+    Serial.printf("[%lu] [WEB] %s %s held handleClient() for %lld ms (%.1f MB, %.1f MB/s)\n", millis(),
+                  verb.c_str(), uri.c_str(), elapsed, mb, elapsed > 0 ? mb * 1000.0 / elapsed : 0.0);
+  }
+}
+
+// Terminates a chunked response the handler left open.
+void WebServer::Impl::finish() {
+  if (!chunked) return;
+  chunked = false;
+  sim_net_send_all(fd, "0\r\n\r\n", 5);
+}
+
+WebServer::WebServer(uint16_t port) : impl_(new Impl) { impl_->port = port; }
+
+WebServer::~WebServer() { stop(); }
+
+void WebServer::on(const char* path, int method, THandlerFunction fn) { on(path, method, std::move(fn), nullptr); }
+
+void WebServer::on(const char* path, int method, THandlerFunction fn, THandlerFunction uploadFn) {
+  impl_->routes.push_back({path ? path : "", method, std::move(fn), std::move(uploadFn)});
+}
+
+void WebServer::onNotFound(THandlerFunction fn) { impl_->notFound = std::move(fn); }
+
+void WebServer::begin() {
+  if (impl_->listenFd >= 0) return;
+  uint16_t bound = impl_->port;
+  impl_->listenFd = sim_net_listen(impl_->port, bound);
+  if (impl_->listenFd < 0) return;
+  static const bool registered = [] {
+    std::atexit(report);
+    return true;
+  }();
+  (void)registered;
+  Serial.printf("[%lu] [WEB] Serving on http://%s:%u/\n", millis(), sim_config_str("SIM_WEB_BIND", "127.0.0.1"),
+                bound);
+}
+
+void WebServer::stop() {
+  sim_net_close(impl_->fd);
+  sim_net_close(impl_->listenFd);
+}
+
+void WebServer::handleClient() {
+  Impl& s = *impl_;
+  if (s.listenFd < 0) return;
+  if (s.fd < 0) {
+    s.fd = sim_net_accept(s.listenFd);
+    if (s.fd < 0) return;
+    s.acceptedAt = Clock::now();
+  }
+  // Like the device, wait across calls for the request to start arriving.
+  pollfd p{s.fd, POLLIN, 0};
+  if (poll(&p, 1, 0) <= 0) {
+    if (msSince(s.acceptedAt) > kIdleTimeoutMs) sim_net_close(s.fd);
+    return;
+  }
+  s.serve();
+  sim_net_close(s.fd);
+}
+
+void WebServer::send(int code, const char* type, const char* content) {
+  Impl& s = *impl_;
+  if (s.fd < 0 || s.headersSent) return;
+  const size_t len = content ? strlen(content) : 0;
+  std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+  if (type && *type) head += std::string("Content-Type: ") + type + "\r\n";
+  if (s.contentLength == CONTENT_LENGTH_UNKNOWN) {
+    head += "Transfer-Encoding: chunked\r\n";
+    s.chunked = true;
+  } else {
+    head += "Content-Length: " +
+            std::to_string(s.contentLength == CONTENT_LENGTH_NOT_SET ? static_cast<long long>(len) : s.contentLength) +
+            "\r\n";
+  }
+  head += s.extraHeaders + "Connection: close\r\n\r\n";
+  s.headersSent = true;
+  s.contentLength = CONTENT_LENGTH_NOT_SET;
+  sim_net_send_all(s.fd, head.data(), head.size());
+  if (len > 0) sendContent(content, len);
+}
+
+void WebServer::sendContent(const char* content, size_t len) {
+  Impl& s = *impl_;
+  if (s.fd < 0) return;
+  if (!s.chunked) {
+    sim_net_send_all(s.fd, content, len);
+    return;
+  }
+  if (len == 0) {  // an empty chunk ends the response
+    s.finish();
+    return;
+  }
+  char size[16];
+  const int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+  sim_net_send_all(s.fd, size, static_cast<size_t>(n));
+  sim_net_send_all(s.fd, content, len);
+  sim_net_send_all(s.fd, "\r\n", 2);
+}
+
+void WebServer::sendHeader(const char* name, const char* value, bool first) {
+  const std::string line = std::string(name ? name : "") + ": " + (value ? value : "") + "\r\n";
+  impl_->extraHeaders = first ? line + impl_->extraHeaders : impl_->extraHeaders + line;
+}
+
+void WebServer::setContentLength(size_t len) {
+  impl_->contentLength = len == static_cast<size_t>(CONTENT_LENGTH_UNKNOWN) ? CONTENT_LENGTH_UNKNOWN
+                                                                            : static_cast<long long>(len);
+}
+
+WiFiClient WebServer::client() { return WiFiClient(impl_->fd); }
+
+bool WebServer::hasArg(const char* name) const { return find(impl_->args, name) != nullptr; }
+
+String WebServer::arg(const char* name) const {
+  const std::string* v = find(impl_->args, name);
+  return String(v ? *v : std::string());
+}
+
+String WebServer::arg(int i) const {
+  return i >= 0 && i < args() ? String(impl_->args[static_cast<size_t>(i)].second) : String("");
+}
+
+String WebServer::argName(int i) const {
+  return i >= 0 && i < args() ? String(impl_->args[static_cast<size_t>(i)].first) : String("");
+}
+
+int WebServer::args() const { return static_cast<int>(impl_->args.size()); }
+
+bool WebServer::hasHeader(const char* name) const { return find(impl_->headers, name) != nullptr; }
+
+String WebServer::header(const char* name) const {
+  const std::string* v = find(impl_->headers, name);
+  return String(v ? *v : std::string());
+}
+
+String WebServer::uri() const { return String(impl_->uri); }
+
+HTTPMethod WebServer::method() const { return impl_->method; }
+
+HTTPUpload& WebServer::upload() { return impl_->upload; }
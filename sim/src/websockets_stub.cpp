@@ -0,0 +1,336 @@
+// WebSocketsServer for the emulator: RFC 6455 on a host socket. See
+// WebSocketsServer.h.
+
+#include "WebSocketsServer.h"
+
+#include <HardwareSerial.h>
+
+#include "sim_config.h"
+#include "sim_net.h"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kLoopBudgetBytes = 256 * 1024;  // per client per loop()
+constexpr size_t kMaxHandshakeBytes = 8 * 1024;
+constexpr char kAcceptGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum Opcode : uint8_t { kContinuation = 0x0, kText = 0x1, kBinary = 0x2, kClose = 0x8, kPing = 0x9, kPong = 0xA };
+
+void sha1(const uint8_t* data, size_t len, uint8_t out[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  std::vector<uint8_t> msg(data, data + len);
+  msg.push_back(0x80);
+  while (msg.size() % 64 != 56) msg.push_back(0);
+  const uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 7; i >= 0; i--) msg.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+  auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+  for (size_t off = 0; off < msg.size(); off += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+      w[i] = (msg[off + i * 4] << 24) | (msg[off + i * 4 + 1] << 16) | (msg[off + i * 4 + 2] << 8) | msg[off + i * 4 + 3];
+    for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      const uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 20; i++) out[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+std::string headerValue(const std::string& head, const char* name) {
+  const size_t n = strlen(name);
+  size_t pos = head.find("\r\n");
+  while (pos != std::string::npos && pos + 2 < head.size()) {
+    pos += 2;
+    const size_t eol = head.find("\r\n", pos);
+    const std::string line = head.substr(pos, eol == std::string::npos ? std::string::npos : eol - pos);
+    if (line.size() > n && line[n] == ':' && strncasecmp(line.c_str(), name, n) == 0) {
+      const size_t v = line.find_first_not_of(' ', n + 1);
+      return v == std::string::npos ? "" : line.substr(v);
+    }
+    pos = eol;
+  }
+  return "";
+}
+
+struct Client {
+  int fd = -1;
+  bool upgraded = false;
+  std::vector<uint8_t> in;
+  std::vector<uint8_t> message;  // fragments of a message still being received
+  uint8_t messageOpcode = 0;
+};
+
+}  // namespace
+
+struct WebSocketsServer::Impl {
+  uint16_t port;
+  int listenFd = -1;
+  Client clients[WEBSOCKETS_SERVER_CLIENT_MAX];
+  WebSocketServerEvent onEvent;
+
+  void event(uint8_t num, WStype_t type, uint8_t* payload, size_t len) {
+    if (onEvent) onEvent(num, type, payload, len);
+  }
+
+  bool sendFrame(uint8_t num, uint8_t opcode, const uint8_t* payload, size_t len) {
+    Client& c = clients[num];
+    if (c.fd < 0 || !c.upgraded) return false;
+    uint8_t head[10];
+    size_t headLen = 2;
+    head[0] = static_cast<uint8_t>(0x80 | opcode);
+    if (len < 126) {
+      head[1] = static_cast<uint8_t>(len);
+    } else if (len <= 0xFFFF) {
+      head[1] = 126;
+      head[2] = static_cast<uint8_t>(len >> 8);
+      head[3] = static_cast<uint8_t>(len);
+      headLen = 4;
+    } else {
+      head[1] = 127;
+      for (int i = 0; i < 8; i++) head[2 + i] = static_cast<uint8_t>(static_cast<uint64_t>(len) >> ((7 - i) * 8));
+      headLen = 10;
+    }
+    return sim_net_send_all(c.fd, head, headLen) && (len == 0 || sim_net_send_all(c.fd, payload, len));
+  }
+
+  void drop(uint8_t num) {
+    Client& c = clients[num];
+    if (c.fd < 0) return;
+    const bool wasUpgraded = c.upgraded;
+    sim_net_close(c.fd);
+    c = Client();
+    if (wasUpgraded) event(num, WStype_DISCONNECTED, nullptr, 0);
+  }
+
+  void handshake(uint8_t num) {
+    Client& c = clients[num];
+    const auto* begin = reinterpret_cast<const char*>(c.in.data());
+    const char* end = static_cast<const char*>(memmem(begin, c.in.size(), "\r\n\r\n", 4));
+    if (!end) {
+      if (c.in.size() > kMaxHandshakeBytes) drop(num);
+      return;
+    }
+    const std::string head(begin, end - begin);
+    c.in.erase(c.in.begin(), c.in.begin() + (end - begin + 4));
+    const std::string key = headerValue(head, "Sec-WebSocket-Key");
+    if (key.empty() || head.compare(0, 4, "GET ") != 0) {
+      static const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+      sim_net_send_all(c.fd, kBadRequest, sizeof(kBadRequest) - 1);
+      drop(num);
+      return;
+    }
+    const std::string seed = key + kAcceptGuid;
+    uint8_t digest[20];
+    sha1(reinterpret_cast<const uint8_t*>(seed.data()), seed.size(), digest);
+    const std::string response =
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " +
+        sim_net_base64(digest, sizeof(digest)) + "\r\n\r\n";
+    if (!sim_net_send_all(c.fd, response.data(), response.size())) {
+      drop(num);
+      return;
+    }
+    c.upgraded = true;
+    std::string path = head.substr(4, head.find(' ', 4) - 4);
+    event(num, WStype_CONNECTED, reinterpret_cast<uint8_t*>(&path[0]), path.size());
+  }
+
+  // Dispatches every complete frame in the client's buffer.
+  void frames(uint8_t num) {
+    size_t off = 0;
+    for (;;) {
+      Client& c = clients[num];
+      if (c.fd < 0) return;
+      const size_t avail = c.in.size() - off;
+      if (avail < 2) break;
+      const uint8_t* p = c.in.data() + off;
+      const bool fin = p[0] & 0x80;
+      const uint8_t opcode = p[0] & 0x0F;
+      const bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7F;
+      size_t headLen = 2;
+      if (len == 126) {
+        if (avail < 4) break;
+        len = (p[2] << 8) | p[3];
+        headLen = 4;
+      } else if (len == 127) {
+        if (avail < 10) break;
+        len = 0;
+        for (int i = 0; i < 8; i++) len = (len << 8) | p[2 + i];
+        headLen = 10;
+      }
+      const size_t maskAt = headLen;
+      if (masked) headLen += 4;
+      if (avail < headLen + len) break;
+
+      uint8_t* payload = c.in.data() + off + headLen;
+      if (masked)
+        for (uint64_t i = 0; i < len; i++) payload[i] ^= p[maskAt + (i & 3)];
+      off += headLen + static_cast<size_t>(len);
+
+      switch (opcode) {
+        case kClose:
+          sendFrame(num, kClose, payload, std::min<uint64_t>(len, 2));
+          drop(num);
+          return;
+        case kPing:
+          sendFrame(num, kPong, payload, static_cast<size_t>(len));
+          event(num, WStype_PING, payload, static_cast<size_t>(len));
+          break;
+        case kPong:
+          event(num, WStype_PONG, payload, static_cast<size_t>(len));
+          break;
+        case kText:
+        case kBinary:
+        case kContinuation: {
+          if (opcode != kContinuation) {
+            c.message.clear();
+            c.messageOpcode = opcode;
+          }
+          if (fin && opcode != kContinuation) {
+            deliver(num, opcode, payload, static_cast<size_t>(len));
+          } else {
+            c.message.insert(c.message.end(), payload, payload + len);
+            if (fin) {
+              std::vector<uint8_t> whole;
+              whole.swap(c.message);
+              deliver(num, c.messageOpcode, whole.data(), whole.size());
+            }
+          }
+          break;
+        }
+        default:
+          drop(num);
+          return;
+      }
+    }
+    Client& c = clients[num];
+    if (c.fd >= 0) c.in.erase(c.in.begin(), c.in.begin() + off);
+  }
+
+  void deliver(uint8_t num, uint8_t opcode, uint8_t* payload, size_t len) {
+    if (opcode == kText) {
+      // Text payloads are NUL-terminated, as in arduinoWebSockets.
+      std::vector<uint8_t> text(payload, payload + len);
+      text.push_back(0);
+      event(num, WStype_TEXT, text.data(), len);
+    } else {
+      event(num, WStype_BIN, payload, len);
+    }
+  }
+};
+
+WebSocketsServer::WebSocketsServer(uint16_t port) : impl_(new Impl) { impl_->port = port; }
+
+WebSocketsServer::~WebSocketsServer() { close(); }
+
+void WebSocketsServer::begin() {
+  if (impl_->listenFd >= 0) return;
+  uint16_t bound = impl_->port;
+  impl_->listenFd = sim_net_listen(impl_->port, bound);
+  if (impl_->listenFd >= 0)
+    Serial.printf("[%lu] [WS] Listening on ws://%s:%u/\n", millis(), sim_config_str("SIM_WEB_BIND", "127.0.0.1"),
+                  bound);
+}
+
+void WebSocketsServer::close() {
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) disconnect(i);
+  sim_net_close(impl_->listenFd);
+}
+
+void WebSocketsServer::onEvent(WebSocketServerEvent callback) { impl_->onEvent = std::move(callback); }
+
+void WebSocketsServer::loop() {
+  Impl& s = *impl_;
+  if (s.listenFd < 0) return;
+  for (int fd; (fd = sim_net_accept(s.listenFd)) >= 0;) {
+    Client* slot = std::find_if(std::begin(s.clients), std::end(s.clients), [](const Client& c) { return c.fd < 0; });
+    if (slot == std::end(s.clients)) {
+      static const char kBusy[] = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+      sim_net_send_all(fd, kBusy, sizeof(kBusy) - 1);
+      sim_net_close(fd);
+      continue;
+    }
+    slot->fd = fd;
+  }
+
+  uint8_t buf[16 * 1024];
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+    size_t taken = 0;
+    while (s.clients[num].fd >= 0 && taken < kLoopBudgetBytes) {
+      const ssize_t n = sim_net_recv(s.clients[num].fd, buf, sizeof(buf));
+      if (n == -2) break;
+      if (n <= 0) {
+        s.drop(num);
+        break;
+      }
+      s.clients[num].in.insert(s.clients[num].in.end(), buf, buf + n);
+      taken += static_cast<size_t>(n);
+    }
+    if (s.clients[num].fd < 0) continue;
+    if (!s.clients[num].upgraded) s.handshake(num);
+    if (s.clients[num].upgraded) s.frames(num);
+  }
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, const char* payload) {
+  return sendTXT(num, reinterpret_cast<const uint8_t*>(payload), payload ? strlen(payload) : 0);
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, const uint8_t* payload, size_t len) {
+  return num < WEBSOCKETS_SERVER_CLIENT_MAX && impl_->sendFrame(num, kText, payload, len);
+}
+
+bool WebSocketsServer::sendBIN(uint8_t num, const uint8_t* payload, size_t len) {
+  return num < WEBSOCKETS_SERVER_CLIENT_MAX && impl_->sendFrame(num, kBinary, payload, len);
+}
+
+bool WebSocketsServer::broadcastTXT(const char* payload) {
+  bool ok = true;
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++)
+    if (impl_->clients[i].upgraded) ok = sendTXT(i, payload) && ok;
+  return ok;
+}
+
+void WebSocketsServer::disconnect(uint8_t num) {
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) return;
+  if (impl_->clients[num].upgraded) impl_->sendFrame(num, kClose, nullptr, 0);
+  impl_->drop(num);
+}
+
+int WebSocketsServer::connectedClients() {
+  return static_cast<int>(std::count_if(std::begin(impl_->clients), std::end(impl_->clients),
+                                        [](const Client& c) { return c.upgraded; }));
+}
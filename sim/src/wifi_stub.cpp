@@ -1,3 +1,31 @@
 #include "WiFi.h"
+#include "WiFiClient.h"
+
+#include "sim_config.h"
+#include "sim_net.h"
 
 WiFiClass WiFi;
+
+namespace {
+bool connected() {
+  static const bool on = sim_config_flag("SIM_WIFI");
+  return on;
+}
+}  // namespace
+
+wl_status_t WiFiClass::status() const { return connected() ? WL_CONNECTED : WL_DISCONNECTED; }
+
+IPAddress WiFiClass::localIP() const { return connected() ? IPAddress(127, 0, 0, 1) : IPAddress(0, 0, 0, 0); }
+
+String WiFiClass::SSID() const { return String(connected() ? "sim" : ""); }
+
+bool WiFiClass::begin(const char* ssid, const char* pass) {
+  (void)ssid;
+  (void)pass;
+  return connected();
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (fd_ < 0 || !sim_net_send_all(fd_, buf, size)) return 0;
+  return size;
+}
@@ -0,0 +1,268 @@
+/**
+ * ZipEntryIndex — cached ZIP entry table (see ZipEntryIndex.h).
+ */
+
+#include "ZipEntryIndex.h"
+
+#include <HardwareSerial.h>
+#include <SDCardManager.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr char kMagic[4] = {'C', 'P', 'Z', 'I'};
+constexpr uint8_t kVersion = 1;
+constexpr size_t kHeaderBytes = sizeof(kMagic) + 1 + 4 + 4 + 4;
+constexpr size_t kRecordBytes = 4 + 4 + 4 + 4 + 2;
+
+constexpr uint32_t kEocdSig = 0x06054b50;
+constexpr uint32_t kCentralSig = 0x02014b50;
+constexpr uint32_t kLocalSig = 0x04034b50;
+constexpr size_t kEocdBytes = 22;
+constexpr size_t kCentralBytes = 46;
+constexpr size_t kLocalBytes = 30;
+constexpr size_t kShortCommentScan = 1024;  // EPUBs rarely carry an archive comment
+constexpr size_t kMaxComment = 0xFFFF;
+
+uint32_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const uint8_t* p) { return le16(p) | (le16(p + 2) << 16); }
+
+void put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+// Sequential reads of the central directory in chunks rather than per field.
+class ChunkReader {
+ public:
+  explicit ChunkReader(FsFile& file) : file_(file) {}
+
+  bool read(uint8_t* out, size_t n) {
+    while (n > 0) {
+      if (pos_ == len_ && !fill()) return false;
+      const size_t take = std::min(n, len_ - pos_);
+      memcpy(out, buf_ + pos_, take);
+      pos_ += take;
+      out += take;
+      n -= take;
+    }
+    return true;
+  }
+
+  bool skip(size_t n) {
+    while (n > 0) {
+      if (pos_ == len_ && !fill()) return false;
+      const size_t take = std::min(n, len_ - pos_);
+      pos_ += take;
+      n -= take;
+    }
+    return true;
+  }
+
+ private:
+  bool fill() {
+    const int got = file_.read(buf_, sizeof(buf_));
+    if (got <= 0) return false;
+    pos_ = 0;
+    len_ = static_cast<size_t>(got);
+    return true;
+  }
+
+  FsFile& file_;
+  uint8_t buf_[1024];
+  size_t pos_ = 0;
+  size_t len_ = 0;
+};
+
+// Offset of the end-of-central-directory record in the last `window` bytes, or -1.
+long findEocd(FsFile& zip, size_t window) {
+  const size_t size = zip.size();
+  if (size < kEocdBytes) return -1;
+  const size_t span = std::min(size, window + kEocdBytes);
+  std::vector<uint8_t> tail(span);
+  if (!zip.seek(static_cast<uint32_t>(size - span)) || zip.read(tail.data(), span) != static_cast<int>(span))
+    return -1;
+  for (size_t i = span - kEocdBytes + 1; i-- > 0;) {
+    if (le32(&tail[i]) == kEocdSig && i + kEocdBytes + le16(&tail[i + 20]) == span)
+      return static_cast<long>(size - span + i);
+  }
+  return -1;
+}
+}  // namespace
+
+uint32_t ZipEntryIndex::hashName(const char* name, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= static_cast<uint8_t>(name[i]);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+bool ZipEntryIndex::open(const std::string& zipPath, const std::string& indexPath) {
+  close();
+  zip_ = SdMan.open(zipPath.c_str(), O_RDONLY);
+  if (!zip_ || zip_.isDirectory()) return false;
+  const auto zipSize = static_cast<uint32_t>(zip_.size());
+  uint16_t date = 0, time = 0;
+  const uint32_t modified = zip_.getModifyDateTime(&date, &time) ? (static_cast<uint32_t>(date) << 16) | time : 0;
+
+  if (load(indexPath, zipSize, modified)) {
+    buildBuckets();
+    return true;
+  }
+  if (!scan()) {
+    close();
+    return false;
+  }
+  rebuilt_ = true;
+  std::sort(records_.begin(), records_.end(), [](const Record& a, const Record& b) { return a.hash < b.hash; });
+  buildBuckets();
+  save(indexPath, zipSize, modified);
+  return true;
+}
+
+void ZipEntryIndex::close() {
+  zip_.close();
+  records_.clear();
+  rebuilt_ = false;
+}
+
+bool ZipEntryIndex::load(const std::string& indexPath, uint32_t zipSize, uint32_t modified) {
+  if (!SdMan.exists(indexPath.c_str())) return false;
+  FsFile f = SdMan.open(indexPath.c_str(), O_RDONLY);
+  if (!f) return false;
+  uint8_t header[kHeaderBytes];
+  if (f.read(header, sizeof(header)) != static_cast<int>(sizeof(header)) || memcmp(header, kMagic, 4) != 0 ||
+      header[4] != kVersion || le32(header + 5) != zipSize || le32(header + 9) != modified)
+    return false;
+  const uint32_t count = le32(header + 13);
+  if (f.size() != kHeaderBytes + static_cast<size_t>(count) * kRecordBytes) return false;
+
+  records_.resize(count);
+  ChunkReader in(f);
+  uint8_t rec[kRecordBytes];
+  for (Record& r : records_) {
+    if (!in.read(rec, sizeof(rec))) {
+      records_.clear();
+      return false;
+    }
+    r = {le32(rec), le32(rec + 4), le32(rec + 8), le32(rec + 12), static_cast<uint16_t>(le16(rec + 16))};
+  }
+  return true;
+}
+
+bool ZipEntryIndex::scan() {
+  long eocd = findEocd(zip_, kShortCommentScan);
+  if (eocd < 0) eocd = findEocd(zip_, kMaxComment);
+  uint8_t end[kEocdBytes];
+  if (eocd < 0 || !zip_.seek(static_cast<uint32_t>(eocd)) ||
+      zip_.read(end, sizeof(end)) != static_cast<int>(sizeof(end))) {
+    Serial.printf("[%lu] [ZIPIDX] No end of central directory\n", millis());
+    return false;
+  }
+  const uint32_t count = le16(end + 10);
+  const uint32_t cdOffset = le32(end + 16);
+  if (count == 0xFFFF || cdOffset == 0xFFFFFFFF) return false;  // ZIP64
+
+  records_.clear();
+  records_.reserve(count);
+  if (!zip_.seek(cdOffset)) return false;
+  ChunkReader in(zip_);
+  uint8_t h[kCentralBytes];
+  std::string name;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!in.read(h, sizeof(h)) || le32(h) != kCentralSig) {
+      Serial.printf("[%lu] [ZIPIDX] Central directory entry %u unreadable\n", millis(), i);
+      records_.clear();
+      return false;
+    }
+    const uint32_t nameLen = le16(h + 28);
+    name.resize(nameLen);
+    if (!in.read(reinterpret_cast<uint8_t*>(&name[0]), nameLen) || !in.skip(le16(h + 30) + le16(h + 32))) {
+      records_.clear();
+      return false;
+    }
+    const Record r = {hashName(name.data(), nameLen), le32(h + 42), le32(h + 20), le32(h + 24),
+                      static_cast<uint16_t>(le16(h + 10))};
+    if (r.localHeaderOffset == 0xFFFFFFFF || r.compressedSize == 0xFFFFFFFF) {
+      records_.clear();
+      return false;  // ZIP64
+    }
+    records_.push_back(r);
+  }
+  return true;
+}
+
+void ZipEntryIndex::save(const std::string& indexPath, uint32_t zipSize, uint32_t modified) const {
+  FsFile f;
+  if (!SdMan.openFileForWrite("ZIPIDX", indexPath, f)) return;
+  uint8_t header[kHeaderBytes];
+  memcpy(header, kMagic, 4);
+  header[4] = kVersion;
+  put32(header + 5, zipSize);
+  put32(header + 9, modified);
+  put32(header + 13, static_cast<uint32_t>(records_.size()));
+  bool ok = f.write(header, sizeof(header)) == sizeof(header);
+
+  // Records go out through a chunk buffer: one SD write per 56 entries
+  uint8_t buf[kRecordBytes * 56];
+  size_t used = 0;
+  for (const Record& r : records_) {
+    uint8_t* p = buf + used;
+    put32(p, r.hash);
+    put32(p + 4, r.localHeaderOffset);
+    put32(p + 8, r.compressedSize);
+    put32(p + 12, r.uncompressedSize);
+    p[16] = static_cast<uint8_t>(r.method);
+    p[17] = static_cast<uint8_t>(r.method >> 8);
+    used += kRecordBytes;
+    if (used == sizeof(buf)) {
+      ok = ok && f.write(buf, used) == used;
+      used = 0;
+    }
+  }
+  ok = ok && f.write(buf, used) == used;
+  f.close();
+  if (!ok) {
+    SdMan.remove(indexPath.c_str());
+    Serial.printf("[%lu] [ZIPIDX] Could not write %s\n", millis(), indexPath.c_str());
+  }
+}
+
+void ZipEntryIndex::buildBuckets() {
+  size_t i = 0;
+  for (uint32_t b = 0; b < 256; b++) {
+    buckets_[b] = static_cast<uint32_t>(i);
+    while (i < records_.size() && (records_[i].hash >> 24) == b) i++;
+  }
+  buckets_[256] = static_cast<uint32_t>(records_.size());
+}
+
+bool ZipEntryIndex::find(const char* name, Entry& out) {
+  if (!zip_) return false;
+  const size_t nameLen = strlen(name);
+  const uint32_t hash = hashName(name, nameLen);
+  const auto first = records_.begin() + buckets_[hash >> 24];
+  const auto last = records_.begin() + buckets_[(hash >> 24) + 1];
+  auto it = std::lower_bound(first, last, hash, [](const Record& r, uint32_t h) { return r.hash < h; });
+
+  // Hash collisions are told apart by the name in the local header
+  uint8_t local[kLocalBytes];
+  std::string localName;
+  for (; it != last && it->hash == hash; ++it) {
+    if (!zip_.seek(it->localHeaderOffset) || zip_.read(local, sizeof(local)) != static_cast<int>(sizeof(local)) ||
+        le32(local) != kLocalSig || le16(local + 26) != nameLen)
+      continue;
+    localName.resize(nameLen);
+    if (zip_.read(&localName[0], nameLen) != static_cast<int>(nameLen) || localName.compare(0, nameLen, name) != 0)
+      continue;
+    out.localHeaderOffset = it->localHeaderOffset;
+    out.dataOffset = it->localHeaderOffset + kLocalBytes + nameLen + le16(local + 28);
+    out.compressedSize = it->compressedSize;
+    out.uncompressedSize = it->uncompressedSize;
+    out.method = it->method;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,176 @@
+/**
+ * ZipInflater — pooled tinfl streaming for ZIP entries (see ZipInflater.h).
+ */
+
+#include "ZipInflater.h"
+
+#include <HardwareSerial.h>
+#include <freertos/semphr.h>
+#include <miniz.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+constexpr size_t kInputBytes = 4096;  // compressed bytes per SD read
+}  // namespace
+
+struct ZipInflater::Context {
+  tinfl_decompressor inflator;
+  uint8_t window[TINFL_LZ_DICT_SIZE];  // dictionary and output, wrapping
+  uint8_t input[kInputBytes];
+  bool inUse = false;
+};
+
+ZipInflater::Context* ZipInflater::pool[ZipInflater::kPoolSize] = {};
+
+namespace {
+SemaphoreHandle_t poolLock() {
+  static SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+  return lock;
+}
+}  // namespace
+
+bool ZipInflater::begin(FsFile& zip, const ZipEntryIndex::Entry& entry) {
+  end();
+  if (entry.method != 0 && entry.method != 8) {
+    Serial.printf("[%lu] [ZIP] Unsupported compression method %u\n", millis(), entry.method);
+    return false;
+  }
+
+  xSemaphoreTake(poolLock(), portMAX_DELAY);
+  for (Context*& slot : pool) {
+    if (!slot) slot = new (std::nothrow) Context;
+    if (slot && !slot->inUse) {
+      ctx_ = slot;
+      ctx_->inUse = true;
+      break;
+    }
+  }
+  xSemaphoreGive(poolLock());
+  if (!ctx_) {
+    Serial.printf("[%lu] [ZIP] All %d inflaters busy\n", millis(), kPoolSize);
+    return false;
+  }
+
+  zip_ = &zip;
+  method_ = entry.method;
+  readPos_ = entry.dataOffset;
+  compressedLeft_ = entry.compressedSize;
+  expected_ = entry.uncompressedSize;
+  produced_ = 0;
+  inPos_ = inLen_ = 0;
+  windowPos_ = 0;
+  pending_ = nullptr;
+  pendingLen_ = 0;
+  done_ = false;
+  failed_ = false;
+  tinfl_init(&ctx_->inflator);
+  return true;
+}
+
+void ZipInflater::end() {
+  if (!ctx_) return;
+  xSemaphoreTake(poolLock(), portMAX_DELAY);
+  ctx_->inUse = false;
+  xSemaphoreGive(poolLock());
+  ctx_ = nullptr;
+  zip_ = nullptr;
+  done_ = true;
+  pendingLen_ = 0;
+}
+
+void ZipInflater::trimPool() {
+  xSemaphoreTake(poolLock(), portMAX_DELAY);
+  for (Context*& slot : pool) {
+    if (slot && !slot->inUse) {
+      delete slot;
+      slot = nullptr;
+    }
+  }
+  xSemaphoreGive(poolLock());
+}
+
+bool ZipInflater::step() {
+  if (done_ || failed_ || !ctx_) return false;
+
+  if (inPos_ == inLen_ && compressedLeft_ > 0) {
+    const size_t want = std::min<size_t>(kInputBytes, compressedLeft_);
+    if (!zip_->seek(readPos_) || zip_->read(ctx_->input, want) != static_cast<int>(want)) {
+      Serial.printf("[%lu] [ZIP] Entry data unreadable at %u\n", millis(), readPos_);
+      failed_ = true;
+      return false;
+    }
+    readPos_ += want;
+    compressedLeft_ -= want;
+    inPos_ = 0;
+    inLen_ = want;
+  }
+
+  if (method_ == 0) {
+    // Stored: the input buffer is the output
+    pending_ = ctx_->input + inPos_;
+    pendingLen_ = inLen_ - inPos_;
+    inPos_ = inLen_;
+    produced_ += pendingLen_;
+    done_ = compressedLeft_ == 0;
+    return pendingLen_ > 0;
+  }
+
+  size_t inBytes = inLen_ - inPos_;
+  size_t outBytes = TINFL_LZ_DICT_SIZE - windowPos_;
+  const tinfl_status status =
+      tinfl_decompress(&ctx_->inflator, ctx_->input + inPos_, &inBytes, ctx_->window, ctx_->window + windowPos_,
+                       &outBytes, compressedLeft_ > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+  inPos_ += inBytes;
+  pending_ = ctx_->window + windowPos_;
+  pendingLen_ = outBytes;
+  windowPos_ = (windowPos_ + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+  produced_ += outBytes;
+
+  if (status == TINFL_STATUS_DONE) {
+    done_ = true;
+  } else if (status < 0 || (status == TINFL_STATUS_NEEDS_MORE_INPUT && compressedLeft_ == 0 && inPos_ == inLen_)) {
+    Serial.printf("[%lu] [ZIP] Corrupt deflate stream after %u bytes\n", millis(), produced_);
+    failed_ = true;
+    pendingLen_ = 0;
+    return false;
+  }
+  if (done_ && produced_ != expected_) {
+    Serial.printf("[%lu] [ZIP] Entry inflated to %u bytes, expected %u\n", millis(), produced_, expected_);
+    failed_ = true;
+  }
+  return true;
+}
+
+int ZipInflater::read(uint8_t* buf, size_t size) {
+  size_t copied = 0;
+  while (copied < size) {
+    if (pendingLen_ == 0) {
+      if (!step()) break;
+      continue;
+    }
+    const size_t take = std::min(pendingLen_, size - copied);
+    memcpy(buf + copied, pending_, take);
+    pending_ += take;
+    pendingLen_ -= take;
+    copied += take;
+  }
+  if (copied == 0 && failed_) return -1;
+  return static_cast<int>(copied);
+}
+
+bool ZipInflater::inflateTo(const std::function<bool(const uint8_t*, size_t)>& sink) {
+  if (!ctx_) return false;
+  for (;;) {
+    if (pendingLen_ > 0) {
+      const uint8_t* span = pending_;
+      const size_t len = pendingLen_;
+      pendingLen_ = 0;
+      if (!sink(span, len)) return false;
+    }
+    if (!step()) break;
+  }
+  return done_ && !failed_;
+}
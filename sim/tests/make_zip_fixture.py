@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Write the ZIP that crosspoint_zip_inflater_test reads.
+
+The entry contents are generated the same way in zip_inflater_test.cpp, so
+the test checks every inflated byte without a second decompressor and
+without a binary blob in the tree.
+
+  OEBPS/chapter.xhtml  deflated, larger than the 32 KB window and read in
+                       several 4 KB refills
+  OEBPS/figure.bin     stored, larger than one refill
+  mimetype             stored, shorter than one refill
+
+Usage: python3 sim/tests/make_zip_fixture.py <output-dir>
+"""
+
+import os
+import sys
+import zipfile
+
+WORDS = (
+    "river morning lantern harbour letter garden window silence "
+    "evening road bridge station village market tower keeper"
+).split()
+
+
+def chapter():
+    lines = []
+    for i in range(3000):
+        x = (i * 2654435761) & 0xFFFFFFFF
+        words = " ".join(WORDS[(x >> (4 * k)) & 15] for k in range(8))
+        lines.append("<p>%s %d</p>\n" % (words, i))
+    return "".join(lines).encode("ascii")
+
+
+def figure():
+    return bytes(((i * 131) >> 3) & 0xFF for i in range(10000))
+
+
+def add(zf, name, data, method):
+    info = zipfile.ZipInfo(name, date_time=(2026, 1, 1, 0, 0, 0))
+    info.compress_type = method
+    zf.writestr(info, data)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    os.makedirs(sys.argv[1], exist_ok=True)
+    with zipfile.ZipFile(os.path.join(sys.argv[1], "inflate.zip"), "w") as zf:
+        add(zf, "mimetype", b"application/epub+zip", zipfile.ZIP_STORED)
+        add(zf, "OEBPS/chapter.xhtml", chapter(), zipfile.ZIP_DEFLATED)
+        add(zf, "OEBPS/figure.bin", figure(), zipfile.ZIP_STORED)
+
+
+if __name__ == "__main__":
+    main()
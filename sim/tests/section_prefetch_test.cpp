@@ -0,0 +1,150 @@
+// SectionPrefetch: schedule, waitFor and cancel with stand-in section builds.
+//
+// Runs as loopTask (sim_rtos_begin) and never blocks between checks, only
+// yields, like a busy reader loop: a job must still make progress.
+//
+//   SIM_CORES=1 crosspoint_section_prefetch_test   (fibers, as on the device)
+//   SIM_CORES=0 crosspoint_section_prefetch_test   (host threads)
+
+#include <FreeRTOSStub.h>
+#include <SectionPrefetch.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdio>
+
+namespace {
+int g_failures = 0;
+
+void check(bool ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    g_failures++;
+  }
+}
+
+// A section build of `steps` checkpoints; false when cancelled.
+SectionPrefetcher::Job build(int steps, std::atomic<int>* done = nullptr, std::atomic<bool>* started = nullptr) {
+  return [steps, done, started] {
+    if (started) *started = true;
+    for (int i = 0; i < steps; i++) {
+      if (!SectionPrefetcher::checkpoint()) return false;
+    }
+    if (done) (*done)++;
+    return true;
+  };
+}
+
+// A build that only ends when cancelled.
+SectionPrefetcher::Job endless(std::atomic<bool>* started, std::atomic<bool>* stopped) {
+  return [started, stopped] {
+    *started = true;
+    while (SectionPrefetcher::checkpoint()) {
+    }
+    *stopped = true;
+    return false;
+  };
+}
+
+// Yields like loop() until pred holds; false after too many turns.
+template <typename Pred>
+bool yieldUntil(Pred pred) {
+  for (int i = 0; i < 1000000; i++) {
+    if (pred()) return true;
+    taskYIELD();
+  }
+  return false;
+}
+
+void testWaitForRunning() {
+  std::atomic<bool> started{false};
+  SectionPrefetch.schedule(1, 5, build(2000, nullptr, &started));
+  check(yieldUntil([&] { return started.load(); }), "job starts");
+  check(SectionPrefetch.waitFor(1, 5), "waitFor waits for the running job");
+  check(!SectionPrefetch.waitFor(1, 5), "a result is consumed by waitFor");
+}
+
+void testProgressWithoutBlocking() {
+  std::atomic<int> done{0};
+  SectionPrefetch.schedule(1, 1, build(500, &done));
+  check(yieldUntil([&] { return !SectionPrefetch.busy(); }), "job finishes while the reader only yields");
+  check(done == 1, "job ran to the end");
+  check(SectionPrefetch.waitFor(1, 1), "finished job is reported");
+}
+
+void testOlderResultSurvives() {
+  SectionPrefetch.schedule(2, 3, build(10));
+  check(yieldUntil([] { return !SectionPrefetch.busy(); }), "section 3 finishes");
+  SectionPrefetch.schedule(2, 4, build(10));
+  check(yieldUntil([] { return !SectionPrefetch.busy(); }), "section 4 finishes");
+  check(SectionPrefetch.waitFor(2, 3), "section 3 still reported after section 4 ran");
+  check(SectionPrefetch.waitFor(2, 4), "section 4 reported");
+  check(!SectionPrefetch.waitFor(3, 3), "other book not reported");
+}
+
+void testScheduleCancelsRunning() {
+  std::atomic<bool> started{false}, stopped{false};
+  SectionPrefetch.schedule(4, 7, endless(&started, &stopped));
+  check(yieldUntil([&] { return started.load(); }), "endless job starts");
+  std::atomic<bool> replaced{false};
+  SectionPrefetch.schedule(4, 8, build(10, nullptr, &replaced));
+  check(yieldUntil([&] { return replaced.load(); }), "replacement job starts");
+  check(SectionPrefetch.waitFor(4, 8), "replacement job completes");
+  check(stopped, "running job stopped at a checkpoint");
+  check(!SectionPrefetch.waitFor(4, 7), "cancelled job not reported as built");
+}
+
+// The queued job either started already (waitFor waits for it) or is
+// dropped and never runs; in thread mode both can happen.
+void testQueuedJob() {
+  std::atomic<bool> started{false}, stopped{false};
+  std::atomic<int> done{0};
+  SectionPrefetch.schedule(5, 1, endless(&started, &stopped));
+  check(yieldUntil([&] { return started.load(); }), "endless job starts");
+  SectionPrefetch.schedule(5, 2, build(10, &done));
+  const bool built = SectionPrefetch.waitFor(5, 2);
+  check(built == (done == 1), "waitFor reports a queued job only when it ran");
+  SectionPrefetch.cancel();
+  check(stopped, "cancel stops the running job before returning");
+  check(!SectionPrefetch.busy(), "nothing queued after cancel");
+  check(done == (built ? 1 : 0), "a dropped job never runs");
+}
+
+void testCancelStopsRunning() {
+  std::atomic<bool> started{false}, stopped{false};
+  SectionPrefetch.schedule(5, 3, endless(&started, &stopped));
+  check(yieldUntil([&] { return started.load(); }), "endless job starts");
+  SectionPrefetch.cancel();
+  check(stopped, "cancel waits for the running job to stop");
+  check(!SectionPrefetch.waitFor(5, 3), "cancelled job not reported as built");
+}
+
+void testQueuedJobDropped() {
+  std::atomic<int> done{0};
+  SectionPrefetch.schedule(7, 1, build(10, &done));
+  const bool built = SectionPrefetch.waitFor(7, 1);
+  check(!SectionPrefetch.busy(), "waitFor leaves nothing queued");
+  check(built == (done == 1), "waitFor reports a job only when it ran");
+}
+
+void testCancelForgetsResults() {
+  SectionPrefetch.schedule(6, 1, build(10));
+  check(yieldUntil([] { return !SectionPrefetch.busy(); }), "job finishes");
+  SectionPrefetch.cancel();
+  check(!SectionPrefetch.waitFor(6, 1), "cancel forgets finished jobs");
+}
+}  // namespace
+
+int main() {
+  sim_rtos_begin();
+  testWaitForRunning();
+  testProgressWithoutBlocking();
+  testOlderResultSurvives();
+  testScheduleCancelsRunning();
+  testQueuedJob();
+  testCancelStopsRunning();
+  testQueuedJobDropped();
+  testCancelForgetsResults();
+  if (g_failures == 0) printf("section_prefetch_test: ok\n");
+  return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+// ZipInflater: push and pull over the real tinfl, stored entries and the
+// decompressor pool, on the ZIP make_zip_fixture.py writes.
+//
+//   python3 sim/tests/make_zip_fixture.py <dir>
+//   crosspoint_zip_inflater_test <dir>
+//
+// The card is <dir>, read-only; zip.idx goes to a temporary overlay.
+
+#include <FreeRTOSStub.h>
+#include <SdFat.h>
+#include <ZipEntryIndex.h>
+#include <ZipInflater.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+int g_failures = 0;
+
+void check(bool ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    g_failures++;
+  }
+}
+
+// Same contents as make_zip_fixture.py
+const char* const kWords[16] = {"river",   "morning", "lantern", "harbour", "letter", "garden",
+                                "window",  "silence", "evening", "road",    "bridge", "station",
+                                "village", "market",  "tower",   "keeper"};
+
+std::vector<uint8_t> chapter() {
+  std::string text;
+  for (uint32_t i = 0; i < 3000; i++) {
+    const uint32_t x = i * 2654435761u;
+    text += "<p>";
+    for (int k = 0; k < 8; k++) {
+      if (k) text += ' ';
+      text += kWords[(x >> (4 * k)) & 15];
+    }
+    text += ' ' + std::to_string(i) + "</p>\n";
+  }
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> figure() {
+  std::vector<uint8_t> data(10000);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<uint8_t>((i * 131) >> 3);
+  return data;
+}
+
+std::vector<uint8_t> mimetype() {
+  const std::string text = "application/epub+zip";
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> push(ZipInflater& in, bool* ok, size_t* largestSpan = nullptr) {
+  std::vector<uint8_t> out;
+  *ok = in.inflateTo([&](const uint8_t* p, size_t n) {
+    out.insert(out.end(), p, p + n);
+    if (largestSpan && n > *largestSpan) *largestSpan = n;
+    return true;
+  });
+  return out;
+}
+
+// Odd-sized reads, so spans are split across calls
+std::vector<uint8_t> pull(ZipInflater& in, bool* ok) {
+  std::vector<uint8_t> out;
+  uint8_t buf[777];
+  int n;
+  while ((n = in.read(buf, sizeof(buf))) > 0) out.insert(out.end(), buf, buf + n);
+  *ok = n == 0 && in.atEnd();
+  return out;
+}
+
+void testPush(FsFile& zip, ZipEntryIndex& index) {
+  ZipEntryIndex::Entry entry;
+  check(index.find("OEBPS/chapter.xhtml", entry), "chapter found");
+  check(entry.method == 8, "chapter is deflated");
+  ZipInflater in;
+  check(in.begin(zip, entry), "begin on a deflated entry");
+  bool ok = false;
+  size_t largest = 0;
+  const std::vector<uint8_t> out = push(in, &ok, &largest);
+  check(ok, "inflateTo completes the chapter");
+  check(out == chapter(), "pushed chapter matches");
+  check(largest <= 32768, "spans come from the 32 KB window");
+  check(in.produced() == entry.uncompressedSize, "produced() counts the chapter");
+}
+
+void testPushStops(FsFile& zip, ZipEntryIndex& index) {
+  ZipEntryIndex::Entry entry;
+  index.find("OEBPS/chapter.xhtml", entry);
+  ZipInflater in;
+  in.begin(zip, entry);
+  int spans = 0;
+  check(!in.inflateTo([&](const uint8_t*, size_t) { return ++spans < 2; }), "sink returning false stops inflateTo");
+  check(spans == 2, "no span after the sink stopped");
+}
+
+void testPull(FsFile& zip, ZipEntryIndex& index) {
+  ZipEntryIndex::Entry entry;
+  index.find("OEBPS/chapter.xhtml", entry);
+  ZipInflater in;
+  check(in.begin(zip, entry), "begin for read()");
+  bool ok = false;
+  check(pull(in, &ok) == chapter(), "pulled chapter matches");
+  check(ok, "read() ends with 0 at the end of the entry");
+}
+
+void testInterleaved(FsFile& zip, ZipEntryIndex& index) {
+  // Both pooled decompressors on one archive: every refill seeks first
+  ZipEntryIndex::Entry text, fig;
+  index.find("OEBPS/chapter.xhtml", text);
+  index.find("OEBPS/figure.bin", fig);
+  ZipInflater a, b;
+  check(a.begin(zip, text) && b.begin(zip, fig), "two entries at once");
+  std::vector<uint8_t> outA, outB;
+  uint8_t buf[1000];
+  for (int n = 1, m = 1; n > 0 || m > 0;) {
+    if ((n = a.read(buf, sizeof(buf))) > 0) outA.insert(outA.end(), buf, buf + n);
+    if ((m = b.read(buf, sizeof(buf))) > 0) outB.insert(outB.end(), buf, buf + m);
+  }
+  check(outA == chapter(), "interleaved chapter matches");
+  check(outB == figure(), "interleaved figure matches");
+}
+
+void testStored(FsFile& zip, ZipEntryIndex& index) {
+  ZipEntryIndex::Entry entry;
+  check(index.find("OEBPS/figure.bin", entry), "figure found");
+  check(entry.method == 0, "figure is stored");
+  ZipInflater in;
+  in.begin(zip, entry);
+  bool ok = false;
+  check(push(in, &ok) == figure(), "pushed stored entry matches");
+  check(ok, "inflateTo completes a stored entry");
+
+  check(index.find("mimetype", entry), "mimetype found");
+  in.begin(zip, entry);
+  check(pull(in, &ok) == mimetype(), "pulled short stored entry matches");
+  check(ok, "short stored entry ends");
+}
+
+void testPoolExhausted(FsFile& zip, ZipEntryIndex& index) {
+  ZipEntryIndex::Entry entry;
+  index.find("OEBPS/chapter.xhtml", entry);
+  ZipInflater in[ZipInflater::kPoolSize + 1];
+  for (int i = 0; i < ZipInflater::kPoolSize; i++) check(in[i].begin(zip, entry), "begin while the pool has room");
+  check(!in[ZipInflater::kPoolSize].begin(zip, entry), "begin fails with every decompressor busy");
+  in[0].end();
+  check(in[ZipInflater::kPoolSize].begin(zip, entry), "end() returns a decompressor to the pool");
+  bool ok = false;
+  check(push(in[ZipInflater::kPoolSize], &ok) == chapter() && ok, "reused decompressor inflates from the start");
+
+  for (ZipInflater& i : in) i.end();
+  ZipInflater::trimPool();
+  ZipInflater again;
+  check(again.begin(zip, entry), "begin after trimPool() allocates again");
+}
+
+void testUnsupportedMethod(FsFile& zip) {
+  ZipEntryIndex::Entry entry;
+  entry.method = 12;  // bzip2
+  ZipInflater in;
+  check(!in.begin(zip, entry), "begin rejects other compression methods");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  char card[PATH_MAX];
+  if (argc != 2 || !realpath(argv[1], card)) {
+    fprintf(stderr, "usage: %s <dir with inflate.zip from make_zip_fixture.py>\n", argv[0]);
+    return 2;
+  }
+  char overlay[] = "/tmp/crosspoint_zip_inflater_test.XXXXXX";
+  if (!mkdtemp(overlay)) {
+    perror("mkdtemp");
+    return 2;
+  }
+  sim_rtos_begin();
+  FsFile::setRootPath(card);
+  FsFile::setOverlayPath(overlay);
+
+  {
+    ZipEntryIndex index;
+    FsFile zip;
+    check(index.open("/inflate.zip", "/inflate.idx"), "ZipEntryIndex opens the fixture");
+    check(index.size() == 3, "three entries indexed");
+    check(zip.open("/inflate.zip", O_RDONLY), "fixture opens");
+    testPush(zip, index);
+    testPushStops(zip, index);
+    testPull(zip, index);
+    testInterleaved(zip, index);
+    testStored(zip, index);
+    testPoolExhausted(zip, index);
+    testUnsupportedMethod(zip);
+  }
+
+  unlink((std::string(overlay) + "/inflate.idx").c_str());
+  rmdir(overlay);
+  if (g_failures == 0) printf("zip_inflater_test: ok\n");
+  return g_failures == 0 ? 0 : 1;
+}